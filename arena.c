@@ -0,0 +1,105 @@
+// Arena allocator //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN (sizeof(max_align_t)) // every allocation is aligned for any type //
+
+// ********** arena_init ********** //
+// create an empty arena; no memory is allocated until it is used //
+void arena_init(arena_t *arena)
+{
+  arena->head = NULL;
+  arena->used = 0;
+  arena->reserved = 0;
+  arena->allocations = 0;
+}
+
+// ********** arena_alloc ********** //
+// get size bytes from the arena, adding a block if the current //
+// one is full; returns NULL on memory allocation failure       //
+void *arena_alloc(arena_t *arena, size_t size)
+{
+  arenablock_t *block = arena->head;
+  void *result;
+
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+  if (block == NULL || block->size - block->used < size)
+    {
+      size_t blocksize = size > ARENA_BLOCK_SIZE / 4 ? size : ARENA_BLOCK_SIZE;
+
+      block = (arenablock_t *)malloc(sizeof(arenablock_t) + blocksize);
+      if (block == NULL)
+        {
+          return NULL;
+        }
+
+      block->size = blocksize;
+      block->used = 0;
+      arena->reserved += sizeof(arenablock_t) + blocksize;
+
+      // a block of its own goes behind the current one, //
+      // so the free space of the current one is kept    //
+      if (blocksize != ARENA_BLOCK_SIZE && arena->head != NULL)
+        {
+          block->next = arena->head->next;
+          arena->head->next = block;
+        }
+      else
+        {
+          block->next = arena->head;
+          arena->head = block;
+        }
+    }
+
+  result = (char *)block->data + block->used;
+  block->used += size;
+  arena->used += size;
+  arena->allocations++;
+
+  return result;
+}
+
+// ********** arena_strdup ********** //
+// copy a string into the arena; returns NULL //
+// on memory allocation failure               //
+char *arena_strdup(arena_t *arena, const char *string)
+{
+  return arena_strndup(arena, string, strlen(string));
+}
+
+// ********** arena_strndup ********** //
+// copy length bytes of a string into the arena, '\0' //
+// terminated; returns NULL on allocation failure     //
+char *arena_strndup(arena_t *arena, const char *string, size_t length)
+{
+  char *copy = (char *)arena_alloc(arena, length + 1);
+
+  if (copy != NULL)
+    {
+      memcpy(copy, string, length);
+      copy[length] = '\0';
+    }
+
+  return copy;
+}
+
+// ********** arena_free ********** //
+// free all the blocks of the arena at once //
+void arena_free(arena_t *arena)
+{
+  arenablock_t *block = arena->head, *next;
+
+  while (block != NULL)
+    {
+      next = block->next;
+      free(block);
+      block = next;
+    }
+
+  arena_init(arena);
+}
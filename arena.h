@@ -0,0 +1,47 @@
+// Header file for the arena allocator //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+/* An arena hands out memory from large blocks by bumping a pointer, so
+many small allocations, e.g. the bounds of the registers, sit next to each
+other instead of being scattered over the heap. Nothing is freed on its
+own; the whole arena is freed at once with arena_free.
+*/
+
+#ifndef __ARENA_H_
+#define __ARENA_H_
+
+#include <stddef.h>
+
+// Preprocessor //
+#define ARENA_BLOCK_SIZE 65536 // the size of a block; larger allocations get a block of their own //
+
+// Structs //
+// Arena Block Struct //
+struct arenablock{
+	struct arenablock *next; // the previously allocated block //
+	size_t size; // the usable size of the block //
+	size_t used; // the bytes handed out from the block //
+	max_align_t data[]; // the memory of the block //
+};
+
+typedef struct arenablock arenablock_t;
+
+// Arena Struct //
+struct arena{
+	arenablock_t *head; // the block allocations are made from //
+	size_t used; // the bytes handed out //
+	size_t reserved; // the bytes allocated for the blocks //
+	size_t allocations; // the number of allocations //
+};
+
+typedef struct arena arena_t;
+
+// Function Prototypes //
+void arena_init(arena_t *arena);
+void *arena_alloc(arena_t *arena, size_t size);
+char *arena_strdup(arena_t *arena, const char *string);
+char *arena_strndup(arena_t *arena, const char *string, size_t length);
+void arena_free(arena_t *arena);
+
+#endif
@@ -0,0 +1,532 @@
+/*********************** SERIAL PORT COMMUNICATION BENCHMARK ***********************/
+// Author: Vangelis Bakas //
+// Last Edited: 1/2/2023 //
+// Task: Measure the latency and throughput of the AT-COMMAND server //
+
+/* This program measures the server the way a client sees it. It opens a pair
+of pseudo terminals for every port, starts the server on their slave sides and
+drives a workload through the master sides, one thread per port:
+  1. read: 'AT+REGn' over the registers of the table.
+  2. write: 'AT+REGn=<int>' over the registers of the table.
+  3. mixed: nine reads for every write.
+  4. insert: an insertion storm, 'insert+<int>+0-100'.
+  5. batch: 'AT+REGa..REGb' ranges of -k registers each.
+
+The requests are sent in the line framing mode, tagged as in the client's
+pipelined mode, with up to -p of them in flight per port. The time from the
+write of a request to the arrival of its reply is its latency; once every
+port is done, the percentiles of all the latencies and the requests per second
+are printed, the last line in a "key=value" form for scripts to compare.
+*/
+
+// Libraries //
+#define _GNU_SOURCE // for the pseudo terminals, posix_openpt and ptsname_r //
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <pthread.h>
+#include "commonfunc.h"
+
+// Preprocessor //
+#define MAX_PORTS 64 // the most ports driven at once //
+#define MAX_DEPTH 256 // the most requests in flight per port, as in the client //
+#define MAX_ARGS 64 // the most arguments passed to the server //
+#define DEFAULT_REQUESTS 10000 // requests per port //
+#define DEFAULT_TIMEOUT 2000 // milliseconds to wait for a reply before giving up //
+#define PRELOAD_VALUE "0+0-16535" // the definition of the registers added before the run //
+
+// the workloads //
+#define WORK_READ 0
+#define WORK_WRITE 1
+#define WORK_MIXED 2
+#define WORK_INSERT 3
+#define WORK_BATCH 4
+
+// Structs //
+// Bench Port Struct //
+// One pseudo terminal pair and the results of the thread driving it //
+struct benchport{
+	int master; // the side the benchmark writes the requests to //
+	int slave; // kept open so the master never sees a hang up //
+	char path[64]; // the slave side, served by the server //
+	framereader_t reader; // to split the replies //
+	long long *latencies; // nanoseconds per reply //
+	long completed; // replies received //
+	long errors; // error replies, and requests given up on //
+	pthread_t thread;
+};
+
+typedef struct benchport benchport_t;
+
+// Bench Globals //
+const char *workload_names[] = {"read", "write", "mixed", "insert", "batch"};
+int workload = WORK_READ; // the selected workload //
+long requests = DEFAULT_REQUESTS; // requests per port //
+int depth = 1; // requests in flight per port //
+int registers = 2; // the registers the table has before the run //
+int batch_size = 16; // the registers of a batch request //
+int reply_timeout = DEFAULT_TIMEOUT; // milliseconds //
+
+// ********** monotonic_ns ********** //
+// current time of the monotonic clock, in nanoseconds //
+long long monotonic_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// ********** open_pair ********** //
+// open a pseudo terminal pair with the slave side set up as a //
+// serial port; returns 0 on success and -1 on failure         //
+int open_pair(benchport_t *port)
+{
+  lineconf_t conf;
+
+  port->master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (port->master < 0 || grantpt(port->master) != 0 || unlockpt(port->master) != 0
+      || ptsname_r(port->master, port->path, sizeof(port->path)) != 0)
+    {
+      perror("posix_openpt");
+      return -1;
+    }
+
+  // set the slave raw before the server opens it, so nothing is echoed back //
+  port->slave = my_open(port->path, O_RDWR | O_NOCTTY);
+  line_config_init(&conf);
+  if (port->slave < 0 || set_interface_attributes(port->slave, &conf) != 0)
+    {
+      return -1;
+    }
+
+  frame_reader_init(&port->reader, FRAME_LINE);
+  return 0;
+}
+
+// ********** start_server ********** //
+// start the server on the slave sides of the ports, with the extra //
+// arguments given; returns the server pid, or -1 on failure        //
+pid_t start_server(const char *path, char *extra, benchport_t *ports, int count, int verbose)
+{
+  char *args[MAX_ARGS + MAX_PORTS + 4];
+  int numofargs = 0;
+  char *token = NULL, *saveptr = NULL;
+  pid_t pid;
+
+  args[numofargs++] = (char *)path;
+  args[numofargs++] = "-m";
+  args[numofargs++] = "line";
+  for (token = strtok_r(extra, " \t", &saveptr); token != NULL && numofargs < MAX_ARGS; token = strtok_r(NULL, " \t", &saveptr))
+    {
+      args[numofargs++] = token;
+    }
+  for (int i = 0; i < count; i++)
+    {
+      args[numofargs++] = ports[i].path;
+    }
+  args[numofargs] = NULL;
+
+  pid = fork();
+  if (pid == 0)
+    {
+      if (!verbose)
+        {
+          int null = open("/dev/null", O_WRONLY);
+          dup2(null, STDOUT_FILENO);
+          dup2(null, STDERR_FILENO);
+        }
+      execv(path, args);
+      perror("execv");
+      _exit(127);
+    }
+
+  return pid;
+}
+
+// ********** read_reply ********** //
+// wait for the next reply on a port; returns it, or NULL if //
+// none arrived within the timeout                           //
+char *read_reply(benchport_t *port)
+{
+  char *reply = NULL;
+  long long deadline = monotonic_ms() + reply_timeout, remaining;
+
+  while ((reply = frame_next(&port->reader)) == NULL)
+    {
+      remaining = deadline - monotonic_ms();
+      if (remaining < 0 || wait_readable(port->master, (int)remaining) != 1 || frame_fill(&port->reader, port->master) < 0)
+        {
+          return NULL;
+        }
+    }
+
+  return reply;
+}
+
+// ********** preload ********** //
+// add registers to the table through the first port, so that //
+// the workload spreads over registers-2 more of them; returns //
+// 0 on success and -1 on failure                              //
+int preload(benchport_t *port)
+{
+  static char request[FRAME_MAX];
+  size_t length;
+  int added = 2; // the default registers //
+  char *reply = NULL;
+
+  while (added < registers)
+    {
+      length = sprintf(request, "bulkinsert+%s", PRELOAD_VALUE);
+      added++;
+      while (added < registers && length + sizeof(PRELOAD_VALUE) + 2 < FRAME_MAX - 1)
+        {
+          length += sprintf(request + length, ";%s", PRELOAD_VALUE);
+          added++;
+        }
+
+      frame_write(port->master, FRAME_LINE, request);
+      if ((reply = read_reply(port)) == NULL || strncmp(reply, "INSERTED", 8) != 0)
+        {
+          fprintf(stderr, "ERROR: Could not add the registers: %s\n", reply != NULL ? reply : "no reply");
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
+// ********** make_request ********** //
+// build the i-th request of the workload //
+void make_request(long i, char *request, size_t size)
+{
+  int index = (int)(i % registers) + 1;
+  int span = batch_size < registers ? batch_size : registers;
+  long value = index == 2 ? i % 3 + 1 : i % 16534 + 1; // within the bounds, 0-16535 excludes its ends //
+
+  switch (workload)
+    {
+    case WORK_WRITE:
+      snprintf(request, size, "AT+REG%d=%ld", index, value);
+      break;
+
+    case WORK_MIXED:
+      if (i % 10 == 0)
+        {
+          snprintf(request, size, "AT+REG%d=%ld", index, value);
+        }
+      else
+        {
+          snprintf(request, size, "AT+REG%d", index);
+        }
+      break;
+
+    case WORK_INSERT:
+      snprintf(request, size, "insert+%ld+0-100", i % 101);
+      break;
+
+    case WORK_BATCH:
+      index = (int)(i % (registers - span + 1)) + 1;
+      snprintf(request, size, "AT+REG%d..REG%d", index, index + span - 1);
+      break;
+
+    default:
+      snprintf(request, size, "AT+REG%d", index);
+      break;
+    }
+}
+
+// ********** drive_port ********** //
+// thread function, send the requests of the workload to a port, //
+// keeping up to depth of them in flight, and time their replies //
+void *drive_port(void *arg)
+{
+  benchport_t *port = (benchport_t *)arg;
+  long long sent_at[MAX_DEPTH]; // send times of the requests in flight, by sequence //
+  char tag[16], request[64];
+  struct iovec parts[2];
+  char *reply = NULL, *end = NULL;
+  long sent = 0, done = 0;
+  unsigned long seq;
+
+  while (done < requests)
+    {
+      // keep the window full //
+      while (sent < requests && sent - done < depth)
+        {
+          make_request(sent, request, sizeof(request));
+          parts[0].iov_base = tag;
+          parts[0].iov_len = snprintf(tag, sizeof(tag), "#%ld ", sent + 1);
+          parts[1].iov_base = request;
+          parts[1].iov_len = strlen(request);
+          sent_at[sent % MAX_DEPTH] = monotonic_ns();
+          frame_writev(port->master, FRAME_LINE, parts, 2);
+          sent++;
+        }
+
+      if ((reply = read_reply(port)) == NULL)
+        {
+          // the server stopped answering; give up on the rest //
+          port->errors += requests - done;
+          break;
+        }
+
+      if (reply[0] != '#')
+        {
+          continue; // a late reply to the probe, see main //
+        }
+
+      seq = strtoul(reply + 1, &end, 10);
+      if (seq != (unsigned long)done + 1)
+        {
+          port->errors++; // the replies of a port come in order; this is not one //
+          continue;
+        }
+
+      port->latencies[port->completed++] = monotonic_ns() - sent_at[done % MAX_DEPTH];
+      if (strstr(end, "INVALID") != NULL || strstr(end, "InvalidInput") != NULL)
+        {
+          port->errors++;
+        }
+      done++;
+    }
+
+  return NULL;
+}
+
+// ********** compare_latencies ********** //
+// qsort comparison function for the latencies //
+int compare_latencies(const void *a, const void *b)
+{
+  long long x = *(const long long *)a, y = *(const long long *)b;
+
+  return (x > y) - (x < y);
+}
+
+// ********** percentile ********** //
+// the latency below which the given fraction of the sorted //
+// latencies are, in microseconds                           //
+double percentile(const long long *sorted, long count, double fraction)
+{
+  long rank = (long)(fraction * count + 0.999999);
+
+  if (count == 0)
+    {
+      return 0;
+    }
+
+  rank = rank < 1 ? 1 : rank > count ? count : rank;
+  return sorted[rank - 1] / 1000.0;
+}
+
+// ********** server_path ********** //
+// the server built next to this program //
+void server_path(char *path, size_t size)
+{
+  ssize_t length = readlink("/proc/self/exe", path, size - 8);
+  char *slash = NULL;
+
+  path[length > 0 ? length : 0] = '\0';
+  slash = strrchr(path, '/');
+  strcpy(slash != NULL ? slash + 1 : path, "server");
+}
+
+// ********** main program ********** //
+int main(int argc, char *argv[])
+{
+  int option, count = 1, verbose = 0;
+  char server[4096] = "";
+  char extra[1024] = ""; // the extra server arguments //
+  benchport_t *ports = NULL;
+  long long *all = NULL, started, elapsed;
+  long total = 0, errors = 0;
+  pid_t pid;
+  int status;
+  double seconds;
+
+  server_path(server, sizeof(server));
+
+  // check the options, i.e. the workload, the requests per port, the pipeline //
+  // depth, the ports, the registers, the batch size, the reply timeout, the    //
+  // server with its extra arguments, and whether to show the server output     //
+  while ((option = getopt(argc, argv, "w:n:p:P:r:k:t:S:a:v")) != -1)
+    {
+      if (option == 'w')
+        {
+          workload = -1;
+          for (int i = 0; i < (int)(sizeof(workload_names) / sizeof(workload_names[0])); i++)
+            {
+              workload = strcmp(optarg, workload_names[i]) == 0 ? i : workload;
+            }
+          if (workload < 0)
+            {
+              fprintf(stderr, "ERROR: Unknown workload %s\n", optarg);
+              return 1;
+            }
+        }
+      else if (option == 'n' && atol(optarg) > 0)
+        {
+          requests = atol(optarg);
+        }
+      else if (option == 'p' && atoi(optarg) >= 1 && atoi(optarg) <= MAX_DEPTH)
+        {
+          depth = atoi(optarg);
+        }
+      else if (option == 'P' && atoi(optarg) >= 1 && atoi(optarg) <= MAX_PORTS)
+        {
+          count = atoi(optarg);
+        }
+      else if (option == 'r' && atoi(optarg) >= 2)
+        {
+          registers = atoi(optarg);
+        }
+      else if (option == 'k' && atoi(optarg) >= 1)
+        {
+          batch_size = atoi(optarg);
+        }
+      else if (option == 't' && atoi(optarg) >= 1)
+        {
+          reply_timeout = atoi(optarg);
+        }
+      else if (option == 'S')
+        {
+          snprintf(server, sizeof(server), "%s", optarg);
+        }
+      else if (option == 'a')
+        {
+          snprintf(extra, sizeof(extra), "%s", optarg);
+        }
+      else if (option == 'v')
+        {
+          verbose = 1;
+        }
+      else
+        {
+          fprintf(stderr, "Usage: %s [-w read|write|mixed|insert|batch] [-n requests per port] [-p depth] [-P ports] "
+                  "[-r registers] [-k batch size] [-t timeout_ms] [-S server] [-a \"server arguments\"] [-v]\n", argv[0]);
+          return 1;
+        }
+    }
+
+  ports = (benchport_t *)calloc(count, sizeof(benchport_t));
+  if (ports == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in bench\n");
+      return 1;
+    }
+
+  for (int i = 0; i < count; i++)
+    {
+      ports[i].latencies = (long long *)malloc(requests * sizeof(long long));
+      if (ports[i].latencies == NULL || open_pair(&ports[i]) != 0)
+        {
+          fprintf(stderr, "ERROR: Could not set up port %d\n", i + 1);
+          return 1;
+        }
+    }
+
+  if ((pid = start_server(server, extra, ports, count, verbose)) < 0)
+    {
+      perror("fork");
+      return 1;
+    }
+
+  // the server is up once it answers //
+  for (int tries = 0; ; tries++)
+    {
+      frame_write(ports[0].master, FRAME_LINE, "AT+REG1");
+      if (read_reply(&ports[0]) != NULL)
+        {
+          break;
+        }
+      if (tries == 10 || waitpid(pid, &status, WNOHANG) == pid)
+        {
+          fprintf(stderr, "ERROR: The server %s did not start\n", server);
+          kill(pid, SIGTERM);
+          return 1;
+        }
+    }
+
+  if (registers > 2 && preload(&ports[0]) != 0)
+    {
+      kill(pid, SIGTERM);
+      return 1;
+    }
+
+  printf("workload %s, %d port(s), depth %d, %ld requests per port, %d registers\n",
+         workload_names[workload], count, depth, requests, registers);
+
+  started = monotonic_ns();
+  for (int i = 0; i < count; i++)
+    {
+      pthread_create(&ports[i].thread, NULL, drive_port, &ports[i]);
+    }
+  for (int i = 0; i < count; i++)
+    {
+      pthread_join(ports[i].thread, NULL);
+    }
+  elapsed = monotonic_ns() - started;
+
+  // all the latencies together //
+  for (int i = 0; i < count; i++)
+    {
+      total += ports[i].completed;
+      errors += ports[i].errors;
+    }
+  all = (long long *)malloc((total + 1) * sizeof(long long));
+  if (all == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in bench\n");
+      kill(pid, SIGTERM);
+      return 1;
+    }
+  total = 0;
+  for (int i = 0; i < count; i++)
+    {
+      memcpy(all + total, ports[i].latencies, ports[i].completed * sizeof(long long));
+      total += ports[i].completed;
+    }
+  qsort(all, total, sizeof(long long), compare_latencies);
+
+  seconds = elapsed / 1e9;
+  printf("  throughput: %.1f req/s (%ld replies in %.3f s, %ld errors)\n", total / seconds, total, seconds, errors);
+  printf("  latency us: p50 %.1f p99 %.1f p999 %.1f max %.1f\n", percentile(all, total, 0.50),
+         percentile(all, total, 0.99), percentile(all, total, 0.999), percentile(all, total, 1.0));
+  printf("RESULT workload=%s ports=%d depth=%d requests=%ld errors=%ld rps=%.1f p50_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f\n",
+         workload_names[workload], count, depth, total, errors, total / seconds, percentile(all, total, 0.50),
+         percentile(all, total, 0.99), percentile(all, total, 0.999), percentile(all, total, 1.0));
+
+  // stop the server: every port sends its termination request //
+  for (int i = 0; i < count; i++)
+    {
+      frame_write(ports[i].master, FRAME_LINE, "quit");
+    }
+  for (int tries = 0; waitpid(pid, &status, WNOHANG) != pid; tries++)
+    {
+      if (tries == 200)
+        {
+          kill(pid, SIGTERM); // not done after 2 seconds //
+          waitpid(pid, &status, 0);
+          break;
+        }
+      usleep(10000);
+    }
+
+  for (int i = 0; i < count; i++)
+    {
+      my_close(ports[i].master);
+      my_close(ports[i].slave);
+      free(ports[i].latencies);
+    }
+  free(ports);
+  free(all);
+
+  return errors > 0 ? 2 : 0;
+}
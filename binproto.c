@@ -0,0 +1,360 @@
+// Encoding and decoding of the compact binary protocol //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+#include "binproto.h"
+#include <string.h>
+
+#define VARINT_MAX 5 // the longest varint of a 32-bit number //
+
+// CRC-16/CCITT (polynomial 0x1021), processed four bits at a time //
+static const uint16_t crc_table[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+// ********** bin_crc16 ********** //
+// CRC-16/CCITT of a block of bytes, with 0xFFFF as initial value //
+uint16_t bin_crc16(const uint8_t *data, size_t length)
+{
+  uint16_t crc = 0xFFFF;
+
+  for (size_t i = 0; i < length; i++)
+    {
+      crc = (uint16_t)(crc << 4) ^ crc_table[(crc >> 12) ^ (data[i] >> 4)];
+      crc = (uint16_t)(crc << 4) ^ crc_table[(crc >> 12) ^ (data[i] & 0x0F)];
+    }
+
+  return crc;
+}
+
+// ********** put_varint ********** //
+// write an unsigned number as a little-endian base-128 varint //
+// returns the number of bytes written, 1 to 5                  //
+static size_t put_varint(uint8_t *out, uint32_t value)
+{
+  size_t length = 0;
+
+  while (value >= 0x80)
+    {
+      out[length++] = (uint8_t)(value | 0x80);
+      value >>= 7;
+    }
+  out[length++] = (uint8_t)value;
+
+  return length;
+}
+
+// ********** get_varint ********** //
+// read a varint from *in, without going past end; on success *in //
+// is moved past it and 0 is returned, -1 if it is incomplete     //
+static int get_varint(const uint8_t **in, const uint8_t *end, uint32_t *value)
+{
+  uint32_t result = 0;
+
+  for (int shift = 0; shift < 7 * VARINT_MAX && *in < end; shift += 7)
+    {
+      uint8_t byte = *(*in)++;
+
+      result |= (uint32_t)(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        {
+          *value = result;
+          return 0;
+        }
+    }
+
+  return -1;
+}
+
+// ********** put_int32 / get_int32 ********** //
+// fixed width little-endian 32-bit values //
+static size_t put_int32(uint8_t *out, int32_t value)
+{
+  uint32_t bits = (uint32_t)value;
+
+  out[0] = (uint8_t)bits;
+  out[1] = (uint8_t)(bits >> 8);
+  out[2] = (uint8_t)(bits >> 16);
+  out[3] = (uint8_t)(bits >> 24);
+
+  return 4;
+}
+
+static int get_int32(const uint8_t **in, const uint8_t *end, int32_t *value)
+{
+  const uint8_t *p = *in;
+
+  if (end - p < 4)
+    {
+      return -1;
+    }
+
+  *value = (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+  *in = p + 4;
+
+  return 0;
+}
+
+// ********** encode_frame ********** //
+// wrap a body into a complete frame: sync byte, length and CRC //
+// returns the frame length                                     //
+static size_t encode_frame(uint8_t *frame, const uint8_t *body, size_t length)
+{
+  size_t header;
+  uint16_t crc = bin_crc16(body, length);
+
+  frame[0] = BIN_SYNC;
+  header = 1 + put_varint(frame + 1, (uint32_t)length);
+  memcpy(frame + header, body, length);
+  frame[header + length] = (uint8_t)crc;
+  frame[header + length + 1] = (uint8_t)(crc >> 8);
+
+  return header + length + 2;
+}
+
+// ********** bin_next_frame ********** //
+// take the next complete binary frame out of the reader; returns //
+// its body and sets length, or returns NULL if no complete frame //
+// has been received yet; bytes that do not start a valid frame,  //
+// or frames with a bad length or a wrong CRC, are skipped until  //
+// the next sync                                                  //
+const uint8_t *bin_next_frame(framereader_t *reader, size_t *length)
+{
+  const uint8_t *frame, *body, *end;
+  uint32_t body_length;
+
+  while (reader->start < reader->len)
+    {
+      frame = (const uint8_t *)reader->buf + reader->start;
+      end = (const uint8_t *)reader->buf + reader->len;
+
+      if (frame[0] != BIN_SYNC)
+        {
+          reader->start++; // resynchronise on the next sync byte //
+          continue;
+        }
+
+      body = frame + 1;
+      if (get_varint(&body, end, &body_length) != 0)
+        {
+          if (end - (frame + 1) < VARINT_MAX)
+            {
+              return NULL; // the length has not fully arrived yet //
+            }
+
+          reader->start++; // no valid length can be this long //
+          reader->dropped++;
+          continue;
+        }
+
+      if (body_length == 0 || body_length > BIN_BODY_MAX)
+        {
+          reader->start++;
+          reader->dropped++;
+          continue;
+        }
+
+      if ((size_t)(end - body) < body_length + 2)
+        {
+          return NULL; // the body or the CRC has not fully arrived yet //
+        }
+
+      if (bin_crc16(body, body_length) != (uint16_t)(body[body_length] | body[body_length + 1] << 8))
+        {
+          reader->start++;
+          reader->dropped++;
+          continue;
+        }
+
+      reader->start = (const char *)(body + body_length + 2) - reader->buf;
+      *length = body_length;
+      return body;
+    }
+
+  return NULL;
+}
+
+// ********** bin_encode_request ********** //
+// encode a request into a complete frame; returns the frame length, //
+// or 0 if the request does not fit in a frame                      //
+size_t bin_encode_request(uint8_t *frame, const binmsg_t *msg)
+{
+  uint8_t body[BIN_BODY_MAX];
+  size_t length = 0;
+
+  body[length++] = msg->opcode;
+  length += put_varint(body + length, msg->seq);
+
+  switch (msg->opcode)
+    {
+    case BIN_READ:
+    case BIN_BOUNDS:
+      length += put_varint(body + length, msg->index);
+      break;
+
+    case BIN_WRITE:
+      length += put_varint(body + length, msg->index);
+      length += put_int32(body + length, msg->value);
+      break;
+
+    case BIN_INSERT:
+      length += put_int32(body + length, msg->value);
+      if (length + msg->boundslen > BIN_BODY_MAX)
+        {
+          return 0;
+        }
+      memcpy(body + length, msg->bounds, msg->boundslen);
+      length += msg->boundslen;
+      break;
+
+    default:
+      break;
+    }
+
+  return encode_frame(frame, body, length);
+}
+
+// ********** bin_encode_response ********** //
+// encode a response into a complete frame; returns the frame length, //
+// or 0 if the response does not fit in a frame                      //
+size_t bin_encode_response(uint8_t *frame, const binmsg_t *msg)
+{
+  uint8_t body[BIN_BODY_MAX];
+  size_t length = 0;
+
+  body[length++] = msg->opcode;
+  body[length++] = msg->status;
+  length += put_varint(body + length, msg->seq);
+
+  if (msg->status == BIN_OK)
+    {
+      switch (msg->opcode)
+        {
+        case BIN_READ:
+          length += put_int32(body + length, msg->value);
+          break;
+
+        case BIN_BOUNDS:
+          if (length + msg->boundslen > BIN_BODY_MAX)
+            {
+              return 0;
+            }
+          memcpy(body + length, msg->bounds, msg->boundslen);
+          length += msg->boundslen;
+          break;
+
+        case BIN_INSERT:
+          length += put_varint(body + length, msg->index);
+          break;
+
+        case BIN_NOTIFY:
+          length += put_varint(body + length, msg->index);
+          length += put_int32(body + length, msg->value);
+          break;
+
+        default:
+          break;
+        }
+    }
+
+  return encode_frame(frame, body, length);
+}
+
+// ********** bin_decode_request ********** //
+// decode the body of a request frame; returns 0 on success //
+// and -1 if the body is malformed                          //
+int bin_decode_request(const uint8_t *body, size_t length, binmsg_t *msg)
+{
+  const uint8_t *in = body, *end = body + length;
+
+  memset(msg, 0, sizeof(*msg));
+  msg->opcode = *in++;
+
+  if (get_varint(&in, end, &msg->seq) != 0)
+    {
+      return -1;
+    }
+
+  switch (msg->opcode)
+    {
+    case BIN_READ:
+    case BIN_BOUNDS:
+      return get_varint(&in, end, &msg->index);
+
+    case BIN_WRITE:
+      if (get_varint(&in, end, &msg->index) != 0)
+        {
+          return -1;
+        }
+      return get_int32(&in, end, &msg->value);
+
+    case BIN_INSERT:
+      if (get_int32(&in, end, &msg->value) != 0)
+        {
+          return -1;
+        }
+      msg->bounds = (const char *)in;
+      msg->boundslen = end - in;
+      return 0;
+
+    case BIN_QUIT:
+    case BIN_ASCII:
+      return 0;
+
+    default:
+      return -1;
+    }
+}
+
+// ********** bin_decode_response ********** //
+// decode the body of a response frame; returns 0 on success //
+// and -1 if the body is malformed                           //
+int bin_decode_response(const uint8_t *body, size_t length, binmsg_t *msg)
+{
+  const uint8_t *in = body, *end = body + length;
+
+  memset(msg, 0, sizeof(*msg));
+
+  if (length < 2)
+    {
+      return -1;
+    }
+
+  msg->opcode = *in++;
+  msg->status = *in++;
+
+  if (get_varint(&in, end, &msg->seq) != 0)
+    {
+      return -1;
+    }
+
+  if (msg->status != BIN_OK)
+    {
+      return 0;
+    }
+
+  switch (msg->opcode)
+    {
+    case BIN_READ:
+      return get_int32(&in, end, &msg->value);
+
+    case BIN_BOUNDS:
+      msg->bounds = (const char *)in;
+      msg->boundslen = end - in;
+      return 0;
+
+    case BIN_INSERT:
+      return get_varint(&in, end, &msg->index);
+
+    case BIN_NOTIFY:
+      if (get_varint(&in, end, &msg->index) != 0)
+        {
+          return -1;
+        }
+      return get_int32(&in, end, &msg->value);
+
+    default:
+      return 0;
+    }
+}
@@ -0,0 +1,75 @@
+// Header file for the compact binary protocol between the server and the client //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+/* A binary frame on the wire is laid out as:
+  BIN_SYNC | body length (varint) | body | CRC-16/CCITT of the body (little-endian)
+
+A request body is: opcode | sequence tag (varint) | operands
+  BIN_READ, BIN_BOUNDS: register index (varint)
+  BIN_WRITE: register index (varint), value (int32, little-endian)
+  BIN_INSERT: value (int32, little-endian), bounds string (the rest of the body)
+  BIN_QUIT, BIN_ASCII: no operands
+
+A response body is: opcode | status | sequence tag (varint) | payload
+  BIN_READ: value (int32, little-endian), BIN_BOUNDS: bounds string,
+  BIN_INSERT: new register index (varint), BIN_NOTIFY: register index (varint)
+  and value (int32, little-endian), anything else: no payload
+The payload is only present when the status is BIN_OK.
+
+BIN_NOTIFY is never requested: the server sends it, with sequence tag 0, when
+a register the port subscribed to changes.
+*/
+
+#ifndef __BINARY_PROTOCOL_H_
+#define __BINARY_PROTOCOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "commonfunc.h"
+
+// Preprocessor //
+#define BIN_SYNC 0xB5 // first byte of every binary frame //
+#define BIN_BODY_MAX (FRAME_MAX - 16) // the longest body, leaving room for the frame header and CRC //
+#define BIN_FRAME_MAX (BIN_BODY_MAX + 8) // the longest encoded frame //
+
+// opcodes //
+#define BIN_READ 0x01
+#define BIN_BOUNDS 0x02
+#define BIN_WRITE 0x03
+#define BIN_INSERT 0x04
+#define BIN_QUIT 0x05
+#define BIN_ASCII 0x06 // switch the port back to FRAME_LINE mode //
+#define BIN_NOTIFY 0x07 // a subscribed register changed, sent by the server only //
+
+// response statuses //
+#define BIN_OK 0x00
+#define BIN_INVALID_REGISTER 0x01
+#define BIN_INVALID_INPUT 0x02
+#define BIN_INVALID_COMMAND 0x03
+
+// Structs //
+// Binary Message Struct //
+// A decoded request or response. Only the fields the opcode uses are set; //
+// the bounds point into the frame that was decoded, they are not copied   //
+struct binmessage{
+	uint8_t opcode; // one of the BIN_* opcodes //
+	uint8_t status; // response status, BIN_OK or one of the errors //
+	uint32_t seq; // sequence tag, echoed by the server //
+	uint32_t index; // register index //
+	int32_t value; // register value //
+	const char *bounds; // bounds string, not '\0' terminated //
+	size_t boundslen; // length of the bounds string //
+};
+
+typedef struct binmessage binmsg_t;
+
+// Function Prototypes //
+uint16_t bin_crc16(const uint8_t *data, size_t length);
+const uint8_t *bin_next_frame(framereader_t *reader, size_t *length);
+size_t bin_encode_request(uint8_t *frame, const binmsg_t *msg);
+size_t bin_encode_response(uint8_t *frame, const binmsg_t *msg);
+int bin_decode_request(const uint8_t *body, size_t length, binmsg_t *msg);
+int bin_decode_response(const uint8_t *body, size_t length, binmsg_t *msg);
+
+#endif
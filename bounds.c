@@ -0,0 +1,240 @@
+// Compilation and checking of the register bounds //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+#include "bounds.h"
+#include "scan.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// ********** compare_ints ********** //
+// qsort/bsearch comparison function for int arrays //
+static int compare_ints(const void *a, const void *b)
+{
+  int x = *(const int *)a, y = *(const int *)b;
+
+  return (x > y) - (x < y);
+}
+
+// ********** bounds_alloc ********** //
+// allocate zeroed memory for compiled bounds, from the arena //
+// if there is one; returns NULL on memory allocation failure //
+static void *bounds_alloc(bounds_t *compiled, arena_t *arena, size_t size)
+{
+  void *result;
+
+  if (arena == NULL)
+    {
+      return calloc(size, 1);
+    }
+
+  if ((result = arena_alloc(arena, size)) != NULL)
+    {
+      memset(result, 0, size);
+      compiled->inarena = 1;
+    }
+
+  return result;
+}
+
+// ********** bounds_release ********** //
+// free memory allocated by bounds_alloc; arena memory //
+// is left alone until the whole arena is freed        //
+static void bounds_release(bounds_t *compiled, void *memory)
+{
+  if (!compiled->inarena)
+    {
+      free(memory);
+    }
+}
+
+// ********** compile_distinct ********** //
+// compile "a|b|c" bounds into a sorted set, or into a bitmap //
+// if the values are dense enough; returns 0 on success and   //
+// -1 on memory allocation failure                            //
+static int compile_distinct(bounds_t *compiled, slice_t bounds, arena_t *arena)
+{
+  slice_t token;
+  int count = 0, unique = 0;
+  size_t span;
+
+  // there are at most as many values as '|' separators plus one //
+  count = (int)scan_count(bounds.ptr, bounds.len, '|');
+
+  compiled->values = (int *)bounds_alloc(compiled, arena, (count + 1) * sizeof(int));
+  if (compiled->values == NULL)
+    {
+      return -1;
+    }
+
+  count = 0;
+  while (slice_token(&bounds, '|', &token) == 0)
+    {
+      compiled->values[count++] = slice_atoi(token);
+    }
+
+  if (count == 0)
+    {
+      bounds_release(compiled, compiled->values);
+      compiled->values = NULL;
+      return 0; // no values at all, kind stays BOUNDS_NONE //
+    }
+
+  // sort and drop duplicates //
+  qsort(compiled->values, count, sizeof(int), compare_ints);
+  for (int i = 0; i < count; i++)
+    {
+      if (unique == 0 || compiled->values[unique - 1] != compiled->values[i])
+        {
+          compiled->values[unique++] = compiled->values[i];
+        }
+    }
+
+  compiled->numofvalues = unique;
+  compiled->lower = compiled->values[0];
+  compiled->upper = compiled->values[unique - 1];
+  compiled->kind = BOUNDS_SORTED;
+
+  // use a bitmap when it is not larger than the sorted array itself //
+  span = (size_t)((long long)compiled->upper - compiled->lower) + 1;
+  if ((span + 7) / 8 <= unique * sizeof(int))
+    {
+      compiled->bitmap = (uint8_t *)bounds_alloc(compiled, arena, (span + 7) / 8);
+      if (compiled->bitmap == NULL)
+        {
+          return 0; // the sorted set still works //
+        }
+
+      for (int i = 0; i < unique; i++)
+        {
+          size_t bit = (size_t)((long long)compiled->values[i] - compiled->lower);
+          compiled->bitmap[bit / 8] |= (uint8_t)(1u << (bit % 8));
+        }
+
+      bounds_release(compiled, compiled->values);
+      compiled->values = NULL;
+      compiled->kind = BOUNDS_BITMAP;
+    }
+
+  return 0;
+}
+
+// ********** bounds_compile ********** //
+// parse a bounds string once into its compiled form; strings with //
+// a '|' are distinct number bounds, anything else is a "low-high" //
+// range; the string is parsed where it is, without a copy, and   //
+// the compiled values are kept in the arena, if one is given;    //
+// returns 0 on success and -1 on memory allocation failure       //
+int bounds_compile(bounds_t *compiled, slice_t bounds, arena_t *arena)
+{
+  slice_t lower_bound, upper_bound;
+
+  memset(compiled, 0, sizeof(*compiled));
+  compiled->kind = BOUNDS_NONE;
+
+  if (bounds.ptr == NULL)
+    {
+      return 0;
+    }
+
+  if (memchr(bounds.ptr, '|', bounds.len) != NULL)
+    {
+      return compile_distinct(compiled, bounds, arena);
+    }
+
+  // a range needs both of its ends, otherwise nothing is accepted //
+  if (slice_token(&bounds, '-', &lower_bound) == 0 && slice_token(&bounds, '-', &upper_bound) == 0)
+    {
+      compiled->lower = slice_atoi(lower_bound);
+      compiled->upper = slice_atoi(upper_bound);
+      compiled->kind = BOUNDS_RANGE;
+    }
+
+  return 0;
+}
+
+// ********** bounds_check ********** //
+// check if the number requested is allowed by the compiled //
+// bounds; returns 0 on success, -1 on failure              //
+int bounds_check(const bounds_t *compiled, int target_value)
+{
+  size_t bit;
+
+  switch (compiled->kind)
+    {
+    case BOUNDS_RANGE:
+      // range bounds are exclusive on both ends //
+      return (target_value > compiled->lower && target_value < compiled->upper) ? 0 : -1;
+
+    case BOUNDS_SORTED:
+      // a small set is compared in full, a vector at a time, faster than halving it //
+      if (compiled->numofvalues <= BOUNDS_LINEAR_MAX)
+        {
+          return scan_contains(compiled->values, compiled->numofvalues, target_value) ? 0 : -1;
+        }
+      return bsearch(&target_value, compiled->values, compiled->numofvalues,
+                     sizeof(int), compare_ints) != NULL ? 0 : -1;
+
+    case BOUNDS_BITMAP:
+      if (target_value < compiled->lower || target_value > compiled->upper)
+        {
+          return -1;
+        }
+
+      bit = (size_t)((long long)target_value - compiled->lower);
+      return (compiled->bitmap[bit / 8] & (1u << (bit % 8))) ? 0 : -1;
+
+    default:
+      return -1;
+    }
+}
+
+// ********** bounds_check_all ********** //
+// check a whole array of values against the compiled bounds; a  //
+// range only needs the smallest and the largest value, found in //
+// one pass the compiler vectorizes; returns 0 if every value is //
+// allowed, -1 if not                                            //
+int bounds_check_all(const bounds_t *compiled, const int *values, int count)
+{
+  int lowest, highest;
+
+  if (count <= 0)
+    {
+      return 0;
+    }
+
+  if (compiled->kind == BOUNDS_RANGE)
+    {
+      lowest = highest = values[0];
+      for (int i = 1; i < count; i++)
+        {
+          lowest = values[i] < lowest ? values[i] : lowest;
+          highest = values[i] > highest ? values[i] : highest;
+        }
+
+      return bounds_check(compiled, lowest) == 0 && bounds_check(compiled, highest) == 0 ? 0 : -1;
+    }
+
+  for (int i = 0; i < count; i++)
+    {
+      if (bounds_check(compiled, values[i]) != 0)
+        {
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
+// ********** bounds_free ********** //
+// free the memory held by a compiled bounds structure //
+void bounds_free(bounds_t *compiled)
+{
+  bounds_release(compiled, compiled->values);
+  bounds_release(compiled, compiled->bitmap);
+
+  compiled->values = NULL;
+  compiled->bitmap = NULL;
+  compiled->kind = BOUNDS_NONE;
+}
@@ -0,0 +1,41 @@
+// Header file for the compiled register bounds //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+#ifndef __BOUNDS_H_
+#define __BOUNDS_H_
+
+#include <stdint.h>
+#include "arena.h"
+#include "slice.h"
+
+// Preprocessor //
+#define BOUNDS_NONE 0 // malformed bounds string, no value is accepted //
+#define BOUNDS_RANGE 1 // continuous bounds, e.g. "0-100" //
+#define BOUNDS_SORTED 2 // distinct number bounds, e.g. "1|5|9", kept as a sorted set //
+#define BOUNDS_BITMAP 3 // distinct number bounds, dense enough to be kept as a bitmap //
+#define BOUNDS_LINEAR_MAX 16 // sorted sets up to this size are scanned in full, see scan_contains //
+
+// Structs //
+// Compiled Bounds Struct //
+// The bounds string of a register is parsed once into this structure, so //
+// checking a value is a compare, a binary search or a single bit test    //
+struct compiledbounds{
+	int kind; // one of the BOUNDS_* kinds above //
+	int lower; // lower bound of a range, or the smallest allowed distinct value //
+	int upper; // upper bound of a range, or the largest allowed distinct value //
+	int *values; // sorted distinct values, for BOUNDS_SORTED //
+	int numofvalues; // the number of distinct values //
+	uint8_t *bitmap; // one bit per value from lower to upper, for BOUNDS_BITMAP //
+	int inarena; // set if the values or the bitmap live in an arena, and are freed with it //
+};
+
+typedef struct compiledbounds bounds_t;
+
+// Function Prototypes //
+int bounds_compile(bounds_t *compiled, slice_t bounds, arena_t *arena);
+int bounds_check(const bounds_t *compiled, int target_value);
+int bounds_check_all(const bounds_t *compiled, const int *values, int count);
+void bounds_free(bounds_t *compiled);
+
+#endif
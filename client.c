@@ -8,9 +8,16 @@ with the client via the command line interface and its main two functions are:
 	1. The 'help' command which prints all the available AT-COMMANDS.
 	2. The AT-COMMAND request to the server. 
 
-The client waits for a server response before the user can enter the next command. In case
-of an insertion command, the help menu is updated with the new info as well. Finally, if
-a quit command is entered, the client terminates the server as well.
+The client waits for a server response before the user can enter the next command. The help
+lists the registers the server has at that time, which it asks for with AT+LIST, so the
+insertions of any client are in it. Finally, if a quit command is entered, the client
+terminates the server as well.
+
+With -i the requests are read from a script instead, and -j prints the results as JSON lines; there
+is no prompt, the requests are pipelined in batches, and the exit status tells if any of them failed.
+
+The protocol itself, i.e. the framing, the binary mode and the pipelining, is the serialcomm library,
+see serialcomm.h; the client is the command line around it.
 */
 
 // Libraries
@@ -21,132 +28,915 @@ a quit command is entered, the client terminates the server as well.
 #include <string.h>
 #include <sys/types.h>
 #include <stdlib.h>
+#include <limits.h>
 #include "commonfunc.h"
+#include "serialcomm.h"
+#include "regcache.h"
 
 // Preprocessor 
-#define MAX_STRING 512
-#define MAX_FILENAME 12
-#define MAX_ENTRIES 30
-#define INITIAL_REGS 2
-#define MAX_RESPONSE_SIZE 20
-
-// Global for storing info for menu in order to be updated after each insertion //
-char *menu[MAX_STRING] = {"~ Available AT Commands:", 
-"~ REG1: Read the 1st register's value -> Response: <int>", 
-"~ REG1=?: Read the list of all allowed values for 1st register",
-"~ REG1=<int>: Write the provided integer to the 1st register -> Response: OK|InvalidInput",
-"~ REG2: Read the 2nd register's value -> Response: <int>",
-"~ REG2=?: Read the list of all allowed values for 2nd register",
-"~ REG2=<int>: Write the provided integer to the 2nd register -> Response: OK|InvalidInput"};
-int last_entry = 7; // the last entry of the menu array, will be incremented in order to add more entries to the menu //
-// when new registers are added //
-int reg_count = INITIAL_REGS; // the number of registers; default value is the initial number of registers; //
-// will be updated after each new register insertion //
-char insertproperties[MAX_STRING]; // string to be used for the menu update to avoid segfaults //
+#define MAX_STRING (FRAME_MAX + 16) // the longest response, e.g. long bounds //
+#define BULK_PREFIX 11 // the length of "bulkinsert+" //
+#define SCRIPT_BATCH 1024 // the most script requests run together //
+
+// kinds of requests the cache knows, see parse_simple //
+#define CACHE_READ 1
+#define CACHE_BOUNDS 2
+#define CACHE_WRITE 3
+
+// Structs //
+// Cached Answer Struct //
+// A response from the cache to a request sent after others still in //
+// flight; it is printed once they are answered, in request order    //
+struct cachedanswer{
+	char *request; // the request answered //
+	char *response; // the response from the cache //
+	int after; // the requests sent before it, see handle_completion //
+};
+
+typedef struct cachedanswer cachedanswer_t;
+
+// Global for the help lines of the commands; the registers themselves //
+// are listed by the server when the help is asked for, see print_help  //
+const char *commands[] = {"~ Available AT Commands:", 
+"~ REGn: Read the nth register's value -> Response: <int>", 
+"~ REGn=?: Read the list of all allowed values for the nth register",
+"~ REGn=<int>: Write the provided integer to the nth register -> Response: OK|InvalidInput",
+"~ AT+SUB=REGa..REGb[,<ms>]: Get '!REGn=<int>' when one of the registers changes, at most once every <ms> per register",
+"~ AT+UNSUB[=REGa..REGb]: Stop the notifications of the registers, or of all of them",
+"~ block+<count>+<value>+<bounds>: Insert <count> registers with the same value and bounds as one block -> Response: INSERTED BLKn REGa..REGb",
+"~ BLKn: Read all the values of the nth block -> Response: <int>;<int>;...",
+"~ BLKn=?: Read the list of all allowed values for the registers of the nth block",
+"~ BLKn=<int>;<int>;...: Write one integer to every register of the nth block -> Response: OK|InvalidInput",
+"~ listen+<ms>: Print the notifications arriving within <ms> milliseconds"};
+int frame_mode = FRAME_FIXED; // the framing of the requests and replies, see commonfunc.h //
+serialcomm_t client; // the connection to the server, see serialcomm.h //
+int pipeline_depth = 1; // the requests kept in flight; 1 means wait for each response //
+int response_timeout = SERIALCOMM_DEFAULT_TIMEOUT; // milliseconds to wait for a response //
+int cache_enabled = 0; // set to answer requests from the cache when possible //
+regcache_t cache; // what the client knows of the registers, see regcache.h //
+int script_mode = 0; // set when the requests come from a script instead of a user //
+int json_output = 0; // set to print the results of a script as JSON lines //
+int failures = 0; // the script requests that failed or got no response //
+int sent_requests = 0; // the requests of run_requests sent to the server //
+int answered_requests = 0; // and those of them answered, in the order they were sent //
+int writes_in_flight = 0; // the requests sent that may change values and are not answered yet //
+cachedanswer_t *deferred = NULL; // the cached answers waiting for the requests before them //
+int numofdeferred = 0; // the number of cached answers waiting //
+int deferredsize = 0; // room for cached answers //
+int nextdeferred = 0; // the first cached answer still waiting //
+lineconf_t line_config; // the serial line settings of the port //
+
+// ********** handle_notification ********** //
+// print a change notification, "!REGn=<value>", that the server //
+// sent for a subscribed register, and keep the new value; the   //
+// notify callback of the client, which gets the late responses  //
+// as well                                                       //
+void handle_notification(void *arg, const char *notification)
+{
+  int id, value, known = sscanf(notification, "!REG%d=%d", &id, &value) == 2;
+
+  (void)arg;
+  if (json_output && known)
+    {
+      printf("{\"notification\":\"REG%d\",\"value\":%d}\n", id, value);
+    }
+  else
+    {
+      printf("%.*s\n", (int)strcspn(notification, "\r\n"), notification);
+    }
+
+  if (cache_enabled && known)
+    {
+      regcache_set_value(&cache, id, value);
+    }
+}
+
+// ********** listen_notifications ********** //
+// print the notifications arriving within the given milliseconds, //
+// for the registers subscribed to with AT+SUB                     //
+void listen_notifications(int duration)
+{
+  long long deadline = monotonic_ms() + duration, remaining;
+
+  while ((remaining = deadline - monotonic_ms()) > 0)
+    {
+      serialcomm_poll(&client, (int)remaining);
+    }
+}
+
+// ********** send_request ********** //
+// the function to send the request to the server for processing //
+// the response is copied to server_response; returns 0 if a     //
+// response was received, -1 if not                              //
+int send_request(const char *request, char *server_response)
+{
+  scfuture_t future; // the response, once it has arrived //
+  int status;
+
+  memset(server_response, 0, MAX_STRING);
+  serialcomm_future_init(&future);
+
+  // send request to server and wait for response //
+  if (serialcomm_submit(&client, request, serialcomm_complete, &future) != 0)
+    {
+      fprintf(stderr, "ERROR: Not enough memory for the requests\n");
+      exit(1);
+    }
+
+  while ((status = serialcomm_future_wait(&future, 0)) == -1)
+    {
+      serialcomm_poll(&client, -1);
+    }
+
+  if (status == SERIALCOMM_OK)
+    {
+      snprintf(server_response, MAX_STRING, "%s", future.response);
+    }
+  serialcomm_future_free(&future);
+
+  return status == SERIALCOMM_OK ? 0 : -1;
+}
 
 // ********** print_help ********** //
-// the function to print the menu with the available AT commands to the user //
+// the function to print the menu with the available AT commands to the //
+// user, and the registers of the server, as runs of registers sharing  //
+// their bounds, see AT+LIST; a reply ending in ';' has more after it,  //
+// and a run sent without its bounds gets them with AT+REGa=?           //
 void print_help()
 {
+  char request[32], server_response[MAX_STRING], run_bounds[MAX_STRING];
+  char *run, *bounds, *saveptr = NULL;
+  int next = 1, first = 0, last = 0, more = 1, fields;
+  size_t length;
+
   // print menu entries //
-  for (int i = 0; i < MAX_ENTRIES; i++)
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+    {
+      printf("%s\n", commands[i]);
+    }
+
+  printf("~ Registers and their allowed values:\n");
+  while (more)
     {
-      if (menu[i] != NULL)
+      snprintf(request, sizeof(request), "AT+LIST=REG%d", next);
+      if (send_request(request, server_response) != 0 || strncmp(server_response, "REG", 3) != 0)
         {
-          printf("%s\n", menu[i]);
+          printf("~ The server did not list its registers\n");
+          return;
         }
-    } 
+
+      length = strcspn(server_response, "\r\n");
+      server_response[length] = '\0';
+      more = length > 0 && server_response[length - 1] == ';';
+
+      for (run = strtok_r(server_response, ";", &saveptr); run != NULL; run = strtok_r(NULL, ";", &saveptr))
+        {
+          fields = sscanf(run, "REG%d..REG%d", &first, &last);
+          if (fields == 1)
+            {
+              last = first; // a run of one register //
+            }
+          if (fields < 1 || first <= 0 || last < first)
+            {
+              more = 0; // not a run //
+              break;
+            }
+
+          if ((bounds = strchr(run, ':')) != NULL)
+            {
+              printf("~ %.*s: %s\n", (int)(bounds - run), run, bounds + 1);
+              continue;
+            }
+
+          snprintf(request, sizeof(request), "AT+REG%d=?", first);
+          if (send_request(request, run_bounds) != 0)
+            {
+              snprintf(run_bounds, sizeof(run_bounds), "(no response)");
+            }
+          printf("~ %s: %.*s\n", run, (int)strcspn(run_bounds, "\r\n"), run_bounds);
+        }
+
+      more = more && last >= next;
+      next = last + 1;
+    }
 }
 
-// ********** send_request ********** //
-// the function to send the request to the server for processing //
-void send_request(int fd, char *request)
+// ********** print_json_string ********** //
+// print a string as a JSON string literal //
+void print_json_string(const char *text, size_t length)
 {
-  int bytes_read; // 'read' system call result //
-  char server_response[MAX_STRING] = {'\0'}; // server response to print //
+  putchar('"');
+  for (size_t i = 0; i < length; i++)
+    {
+      unsigned char c = (unsigned char)text[i];
 
-  // send request to server and wait for response //
-  my_write(fd, request, MAX_RESPONSE_SIZE);
-  wait_for_response(fd, 0); 
+      if (c == '"' || c == '\\')
+        {
+          printf("\\%c", c);
+        }
+      else if (c < 0x20)
+        {
+          printf("\\u%04x", c);
+        }
+      else
+        {
+          putchar(c);
+        }
+    }
+  putchar('"');
+}
+
+// ********** is_failure ********** //
+// check if a response reports an error, also in one of the //
+// results of a batch; returns 1 if it does, 0 if not       //
+int is_failure(const char *response)
+{
+  return strstr(response, "INVALID") != NULL || strstr(response, "InvalidInput") != NULL
+         || strstr(response, "REPLY TOO LONG") != NULL;
+}
 
-  bytes_read = my_read(fd, server_response, sizeof(server_response));
-  if (bytes_read)
+// ********** print_result ********** //
+// print the result of a script request on a line of its own, //
+// as "<request>\t<response>" or as a JSON object              //
+void print_result(const char *request, const char *response)
+{
+  size_t length = response != NULL ? strcspn(response, "\r\n") : 0;
+  const char *status = response == NULL ? "timeout" : is_failure(response) ? "error" : "ok";
+
+  if (!json_output)
     {
-      printf("%s\n", server_response); // print response from server //
+      printf("%s\t%.*s\n", request, (int)length, response != NULL ? response : "TIMEOUT");
+      return;
     }
+
+  printf("{\"request\":");
+  print_json_string(request, strlen(request));
+  printf(",\"status\":\"%s\",\"response\":", status);
+  if (response != NULL)
+    {
+      print_json_string(response, length);
+    }
+  else
+    {
+      printf("null");
+    }
+  printf("}\n");
 }
 
-// ********** update_menu ********** //
-// function to update the menu after each register insertion //
-void update_menu(char *request)
+// ********** handle_response ********** //
+// print the server response to a request, or an error if there //
+// was none                                                     //
+void handle_response(char *request, const char *response)
 {
-  char *token = NULL; // to break the request in order to get the separate info //
-  char reg_bounds[MAX_STRING]; // new reg bounds //
-  char reg_pos[2]; // new reg position on list //
-  char reg_string[MAX_STRING] = {"REG"}; 
-  char temp[MAX_STRING];
+  if (script_mode)
+    {
+      print_result(request, response);
+      failures += response == NULL || is_failure(response);
+    }
+  else if (response != NULL)
+    {
+      printf("%s\n", response); // print response from server //
+    }
+  else
+    {
+      fprintf(stderr, "ERROR: No response from the server for %s\n", request);
+    }
+}
 
-  // get the first token from the request - 'insert' //
-  token = strtok(request,"+");
+// ********** parse_simple ********** //
+// recognise a request on a single register, i.e. "AT+REGn", //
+// "AT+REGn=?" or "AT+REGn=<int>"; returns CACHE_READ,       //
+// CACHE_BOUNDS or CACHE_WRITE and sets the register id and  //
+// the value written, or returns 0 for any other request     //
+int parse_simple(const char *request, int *id, int *value)
+{
+  slice_t regid, number;
+  const char *equals = NULL;
 
-  // second token: new register value - no need to use it, since the server handles reg values //
-  token = strtok(NULL, "+");
+  if (strncmp(request, "AT+", 3) != 0 || strpbrk(request, ";.") != NULL)
+    {
+      return 0; // batches and ranges are not cached //
+    }
 
-  // third token: new register bounds //
-  token = strtok(NULL, "+");
-  strcpy(reg_bounds, token);
+  request += 3;
+  equals = strchr(request, '=');
+  regid.ptr = request;
+  regid.len = equals != NULL ? (size_t)(equals - request) : strlen(request);
+  if ((*id = slice_regid(regid)) < 0)
+    {
+      return 0;
+    }
 
-  sprintf(reg_pos, "%d", reg_count); // convert the last reg position to a string //
-  strcat(reg_string, reg_pos); // add position number to "REG" //
+  if (equals == NULL)
+    {
+      return CACHE_READ;
+    }
 
-  // add the 3 new help lines //
-  sprintf(temp, "~ %s: Read the value of register %d -> Response: <int>", reg_string, reg_count);
-  menu[last_entry] = strdup(temp);
+  if (strcmp(equals + 1, "?") == 0)
+    {
+      return CACHE_BOUNDS;
+    }
+
+  number = slice_of(equals + 1);
+  return slice_int(number, value) == 0 ? CACHE_WRITE : 0;
+}
+
+// ********** answer_from_cache ********** //
+// answer a request from the cache, if possible: reads of fresh //
+// values, bounds, and writes out of the cached bounds; returns //
+// 1 with the response in text, or 0 if the server must answer //
+// a value is not read from the cache while a write is in       //
+// flight, as the server may answer with the value it writes    //
+int answer_from_cache(const char *request, char *text, size_t size)
+{
+  const char *bounds = NULL;
+  // in FRAME_FIXED mode the server ends the values and errors with a '\n' //
+  const char *eol = !client.binary && frame_mode == FRAME_FIXED ? "\n" : "";
+  int id, value;
 
-  if (menu[last_entry] == NULL)
+  if (!cache_enabled)
     {
-      fprintf(stderr, "ERROR: Not enough memory to update the menu\n");
+      return 0;
+    }
+
+  switch (parse_simple(request, &id, &value))
+    {
+    case CACHE_READ:
+      if (writes_in_flight > 0 || !regcache_value(&cache, id, &value))
+        {
+          return 0;
+        }
+      snprintf(text, size, "%d%s", value, eol);
+      break;
+
+    case CACHE_BOUNDS:
+      if ((bounds = regcache_bounds(&cache, id)) == NULL)
+        {
+          return 0;
+        }
+      snprintf(text, size, "%s", bounds);
+      break;
+
+    case CACHE_WRITE:
+      if (regcache_check(&cache, id, value) != -1)
+        {
+          return 0; // a valid value, or unknown bounds //
+        }
+      snprintf(text, size, "InvalidInput%s", eol);
+      break;
+
+    default:
+      return 0;
     }
 
-  sprintf(temp, "~ %s=?: Read the list of all allowed values for register %d", reg_string, reg_count);
-  menu[last_entry + 1] = strdup(temp);
+  cache.hits++;
+  return 1;
+}
+
+// ********** changed_register ********** //
+// the register a request may change: its id for a write, -1 //
+// for a batch that writes, which may change any, or 0        //
+int changed_register(const char *request)
+{
+  const char *equals = NULL;
+  int id, value;
 
-  if (menu[last_entry + 1] == NULL)
+  switch (parse_simple(request, &id, &value))
     {
-      fprintf(stderr, "ERROR: Not enough memory to update the menu\n");
+    case CACHE_READ:
+    case CACHE_BOUNDS:
+      return 0;
+
+    case CACHE_WRITE:
+      return id > 0 ? id : -1;
+
+    default:
+      for (equals = strchr(request, '='); equals != NULL; equals = strchr(equals + 1, '='))
+        {
+          if (equals[1] != '?')
+            {
+              return -1;
+            }
+        }
+      return 0;
     }
-  
-  sprintf(temp, "~ %s=<int>: Write the provided integer to register %d -> Response: OK|InvalidInput", reg_string, reg_count);
-  menu[last_entry + 2] = strdup(temp);
+}
 
-  if (menu[last_entry + 2] == NULL)
+// ********** forget_writes ********** //
+// drop from the cache the values a request may change; returns //
+// 1 if it may change any, 0 if not                             //
+int forget_writes(const char *request)
+{
+  int id = changed_register(request);
+
+  if (cache_enabled && id > 0)
     {
-      fprintf(stderr, "ERROR: Not enough memory to update the menu\n");
+      regcache_invalidate(&cache, id);
     }
-  // change the last entry index to the next empty menu position //
-  last_entry = last_entry + 3; 
-} 
+  else if (cache_enabled && id < 0)
+    {
+      regcache_invalidate_all(&cache);
+    }
+
+  return id != 0;
+}
+
+// ********** learn_response ********** //
+// keep what a server response tells about the registers; a //
+// write without a response may have been made or not       //
+void learn_response(const char *request, const char *raw)
+{
+  static char response[MAX_STRING]; // the response without its '\n' //
+  char *end = NULL;
+  int id, value;
+  long number;
+
+  if (!cache_enabled)
+    {
+      return;
+    }
+
+  if (raw == NULL)
+    {
+      forget_writes(request);
+      return;
+    }
+
+  // FRAME_FIXED responses keep the '\n' of the reply //
+  snprintf(response, sizeof(response), "%.*s", (int)strcspn(raw, "\r\n"), raw);
+
+  switch (parse_simple(request, &id, &value))
+    {
+    case CACHE_READ:
+      errno = 0;
+      number = strtol(response, &end, 10);
+      if (end != response && *end == '\0' && errno == 0 && number >= INT_MIN && number <= INT_MAX)
+        {
+          regcache_set_value(&cache, id, (int)number);
+        }
+      break;
+
+    case CACHE_BOUNDS:
+      // a bounds response cut by a FRAME_FIXED frame is not kept //
+      if (strncmp(response, "INVALID", 7) != 0
+          && (client.binary || frame_mode != FRAME_FIXED || strlen(response) < FIXED_FRAME_SIZE - 1))
+        {
+          regcache_set_bounds(&cache, id, response);
+        }
+      break;
+
+    case CACHE_WRITE:
+      if (strcmp(response, "OK") == 0)
+        {
+          regcache_set_value(&cache, id, value); // the value is now known //
+        }
+      else
+        {
+          regcache_invalidate(&cache, id);
+        }
+      break;
+
+    default:
+      // a batch that writes may change any of the values, also //
+      // those read while it was in flight                      //
+      forget_writes(request);
+      break;
+    }
+}
+
+// ********** send_bulkinsert ********** //
+// send a bulkinsert request and print its response //
+// returns 0 if the registers were inserted, -1 if not //
+int send_bulkinsert(char *request, char *server_response)
+{
+  if (send_request(request, server_response) != 0)
+    {
+      fprintf(stderr, "ERROR: No response from the server for a bulk insertion\n");
+      return -1;
+    }
+
+  handle_response(request, server_response);
+
+  return strncmp(server_response, "INSERTED", 8) == 0 ? 0 : -1;
+}
+
+// ********** provision_file ********** //
+// send the register definitions of a file, one "<value>,<bounds>" //
+// per line, as bulkinsert requests of up to a full line frame     //
+// each; returns 0 on success and -1 on failure                    //
+int provision_file(const char *path)
+{
+  static char request[FRAME_MAX]; // the bulkinsert request being filled //
+  char server_response[MAX_STRING];
+  FILE *file = fopen(path, "r");
+  char *line = NULL, *comma = NULL;
+  size_t line_size = 0, length = BULK_PREFIX, line_length;
+  int lineno = 0, result = 0;
+
+  if (file == NULL)
+    {
+      fprintf(stderr, "ERROR: Could not open %s\n", path);
+      return -1;
+    }
+
+  strcpy(request, "bulkinsert+");
+  while (result == 0 && getline(&line, &line_size, file) != -1)
+    {
+      lineno++;
+      line[strcspn(line, "\r\n")] = '\0';
+      if (line[0] == '\0' || line[0] == '#')
+        {
+          continue;
+        }
+
+      comma = strchr(line, ',');
+      line_length = strlen(line);
+      if (comma == NULL || BULK_PREFIX + line_length >= FRAME_MAX - 1)
+        {
+          fprintf(stderr, "ERROR: %s:%d: not a register definition\n", path, lineno);
+          result = -1;
+          break;
+        }
+      *comma = '+'; // "<value>,<bounds>" is sent as "<value>+<bounds>" //
+
+      // send the request once the next definition would not fit //
+      if (length + 1 + line_length >= FRAME_MAX - 1)
+        {
+          result = send_bulkinsert(request, server_response);
+          length = BULK_PREFIX;
+          request[length] = '\0';
+        }
+
+      if (length > BULK_PREFIX)
+        {
+          request[length++] = ';';
+        }
+      memcpy(request + length, line, line_length + 1);
+      length += line_length;
+    }
+
+  if (result == 0 && length > BULK_PREFIX)
+    {
+      result = send_bulkinsert(request, server_response);
+    }
+
+  free(line);
+  fclose(file);
+
+  return result;
+}
+
+// ********** handle_completion ********** //
+// the completion callback of the requests sent to the server; //
+// arg is the request itself                                   //
+void handle_completion(void *arg, int status, const char *response)
+{
+  char *request = (char *)arg;
+
+  writes_in_flight -= changed_register(request) != 0;
+  answered_requests++;
+  if (status != SERIALCOMM_OK)
+    {
+      learn_response(request, NULL);
+      handle_response(request, NULL);
+    }
+  else
+    {
+      learn_response(request, response);
+      handle_response(request, response);
+    }
+
+  // the cached answers to the requests after it go out now //
+  while (nextdeferred < numofdeferred && deferred[nextdeferred].after <= answered_requests)
+    {
+      handle_response(deferred[nextdeferred].request, deferred[nextdeferred].response);
+      free(deferred[nextdeferred].response);
+      nextdeferred++;
+    }
+  if (nextdeferred == numofdeferred)
+    {
+      nextdeferred = numofdeferred = 0;
+    }
+}
+
+// ********** defer_answer ********** //
+// keep a response from the cache until the requests sent before //
+// it are answered, so the responses are printed in order        //
+void defer_answer(char *request, const char *response)
+{
+  if (numofdeferred == deferredsize)
+    {
+      deferredsize = deferredsize == 0 ? 16 : 2 * deferredsize;
+      deferred = (cachedanswer_t *)realloc(deferred, deferredsize * sizeof(cachedanswer_t));
+      if (deferred == NULL)
+        {
+          fprintf(stderr, "ERROR: Not enough memory for the requests\n");
+          exit(1);
+        }
+    }
+
+  deferred[numofdeferred].request = request;
+  deferred[numofdeferred].after = sent_requests;
+  if ((deferred[numofdeferred].response = strdup(response)) == NULL)
+    {
+      fprintf(stderr, "ERROR: Not enough memory for the requests\n");
+      exit(1);
+    }
+  numofdeferred++;
+}
+
+// ********** run_requests ********** //
+// send a list of requests to the server, keeping up to        //
+// pipeline_depth of them in flight, and print their responses //
+// as they arrive; the requests the cache can answer are not   //
+// sent at all, and their answers wait for the ones before     //
+// them; the server answers the requests of a port in order    //
+void run_requests(char **requests, int count)
+{
+  char cached[MAX_STRING]; // a response from the cache //
+  int sent = 0;
+
+  while (sent < count || serialcomm_pending(&client) > 0)
+    {
+      // keep the window full //
+      while (sent < count && serialcomm_pending(&client) < pipeline_depth)
+        {
+          if (answer_from_cache(requests[sent], cached, sizeof(cached)))
+            {
+              if (serialcomm_pending(&client) == 0)
+                {
+                  handle_response(requests[sent], cached);
+                }
+              else
+                {
+                  defer_answer(requests[sent], cached);
+                }
+            }
+          else
+            {
+              // the values it may change are not known from now on //
+              writes_in_flight += forget_writes(requests[sent]);
+              if (serialcomm_submit(&client, requests[sent], handle_completion, requests[sent]) != 0)
+                {
+                  fprintf(stderr, "ERROR: Not enough memory for the requests\n");
+                  exit(1);
+                }
+              sent_requests++;
+            }
+          sent++;
+        }
+
+      if (serialcomm_pending(&client) > 0)
+        {
+          serialcomm_poll(&client, -1);
+        }
+    }
+}
+
+// ********** negotiate_speed ********** //
+// offer the server the highest baud rate of the client, maxspeed, //
+// and switch to the one it picks once the reply has arrived;     //
+// returns 0 on success and -1 if the server did not agree        //
+int negotiate_speed(int fd)
+{
+  char request[32], server_response[MAX_STRING];
+  int speed;
+
+  snprintf(request, sizeof(request), "AT+BAUD=%d", line_config.maxspeed);
+  if (send_request(request, server_response) != 0 || sscanf(server_response, "BAUD %d", &speed) != 1
+      || speed_constant(speed) == B0)
+    {
+      return -1;
+    }
+
+  if (speed != line_config.speed)
+    {
+      line_config.speed = speed;
+      if (set_interface_attributes(fd, &line_config) != 0)
+        {
+          return -1;
+        }
+    }
+
+  if (!script_mode)
+    {
+      printf("Line speed: %d baud\n", speed);
+    }
+  return 0;
+}
+
+// ********** run_batch ********** //
+// send the script requests collected so far and free them //
+void run_batch(char **requests, int *count)
+{
+  run_requests(requests, *count);
+
+  for (int i = 0; i < *count; i++)
+    {
+      free(requests[i]);
+    }
+  *count = 0;
+}
+
+// ********** run_script ********** //
+// read the requests of a script, separated by spaces or lines, and //
+// send them in batches of up to SCRIPT_BATCH, pipelined if enabled; //
+// a batch is sent as soon as no more input is ready, so a stream of //
+// requests is answered without waiting for the end of the input.    //
+// The script is read with a frame reader rather than stdio, so the  //
+// lines read ahead count as ready too, not only those on the fd     //
+void run_script(FILE *input)
+{
+  static framereader_t reader; // the bytes of the script read so far //
+  char *requests[SCRIPT_BATCH]; // the requests of the batch //
+  char *line = NULL; // a line of the script //
+  char *token = NULL, *saveptr = NULL;
+  ssize_t bytes_read;
+  int count = 0, quit = 0;
+
+  frame_reader_init(&reader, FRAME_LINE);
+  while (!quit)
+    {
+      if ((line = frame_next(&reader)) == NULL)
+        {
+          if (count > 0 && wait_readable(fileno(input), 0) != 1)
+            {
+              run_batch(requests, &count); // nothing more to read for now //
+            }
+
+          if ((bytes_read = frame_fill(&reader, fileno(input))) < 0)
+            {
+              break;
+            }
+          if (bytes_read == 0 && reader.len > reader.start && reader.len < FRAME_MAX)
+            {
+              reader.buf[reader.len++] = '\n'; // the last line, without its '\n' //
+            }
+          else if (bytes_read == 0)
+            {
+              break; // end of input //
+            }
+          continue;
+        }
+
+      if (*line == '\0')
+        {
+          fprintf(stderr, "ERROR: A script line longer than %d bytes is skipped\n", FRAME_MAX);
+          failures++;
+          continue;
+        }
+
+      for (token = strtok_r(line, " \t\r\n", &saveptr); token != NULL && !quit; token = strtok_r(NULL, " \t\r\n", &saveptr))
+        {
+          if (strcmp(token, "help") == 0)
+            {
+              continue; // there is no one to read it //
+            }
+
+          if (strncmp(token, "listen+", 7) == 0 && atoi(token + 7) > 0)
+            {
+              run_batch(requests, &count);
+              listen_notifications(atoi(token + 7));
+              continue;
+            }
+
+          if ((requests[count++] = strdup(token)) == NULL)
+            {
+              fprintf(stderr, "ERROR: Not enough memory for the requests\n");
+              exit(1);
+            }
+
+          quit = (strcmp(token, "quit") == 0);
+          if (count == SCRIPT_BATCH)
+            {
+              run_batch(requests, &count);
+            }
+        }
+    }
+
+  run_batch(requests, &count);
+}
 
 // ********** main program ********** //
 int main(int argc, char *argv[])
 {
-	int fd; // file descriptor for the serial port //
-  char filename[MAX_FILENAME]; // filename of the serial port //
-  char request[MAX_STRING]; // request to send to the server //
-  char response[MAX_STRING] = {'\0'}; // response from the server //
+	int fd, option; // file descriptor for the serial port //
+  const char *filename; // filename of the serial port //
+  char *line = NULL; // a line of user input //
+  size_t line_size = 0;
+  char **requests = NULL; // the requests entered on the line //
+  int count, quit = 0, binary_requested = 0;
+  const char *definitions = NULL; // the register definition file to send first, if any //
+  const char *script = NULL; // the script of requests, "-" for stdin, if any //
+  FILE *input = stdin; // where the script is read from //
+  char server_response[MAX_STRING]; // response to the binary mode request //
+  char *token = NULL, *saveptr = NULL;
+
+  line_config_init(&line_config);
+
+  // check the options, i.e. the framing mode, the pipeline depth, the response timeout,   //
+  // binary mode, the register definitions to provision, the cache, the script mode and  //
+  // the line settings: speed, format, flow control, config file and negotiated speed   //
+  while ((option = getopt(argc, argv, "m:p:t:Bf:c:i:jb:o:rC:n:")) != -1)
+    {
+      if (option == 'm' && parse_frame_mode(optarg) != -1)
+        {
+          frame_mode = parse_frame_mode(optarg);
+        }
+      else if (option == 'p' && atoi(optarg) >= 1 && atoi(optarg) <= SERIALCOMM_MAX_DEPTH)
+        {
+          pipeline_depth = atoi(optarg);
+        }
+      else if (option == 't' && atoi(optarg) >= 1)
+        {
+          response_timeout = atoi(optarg);
+        }
+      else if (option == 'B')
+        {
+          binary_requested = 1;
+        }
+      else if (option == 'f')
+        {
+          definitions = optarg;
+        }
+      else if (option == 'c' && atoi(optarg) >= 0)
+        {
+          cache_enabled = 1;
+          regcache_init(&cache, atoi(optarg));
+        }
+      else if (option == 'i')
+        {
+          script = optarg;
+        }
+      else if (option == 'j')
+        {
+          json_output = 1;
+        }
+      else if (option == 'b' && speed_constant(atoi(optarg)) != B0)
+        {
+          line_config.speed = atoi(optarg);
+        }
+      else if (option == 'o' && parse_line_format(optarg, &line_config) == 0)
+        {
+          continue;
+        }
+      else if (option == 'r')
+        {
+          line_config.rtscts = 1;
+        }
+      else if (option == 'C' && load_line_config(optarg, &line_config) == 0)
+        {
+          continue;
+        }
+      else if (option == 'n' && atoi(optarg) > 0)
+        {
+          line_config.maxspeed = atoi(optarg);
+        }
+      else
+        {
+          fprintf(stderr, "Usage: %s [-m fixed|line] [-p depth] [-t timeout_ms] [-B] [-f register definitions] [-c cache ttl_ms] "
+                  "[-i script|-] [-j] [-b baud] [-o 8N1] [-r] [-C line config] [-n max negotiated baud] <serial port>\n", argv[0]);
+          return 1;
+        }
+    }
+
+  // JSON results are for scripts; without a script it is read from stdin //
+  script_mode = script != NULL || json_output;
+  if (script != NULL && strcmp(script, "-") != 0 && (input = fopen(script, "r")) == NULL)
+    {
+      fprintf(stderr, "ERROR: Could not open %s\n", script);
+      return 1;
+    }
+
+  // sequence tags only exist in FRAME_LINE and binary mode //
+  if (pipeline_depth > 1 && frame_mode != FRAME_LINE && !binary_requested)
+    {
+      fprintf(stderr, "ERROR: Pipelining needs the line framing mode (-m line) or binary mode (-B)\n");
+      return 1;
+    }
+
+  // many definitions go in one request, which only a line can hold //
+  if (definitions != NULL && (frame_mode != FRAME_LINE || binary_requested))
+    {
+      fprintf(stderr, "ERROR: Sending register definitions needs the line framing mode (-m line)\n");
+      return 1;
+    }
 
 	// check argument count //
-	if (argc < 2)
+	if (optind >= argc)
 		{
 			fprintf(stderr, "ERROR: You must specify a serial port name\n");
 			return 1;
 		}
 
   // get serial port name //
-  strcpy(filename, argv[1]);
+  filename = argv[optind];
 
-  // test printf for debugging //
-  printf("Client port is: %s\n", filename);
+  // test printf for debugging; a script gets its results only //
+  if (!script_mode)
+    {
+      printf("Client port is: %s\n", filename);
+    }
 
 	fd = my_open(filename, O_RDWR | O_NOCTTY);
   if (fd < 0)
@@ -156,42 +946,117 @@ int main(int argc, char *argv[])
     }
 
   // set the serial port attributes, i.e baud rate and parity //
-  set_interface_attributes(fd, B115200, 0);
+  set_interface_attributes(fd, &line_config);
+  if (serialcomm_open(&client, fd, frame_mode) != 0)
+    {
+      fprintf(stderr, "ERROR: Could not set up the client on %s\n", filename);
+      my_close(fd);
+      return 1;
+    }
+  serialcomm_set_depth(&client, pipeline_depth);
+  serialcomm_set_timeout(&client, response_timeout);
+  serialcomm_set_notify(&client, handle_notification, NULL);
+
+  // agree on a faster line first, if asked to //
+  if (line_config.maxspeed > 0 && negotiate_speed(fd) != 0)
+    {
+      fprintf(stderr, "ERROR: Could not negotiate the line speed, staying at %d baud\n", line_config.speed);
+    }
+
+  // negotiate the binary protocol, which the client switches to once the //
+  // server accepts it; the requests are still entered as text            //
+  if (binary_requested && (send_request("AT+BIN", server_response) != 0 || strncmp(server_response, "OK", 2) != 0))
+    {
+      fprintf(stderr, "ERROR: The server did not accept the binary mode\n");
+      serialcomm_close(&client);
+      my_close(fd);
+      return 1;
+    }
   
-  // main loop to wait user interactions //
-  printf("Enter AT-Command, 'insert+<value>+<bounds>', 'help' or 'quit': \n");
-  while (1)
+  // provision the registers of the definition file first //
+  if (definitions != NULL && provision_file(definitions) != 0)
+    {
+      fprintf(stderr, "ERROR: Not all the registers of %s were inserted\n", definitions);
+    }
+
+  // main loop to wait user interactions; a line may hold several //
+  // requests separated by spaces, which are sent one after the other //
+  if (script_mode)
+    {
+      run_script(input);
+      quit = 1;
+    }
+  else
+    {
+      printf("Enter AT-Command, 'insert+<value>+<bounds>', 'listen+<ms>', 'help' or 'quit': \n");
+    }
+
+  while (!quit)
     {
       printf("~ ");
-      scanf("%s", request);
-      if (strcmp(request, "help") == 0) // if 'help' is entered, print the help menu //
-        {
-          print_help();
-        }
-      else if (strcmp(request, "quit") == 0)
+      fflush(stdout);
+      if (getline(&line, &line_size, stdin) == -1)
         {
-          send_request(fd, request); // kill the server //
-          break; // if 'quit' is entered, close the client //
+          break; // end of input //
         }
-      else if(strncmp(request, "insert", 6) == 0)
+
+      // a line has at most one request for every two characters //
+      requests = (char **)realloc(requests, (line_size / 2 + 1) * sizeof(char *));
+      if (requests == NULL)
         {
-          // 'insert' requests are set in this statement, because we need to update //
-          // the help menu after the insertion //
-          send_request(fd, request);
-          reg_count++; // update reg count since a new register was inserted //
-          strcpy(insertproperties, request); // copy the request to a temp string, to avoid segfault //
-          update_menu(insertproperties);
-          printf("~ Register inserted, help menu updated\n");
+          fprintf(stderr, "ERROR: Not enough memory for the requests\n");
+          break;
         }
-      else
+
+      count = 0;
+      for (token = strtok_r(line, " \t\r\n", &saveptr); token != NULL && !quit; token = strtok_r(NULL, " \t\r\n", &saveptr))
         {
-          // normal AT-Command to send to server //
-          send_request(fd, request);
+          if (strcmp(token, "help") == 0) // if 'help' is entered, print the help menu //
+            {
+              run_requests(requests, count); // send what came before it first //
+              count = 0;
+              print_help();
+            }
+          else if (strncmp(token, "listen+", 7) == 0 && atoi(token + 7) > 0)
+            {
+              run_requests(requests, count);
+              count = 0;
+              listen_notifications(atoi(token + 7));
+            }
+          else
+            {
+              requests[count++] = token;
+              quit = (strcmp(token, "quit") == 0); // 'quit' kills the server and closes the client //
+            }
         }
+
+      run_requests(requests, count);
+    }
+
+  free(requests);
+  free(line);
+
+  if (cache_enabled)
+    {
+      fprintf(script_mode ? stderr : stdout, "~ %ld requests answered from the cache\n", cache.hits);
+      regcache_free(&cache);
+    }
+  free(deferred);
+
+  if (input != stdin)
+    {
+      fclose(input);
     }
 
   // close the serial port //
+  serialcomm_close(&client);
   my_close(fd);
 
+  // a script tells whether all of its requests succeeded //
+  if (script_mode && failures > 0)
+    {
+      return 2;
+    }
+
 	return 0;
 }
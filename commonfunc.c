@@ -3,6 +3,7 @@
 // Last Edited: 31/1/2023 //
 
 #include "commonfunc.h"
+#include "scan.h"
 #include <stdio.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -10,6 +11,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <stdlib.h>
+#include <limits.h>
 
 // ********* my_open ********** //
 // calls the open system call used for the server and //
@@ -46,33 +48,92 @@ int my_close(int fd)
   return result;
 }
 
+// ********** sync_parent_dir ********** //
+// fsync the directory holding path, so a file renamed to path is //
+// still there after a crash; returns 0 on success and -1 on error //
+int sync_parent_dir(const char *path)
+{
+  const char *slash = strrchr(path, '/');
+  char *dir;
+  int fd, result = -1;
+
+  if (slash == NULL)
+    {
+      dir = strdup(".");
+    }
+  else
+    {
+      dir = strndup(path, slash == path ? 1 : (size_t)(slash - path));
+    }
+  if (dir == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in sync\n");
+      exit(1);
+    }
+
+  fd = open(dir, O_RDONLY | O_DIRECTORY);
+  if (fd >= 0)
+    {
+      result = fsync(fd);
+      close(fd);
+    }
+
+  free(dir);
+  return result;
+}
+
+// ********** wait_ready ********** //
+// wait with poll until the port can be read or written, for the //
+// blocking my_read and my_write on a non-blocking port; returns  //
+// 1 if it is ready and -1 on error or hang up                    //
+static int wait_ready(int fd, short events)
+{
+  struct pollfd pfd = { .fd = fd, .events = events };
+  int result;
+
+  do
+    {
+      result = poll(&pfd, 1, -1);
+    }
+  while (result == -1 && errno == EINTR);
+
+  return result > 0 && (pfd.revents & events) ? 1 : -1;
+}
+
 // ********* my_read ********** //
-// same as the read system call, but it ensures that all the bytes //
-// requested will be read.                                         //     
+// same as the read system call, but it reads until all the bytes   //
+// requested have arrived, or the port has no more to give, i.e. an //
+// end of file or a tty read returning nothing; returns the bytes   //
+// read, or -1 if an error came before any byte                     //
 ssize_t my_read(int fd, void *buf, size_t count)
 {
-  ssize_t bytes_read, total_read = 0;
-  ssize_t bytes_needed = count;
-  ssize_t bytes_remaining;
-  
-  if ((bytes_read = read(fd, buf, count)) == -1) 
-    { 
-      perror("Read"); 
-    }
-  
-  // count the bytes read and check if there are missing //
-  // read again until all the bytes are read //
-  total_read = bytes_read;
-  
-  while(total_read < bytes_needed && bytes_read != 0) 
+  struct iovec iov = { .iov_base = buf, .iov_len = count };
+  ssize_t bytes_read;
+  size_t total_read = 0;
+
+  while (total_read < count)
     {
-      bytes_remaining = bytes_needed - total_read;
-      if ((bytes_read = read(fd, buf + total_read, bytes_remaining)) == -1) 
-        { 
-          perror("Read"); 
+      iov.iov_base = (char *)buf + total_read;
+      iov.iov_len = count - total_read;
+      bytes_read = my_readv(fd, &iov, 1);
+
+      if (bytes_read == -1)
+        {
+          perror("Read");
+          return total_read > 0 ? (ssize_t)total_read : -1;
         }
-      
-      total_read = total_read + bytes_read;        
+
+      // nothing to read now; on a non-blocking port wait for it, otherwise it is the end //
+      if (bytes_read == 0)
+        {
+          if (errno != EAGAIN || wait_ready(fd, POLLIN) != 1)
+            {
+              break;
+            }
+          continue;
+        }
+
+      total_read = total_read + bytes_read;
     }
 
   return total_read;
@@ -80,71 +141,388 @@ ssize_t my_read(int fd, void *buf, size_t count)
 
 // ********* my_write ********** //
 // same as the write system call, but it ensures that all the bytes //
-// requested will be written.                                       //  
+// requested will be written; returns the bytes written, or -1 if   //
+// an error came before any byte                                    //
 ssize_t my_write(int fd, const void *buf, size_t count)
 {
-  ssize_t bytes_written, total_written = 0;
-  ssize_t bytes_needed = count;
-  ssize_t bytes_remaining;
-  
-  if ((bytes_written = write(fd, buf, count)) == -1) 
-    { 
-      perror("Write");
-    }
-  
-  // count the bytes written and check if there are missing //
-  // write again until all the bytes are read //
-  total_written = bytes_written;
-  
-  while(total_written < bytes_needed) 
-    {
-      bytes_remaining = bytes_needed - total_written;
-      if ((bytes_written = write(fd, buf + total_written, bytes_remaining)) == -1) 
+  struct iovec iov = { .iov_base = (void *)buf, .iov_len = count };
+
+  return my_writev_all(fd, &iov, 1);
+}
+
+// ********** my_readv ********** //
+// a single readv into the given buffers, the non-blocking variant //
+// of my_read: returns the bytes read, which may be fewer than     //
+// asked for, 0 if there is nothing to read now (errno is EAGAIN)  //
+// or at the end of file (errno is 0), and -1 on error             //
+ssize_t my_readv(int fd, const struct iovec *iov, int count)
+{
+  ssize_t bytes_read;
+
+  do
+    {
+      errno = 0;
+      bytes_read = readv(fd, iov, count);
+    }
+  while (bytes_read == -1 && errno == EINTR);
+
+  if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      errno = EAGAIN;
+      return 0;
+    }
+
+  return bytes_read;
+}
+
+// ********** my_writev ********** //
+// a single writev of the given buffers, the non-blocking variant    //
+// of my_write: returns the bytes written, which may be fewer than   //
+// given, 0 if the port cannot take any now, and -1 on error         //
+ssize_t my_writev(int fd, const struct iovec *iov, int count)
+{
+  ssize_t bytes_written;
+
+  do
+    {
+      bytes_written = writev(fd, iov, count);
+    }
+  while (bytes_written == -1 && errno == EINTR);
+
+  if (bytes_written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      return 0;
+    }
+
+  return bytes_written;
+}
+
+// ********** my_writev_all ********** //
+// write all the given buffers, waiting for the port when it //
+// cannot take more; up to MAX_IOV buffers; returns the      //
+// bytes written, or -1 if an error came before any byte     //
+ssize_t my_writev_all(int fd, const struct iovec *iov, int count)
+{
+  struct iovec left[MAX_IOV]; // what is still to write //
+  ssize_t bytes_written;
+  size_t total_written = 0;
+  int first = 0;
+
+  if (count > MAX_IOV)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  memcpy(left, iov, count * sizeof(struct iovec));
+
+  while (first < count)
+    {
+      // skip the buffers already written //
+      if (left[first].iov_len == 0)
+        {
+          first++;
+          continue;
+        }
+
+      bytes_written = my_writev(fd, left + first, count - first);
+      if (bytes_written == -1)
         {
           perror("Write");
+          return total_written > 0 ? (ssize_t)total_written : -1;
+        }
+
+      if (bytes_written == 0)
+        {
+          if (wait_ready(fd, POLLOUT) != 1)
+            {
+              perror("Write");
+              return total_written > 0 ? (ssize_t)total_written : -1;
+            }
+          continue;
+        }
+
+      total_written = total_written + bytes_written;
+
+      // move past what the partial write took //
+      while (bytes_written > 0)
+        {
+          size_t taken = (size_t)bytes_written < left[first].iov_len ? (size_t)bytes_written : left[first].iov_len;
+
+          left[first].iov_base = (char *)left[first].iov_base + taken;
+          left[first].iov_len -= taken;
+          bytes_written -= taken;
+          if (left[first].iov_len == 0)
+            {
+              first++;
+            }
         }
-      
-      total_written = total_written + bytes_written;        
     }
 
   return total_written;
 }
 
+// ********** parse_regid ********** //
+// converts a register id string, e.g. "REG5", to its numeric //
+// index; returns the index on success and -1 if the string   //
+// is not a valid register id                                 //
+int parse_regid(const char *regid)
+{
+  return slice_regid(slice_of(regid));
+}
+
+// ********** slice_regid ********** //
+// parse_regid for a register id that is a part of a request //
+int slice_regid(slice_t regid)
+{
+  return slice_id(regid, "REG");
+}
+
+// ********** slice_id ********** //
+// converts an id with the given prefix, e.g. "REG5" or "BLK2", //
+// to its number; returns the number on success and -1 if the  //
+// slice is not such an id                                      //
+int slice_id(slice_t regid, const char *prefix)
+{
+  size_t i = strlen(prefix);
+  int index = 0;
+
+  if (!slice_prefix(regid, prefix))
+    {
+      return -1;
+    }
+
+  // ids are written without leading zeros, e.g. "REG01" is not "REG1" //
+  if (regid.len == i || regid.ptr[i] < '1' || regid.ptr[i] > '9')
+    {
+      return -1;
+    }
+
+  for (uint32_t eight; i + 8 <= regid.len && scan_digits8(regid.ptr + i, &eight); i += 8)
+    {
+      if (index > (int)((INT_MAX - eight) / 100000000))
+        {
+          return -1;
+        }
+
+      index = index * 100000000 + (int)eight;
+    }
+
+  for (; i < regid.len; i++)
+    {
+      if (regid.ptr[i] < '0' || regid.ptr[i] > '9' || index > (INT_MAX - (regid.ptr[i] - '0')) / 10)
+        {
+          return -1;
+        }
+
+      index = index * 10 + (regid.ptr[i] - '0');
+    }
+
+  return index;
+}
+
 // ********** TTY TERMINAL FUNCTIONS BELOW THIS POINT ********** // 
-// ********** wait_for_response ********** //
-// function to set blocking and read timeout for the serial port //
-// the timeout is set to 0.5 seconds                             //
-void wait_for_response(int fd, int blocksignal)
+// ********** wait_readable ********** //
+// wait with poll until the port has bytes to read, at most  //
+// timeout_ms milliseconds (-1 waits forever); returns 1 if  //
+// the port is readable, 0 on timeout and -1 on error         //
+int wait_readable(int fd, int timeout_ms)
 {
-  struct termios tty;
-  
-  memset (&tty, 0, sizeof tty);
-  
-  if (tcgetattr (fd, &tty) != 0)
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  int result;
+
+  do
     {
-      perror("tcgetattr");
-      return;
+      result = poll(&pfd, 1, timeout_ms);
     }
+  while (result == -1 && errno == EINTR);
 
-  tty.c_cc[VMIN]  = blocksignal ? 1 : 0;
-  tty.c_cc[VTIME] = 5; 
+  if (result == -1)
+    {
+      perror("poll");
+      return -1;
+    }
 
-  if (tcsetattr (fd, TCSANOW, &tty) != 0)
+  // a hang up or an error on the port also ends the wait //
+  if (result > 0 && !(pfd.revents & POLLIN))
     {
-      perror("tcsetattr");
-      return;
+      return -1;
+    }
+
+  return result > 0 ? 1 : 0;
+}
+
+// ********** monotonic_ms ********** //
+// current time of the monotonic clock, in milliseconds //
+long long monotonic_ms(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// the baud rates termios knows, from the lowest to the highest //
+static const struct { int baud; speed_t speed; } speeds[] = {
+  {9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600}, {115200, B115200},
+  {230400, B230400}, {460800, B460800}, {500000, B500000}, {576000, B576000}, {921600, B921600},
+  {1000000, B1000000}, {1152000, B1152000}, {1500000, B1500000}, {2000000, B2000000},
+#ifdef B2500000
+  {2500000, B2500000}, {3000000, B3000000}, {3500000, B3500000}, {4000000, B4000000},
+#endif
+};
+
+// ********** line_config_init ********** //
+// set the line settings the programs always used: 115200 baud, //
+// 8 data bits, no parity, 1 stop bit and no flow control        //
+void line_config_init(lineconf_t *conf)
+{
+  conf->speed = 115200;
+  conf->databits = 8;
+  conf->parity = 'N';
+  conf->stopbits = 1;
+  conf->rtscts = 0;
+  conf->maxspeed = 0;
+}
+
+// ********** speed_constant ********** //
+// converts a baud rate, e.g. 921600, to its termios constant, //
+// e.g. B921600; returns B0 if the rate is not supported       //
+speed_t speed_constant(int baud)
+{
+  for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+    {
+      if (speeds[i].baud == baud)
+        {
+          return speeds[i].speed;
+        }
+    }
+
+  return B0;
+}
+
+// ********** best_speed ********** //
+// the highest supported baud rate not above the limit; returns //
+// 0 if the limit is below all of them                          //
+int best_speed(int limit)
+{
+  int best = 0;
+
+  for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+    {
+      if (speeds[i].baud <= limit)
+        {
+          best = speeds[i].baud;
+        }
+    }
+
+  return best;
+}
+
+// ********** parse_line_format ********** //
+// read a line format, e.g. "8N1" or "7E2", i.e. the data bits, //
+// the parity (N, E or O) and the stop bits, into the settings; //
+// returns 0 on success and -1 if the format is invalid          //
+int parse_line_format(const char *format, lineconf_t *conf)
+{
+  char parity;
+
+  if (strlen(format) != 3 || (format[0] != '7' && format[0] != '8')
+      || (format[2] != '1' && format[2] != '2'))
+    {
+      return -1;
+    }
+
+  parity = format[1] >= 'a' ? format[1] - 'a' + 'A' : format[1];
+  if (parity != 'N' && parity != 'E' && parity != 'O')
+    {
+      return -1;
+    }
+
+  conf->databits = format[0] - '0';
+  conf->parity = parity;
+  conf->stopbits = format[2] - '0';
+  return 0;
+}
+
+// ********** load_line_config ********** //
+// read the line settings from a config file of "key = value" //
+// lines, with the keys speed, format, flow (rtscts or none)  //
+// and maxspeed; empty lines and lines starting with '#' are  //
+// skipped; returns 0 on success and -1 on failure            //
+int load_line_config(const char *path, lineconf_t *conf)
+{
+  FILE *file = fopen(path, "r");
+  char line[256], key[64], value[64];
+  int lineno = 0, result = 0;
+
+  if (file == NULL)
+    {
+      fprintf(stderr, "ERROR: Could not open %s\n", path);
+      return -1;
+    }
+
+  while (result == 0 && fgets(line, sizeof(line), file) != NULL)
+    {
+      lineno++;
+      if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#')
+        {
+          continue;
+        }
+
+      if (sscanf(line, " %63[a-z] = %63s", key, value) != 2)
+        {
+          result = -1;
+        }
+      else if (strcmp(key, "speed") == 0)
+        {
+          conf->speed = atoi(value);
+          result = speed_constant(conf->speed) == B0 ? -1 : 0;
+        }
+      else if (strcmp(key, "format") == 0)
+        {
+          result = parse_line_format(value, conf);
+        }
+      else if (strcmp(key, "flow") == 0 && (strcmp(value, "rtscts") == 0 || strcmp(value, "none") == 0))
+        {
+          conf->rtscts = strcmp(value, "rtscts") == 0;
+        }
+      else if (strcmp(key, "maxspeed") == 0 && atoi(value) > 0)
+        {
+          conf->maxspeed = atoi(value);
+        }
+      else
+        {
+          result = -1;
+        }
+
+      if (result != 0)
+        {
+          fprintf(stderr, "ERROR: %s:%d: not a valid setting\n", path, lineno);
+        }
     }
+
+  fclose(file);
+  return result;
 }
 
 // ********** set_interface_attributes ********** //
 // set the seiral port interface attributes, i.e. baud rate and parity //
 // mandatory in order for the server and client to communicate         //
-// the default values are present with no changes                      //
-int set_interface_attributes(int fd, int speed, int parity)
+// the port is configured once here, reads never block and waiting   //
+// for data is done with poll, see wait_readable                      //
+int set_interface_attributes(int fd, const lineconf_t *conf)
 {
   struct termios tty;
+  speed_t speed = speed_constant(conf->speed);
   memset (&tty, 0, sizeof tty);
 
+  if (speed == B0)
+    {
+      fprintf(stderr, "ERROR: %d baud is not supported\n", conf->speed);
+      return -1;
+    }
+
   // check the current settings //
   if (tcgetattr (fd, &tty) != 0)
     {
@@ -155,22 +533,33 @@ int set_interface_attributes(int fd, int speed, int parity)
   cfsetospeed (&tty, speed);
   cfsetispeed (&tty, speed);
 
-  tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;     // set to 8-bit chars
+  tty.c_cflag = (tty.c_cflag & ~CSIZE) | (conf->databits == 7 ? CS7 : CS8); // set the data bits, 8 by default
   // disable IGNBRK for mismatched speed tests; otherwise receive break
   tty.c_iflag &= ~IGNBRK;         // ignore break signal //
   tty.c_lflag = 0;                // no signaling chars, no echo, no canonical processing //
   tty.c_oflag = 0;                // no remapping and no delays //
   tty.c_cc[VMIN]  = 0;            // read doesn't block //
-  tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout // 
+  tty.c_cc[VTIME] = 0;            // no read timeout, waiting is done with poll // 
 
   tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
 
   tty.c_cflag |= (CLOCAL | CREAD);// ignore modem controls,
                                   // enable reading
   tty.c_cflag &= ~(PARENB | PARODD);      // shut off parity
-  tty.c_cflag |= parity;
+  if (conf->parity != 'N')
+    {
+      tty.c_cflag |= PARENB | (conf->parity == 'O' ? PARODD : 0);
+    }
   tty.c_cflag &= ~CSTOPB;
+  if (conf->stopbits == 2)
+    {
+      tty.c_cflag |= CSTOPB;
+    }
   tty.c_cflag &= ~CRTSCTS;
+  if (conf->rtscts)
+    {
+      tty.c_cflag |= CRTSCTS;     // RTS/CTS hardware flow control //
+    }
 
   if (tcsetattr (fd, TCSANOW, &tty) != 0)
     {
@@ -179,4 +568,317 @@ int set_interface_attributes(int fd, int speed, int parity)
     }
     
   return 0;
-}
\ No newline at end of file
+}
+// ********** FRAMING FUNCTIONS BELOW THIS POINT ********** //
+// ********** parse_frame_mode ********** //
+// converts a framing mode name, "fixed", "line" or "binary", //
+// to its FRAME_* value; returns -1 if the name is not known    //
+int parse_frame_mode(const char *name)
+{
+  if (strcmp(name, "fixed") == 0)
+    {
+      return FRAME_FIXED;
+    }
+  else if (strcmp(name, "line") == 0)
+    {
+      return FRAME_LINE;
+    }
+  else if (strcmp(name, "binary") == 0)
+    {
+      return FRAME_BINARY;
+    }
+
+  return -1;
+}
+
+// ********** frame_reader_init ********** //
+// set up an empty frame reader for the given framing mode //
+void frame_reader_init(framereader_t *reader, int mode)
+{
+  memset(reader, 0, sizeof(*reader));
+  reader->mode = mode;
+}
+
+// ********** frame_fill ********** //
+// read whatever bytes are available on the port into the reader //
+// returns the bytes read, 0 if there were none and -1 on error  //
+ssize_t frame_fill(framereader_t *reader, int fd)
+{
+  struct iovec iov;
+  ssize_t bytes_read;
+
+  // move the unconsumed bytes to the front to make room //
+  if (reader->start > 0)
+    {
+      memmove(reader->buf, reader->buf + reader->start, reader->len - reader->start);
+      reader->len = reader->len - reader->start;
+      reader->start = 0;
+    }
+
+  // a full buffer without a complete line can only be a line that is too long //
+  if (reader->len == FRAME_MAX)
+    {
+      reader->len = 0;
+      reader->dropped = reader->dropped + !reader->discarding;
+      reader->discarding = 1;
+    }
+
+  // on a non-blocking port there may be nothing to read, like a tty with VMIN=0 //
+  iov.iov_base = reader->buf + reader->len;
+  iov.iov_len = FRAME_MAX - reader->len;
+  bytes_read = my_readv(fd, &iov, 1);
+
+  if (bytes_read == -1)
+    {
+      perror("Read");
+    }
+  else
+    {
+      reader->len = reader->len + bytes_read;
+    }
+
+  return bytes_read;
+}
+
+// ********** frame_next ********** //
+// take the next complete frame out of the reader; returns the frame //
+// as a string, or NULL if no complete frame has been received yet;  //
+// a line that was too long comes out as an empty string; the string //
+// stays valid until the next frame_fill                             //
+char *frame_next(framereader_t *reader)
+{
+  char *frame, *end;
+
+  if (reader->mode == FRAME_FIXED)
+    {
+      if (reader->len - reader->start < FIXED_FRAME_SIZE)
+        {
+          return NULL;
+        }
+
+      // fixed frames are padded, the message ends at the first '\0' //
+      memcpy(reader->fixed, reader->buf + reader->start, FIXED_FRAME_SIZE);
+      reader->fixed[FIXED_FRAME_SIZE] = '\0';
+      reader->start = reader->start + FIXED_FRAME_SIZE;
+
+      return reader->fixed;
+    }
+
+  while (reader->start < reader->len)
+    {
+      frame = reader->buf + reader->start;
+      end = memchr(frame, '\n', reader->len - reader->start);
+      if (end == NULL)
+        {
+          return NULL;
+        }
+
+      *end = '\0';
+      reader->start = end - reader->buf + 1;
+
+      if (end > frame && end[-1] == '\r')
+        {
+          end[-1] = '\0'; // accept CR/LF line endings as well //
+        }
+
+      if (reader->discarding)
+        {
+          // this was the tail of a dropped line; it is returned as an //
+          // empty frame, so that the line still gets its error reply   //
+          reader->discarding = 0;
+          return end;
+        }
+      else if (*frame != '\0')
+        {
+          return frame; // empty lines are skipped //
+        }
+    }
+
+  return NULL;
+}
+
+// ********** frame_write ********** //
+// send a message in the given framing mode; fixed frames are //
+// truncated or padded with zeros to FIXED_FRAME_SIZE bytes,  //
+// lines are sent as they are with a '\n' added if missing    //
+ssize_t frame_write(int fd, int mode, const char *message)
+{
+  struct iovec part = { .iov_base = (void *)message, .iov_len = strlen(message) };
+
+  return frame_writev(fd, mode, &part, 1);
+}
+
+// ********** frame_writev ********** //
+// same as frame_write, for a message made of several parts, e.g. //
+// a sequence tag and a request; the parts are written with one  //
+// writev instead of being copied together first                 //
+ssize_t frame_writev(int fd, int mode, const struct iovec *parts, int count)
+{
+  static const char newline = '\n';
+  char frame[FIXED_FRAME_SIZE];
+  struct iovec iov[MAX_IOV];
+  size_t length = 0, taken;
+  const char *last = NULL; // the last byte of the message //
+
+  if (count > MAX_IOV - 1)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  if (mode == FRAME_FIXED)
+    {
+      memset(frame, 0, FIXED_FRAME_SIZE);
+      for (int i = 0; i < count && length < FIXED_FRAME_SIZE; i++)
+        {
+          taken = parts[i].iov_len < FIXED_FRAME_SIZE - length ? parts[i].iov_len : FIXED_FRAME_SIZE - length;
+          memcpy(frame + length, parts[i].iov_base, taken);
+          length += taken;
+        }
+
+      return my_write(fd, frame, FIXED_FRAME_SIZE);
+    }
+
+  for (int i = 0; i < count; i++)
+    {
+      if (parts[i].iov_len > 0)
+        {
+          last = (const char *)parts[i].iov_base + parts[i].iov_len - 1;
+        }
+    }
+
+  if (last != NULL && *last == '\n')
+    {
+      return my_writev_all(fd, parts, count);
+    }
+
+  // a line without its '\n' gets one, and is cut to the longest line //
+  for (int i = 0; i < count; i++)
+    {
+      taken = parts[i].iov_len < FRAME_MAX - 1 - length ? parts[i].iov_len : FRAME_MAX - 1 - length;
+      iov[i].iov_base = parts[i].iov_base;
+      iov[i].iov_len = taken;
+      length += taken;
+    }
+  iov[count].iov_base = (void *)&newline;
+  iov[count].iov_len = 1;
+
+  return my_writev_all(fd, iov, count + 1);
+}
+
+// ********** OUTPUT BUFFER FUNCTIONS BELOW THIS POINT ********** //
+// ********** outbuf_init ********** //
+// set up an empty output buffer //
+void outbuf_init(outbuf_t *out)
+{
+  out->data = NULL;
+  out->len = 0;
+  out->cap = 0;
+}
+
+// ********** outbuf_append ********** //
+// add bytes at the end of the output buffer, growing it if needed //
+// returns 0 on success and -1 on memory allocation failure        //
+int outbuf_append(outbuf_t *out, const void *data, size_t length)
+{
+  char *grown;
+  size_t cap = out->cap ? out->cap : FRAME_MAX;
+
+  while (out->len + length > cap)
+    {
+      cap = 2 * cap;
+    }
+
+  if (cap != out->cap)
+    {
+      grown = (char *)realloc(out->data, cap);
+      if (grown == NULL)
+        {
+          return -1;
+        }
+
+      out->data = grown;
+      out->cap = cap;
+    }
+
+  memcpy(out->data + out->len, data, length);
+  out->len = out->len + length;
+
+  return 0;
+}
+
+// ********** frame_append ********** //
+// same as frame_write, but the framed message is added to the //
+// output buffer instead of being written to the port; lines   //
+// are not limited in length here                              //
+int frame_append(outbuf_t *out, int mode, const char *message)
+{
+  char frame[FIXED_FRAME_SIZE] = {'\0'};
+  size_t length = strlen(message);
+
+  if (mode == FRAME_FIXED)
+    {
+      memcpy(frame, message, length < FIXED_FRAME_SIZE ? length : FIXED_FRAME_SIZE);
+      return outbuf_append(out, frame, FIXED_FRAME_SIZE);
+    }
+
+  if (outbuf_append(out, message, length) != 0)
+    {
+      return -1;
+    }
+
+  if (length == 0 || message[length - 1] != '\n')
+    {
+      return outbuf_append(out, "\n", 1);
+    }
+
+  return 0;
+}
+
+// ********** outbuf_flush ********** //
+// write the output buffer to the port; on a non-blocking port the //
+// bytes the port cannot take now stay in the buffer for the next  //
+// flush; returns the number of bytes written, or -1 on error      //
+ssize_t outbuf_flush(outbuf_t *out, int fd)
+{
+  struct iovec iov;
+  ssize_t bytes_written, total_written = 0;
+
+  while ((size_t)total_written < out->len)
+    {
+      iov.iov_base = out->data + total_written;
+      iov.iov_len = out->len - total_written;
+      bytes_written = my_writev(fd, &iov, 1);
+
+      if (bytes_written == -1)
+        {
+          perror("Write");
+          out->len = 0; // the port is broken, drop the replies //
+          return -1;
+        }
+
+      if (bytes_written == 0)
+        {
+          break; // the port cannot take more now //
+        }
+
+      total_written = total_written + bytes_written;
+    }
+
+  // keep what was not written at the front of the buffer //
+  if (total_written > 0)
+    {
+      memmove(out->data, out->data + total_written, out->len - total_written);
+      out->len = out->len - total_written;
+    }
+
+  return total_written;
+}
+
+// ********** outbuf_free ********** //
+// free the memory held by the output buffer //
+void outbuf_free(outbuf_t *out)
+{
+  free(out->data);
+  outbuf_init(out);
+}
@@ -12,33 +12,100 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <termios.h>
+#include <poll.h>
+#include <time.h>
 #include <stdlib.h>
+#include "slice.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 // Preprocessor //
-#define BOUNDS_MAX 20
-#define REGID_MAX 6
+#define FRAME_FIXED 0 // legacy mode, every message is a FIXED_FRAME_SIZE bytes frame //
+#define FRAME_LINE 1 // every message is its own bytes followed by a '\n' //
+#define FRAME_BINARY 2 // compact binary frames, see binproto.h //
+#define FIXED_FRAME_SIZE 20
+#define FRAME_MAX 65536 // the longest line accepted in FRAME_LINE mode, e.g. an insertion with long bounds //
+#define MAX_IOV 8 // the most buffers of a single gathered write, see my_writev_all //
 
 // Structs //
-// Register Struct (singly linked list) //
-// The structure of a register the server processes. It contains the register id, //
-// the register value, the bounds of the number and the pointer to the next node  //
-struct registerlist{
-	char regid[REGID_MAX]; // register id, i.e. position on the list //
-	int regvalue; // register value //
-	char bounds[BOUNDS_MAX]; // number bounds of the selected register, as string //
-	struct registerlist *next; // pointer to the next node in the list //
+// Frame Reader Struct //
+// Incremental parser for the messages arriving on a serial port. Bytes are //
+// appended as they are read and complete frames are taken out one by one,  //
+// so a read may hold any number of frames, or just a part of one           //
+struct framereader{
+	int mode; // FRAME_FIXED, FRAME_LINE or FRAME_BINARY //
+	char buf[FRAME_MAX + 1]; // received bytes not yet consumed //
+	size_t start; // start of the unconsumed bytes in buf //
+	size_t len; // end of the received bytes in buf //
+	int discarding; // set while skipping the rest of a line longer than FRAME_MAX //
+	int dropped; // the number of lines dropped for being too long //
+	char fixed[FIXED_FRAME_SIZE + 1]; // the last fixed frame, as a string //
+};
+
+typedef struct framereader framereader_t;
+
+// Output Buffer Struct //
+// Replies are built here and sent with a single write, so that all the //
+// replies of a read cost one system call instead of one each           //
+struct outbuffer{
+	char *data; // the bytes waiting to be written //
+	size_t len; // the number of bytes waiting //
+	size_t cap; // the allocated size of data //
 };
 
-// define it as "register_t" for simplicity //
-typedef struct registerlist registers_t;
+typedef struct outbuffer outbuf_t;
+
+// Line Config Struct //
+// The serial line settings of a port, see set_interface_attributes //
+struct lineconfig{
+	int speed; // the baud rate, e.g. 115200 //
+	int databits; // 7 or 8 //
+	char parity; // 'N' for none, 'E' for even or 'O' for odd //
+	int stopbits; // 1 or 2 //
+	int rtscts; // set for RTS/CTS hardware flow control //
+	int maxspeed; // the highest baud rate to negotiate, 0 to keep the speed, see AT+BAUD //
+};
+
+typedef struct lineconfig lineconf_t;
 
 // Function Prototypes //
 int my_open(const char *pathname, int flags);
+int parse_regid(const char *regid);
+int slice_regid(slice_t regid);
+int slice_id(slice_t regid, const char *prefix);
 int my_close(int fd);
+int sync_parent_dir(const char *path);
 ssize_t my_read(int fd, void *buf, size_t count);
 ssize_t my_write(int fd, const void *buf, size_t count);
-void wait_for_response(int fd, int blocksignal);
-int set_interface_attributes (int fd, int speed, int parity);
+ssize_t my_readv(int fd, const struct iovec *iov, int count);
+ssize_t my_writev(int fd, const struct iovec *iov, int count);
+ssize_t my_writev_all(int fd, const struct iovec *iov, int count);
+int wait_readable(int fd, int timeout_ms);
+long long monotonic_ms(void);
+void line_config_init(lineconf_t *conf);
+speed_t speed_constant(int baud);
+int best_speed(int limit);
+int parse_line_format(const char *format, lineconf_t *conf);
+int load_line_config(const char *path, lineconf_t *conf);
+int set_interface_attributes(int fd, const lineconf_t *conf);
+int parse_frame_mode(const char *name);
+void frame_reader_init(framereader_t *reader, int mode);
+ssize_t frame_fill(framereader_t *reader, int fd);
+char *frame_next(framereader_t *reader);
+ssize_t frame_write(int fd, int mode, const char *message);
+ssize_t frame_writev(int fd, int mode, const struct iovec *parts, int count);
+void outbuf_init(outbuf_t *out);
+int outbuf_append(outbuf_t *out, const void *data, size_t length);
+int frame_append(outbuf_t *out, int mode, const char *message);
+ssize_t outbuf_flush(outbuf_t *out, int fd);
+void outbuf_free(outbuf_t *out);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,195 @@
+// Leveled, asynchronous logger of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+#include "logger.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+// Structs //
+// Log Slot Struct //
+// A slot of the ring. The sequence number tells whose turn it is: a //
+// producer may fill slot i when seq == i, the consumer may drain it //
+// when seq == i + 1, and then hands it back with seq = i + size     //
+struct logslot{
+	atomic_size_t seq; // turn of the slot, see above //
+	int level; // level of the message //
+	char message[LOG_MSG_MAX]; // the formatted message //
+};
+
+// Globals //
+int log_level = LOG_INFO;
+static struct logslot ring[LOG_RING_SIZE];
+static atomic_size_t head; // next slot to fill //
+static size_t tail; // next slot to drain, only used by the consumer //
+static atomic_ulong dropped; // messages dropped because the ring was full //
+static atomic_int running;
+static pthread_t drainer;
+
+// ********** parse_log_level ********** //
+// converts a level name, "error", "warn", "info" or "debug", //
+// to its LOG_* value; returns -1 if the name is not known    //
+int parse_log_level(const char *name)
+{
+  const char *names[] = { "error", "warn", "info", "debug" };
+
+  for (int i = LOG_ERROR; i <= LOG_DEBUG; i++)
+    {
+      if (strcmp(name, names[i]) == 0)
+        {
+          return i;
+        }
+    }
+
+  return -1;
+}
+
+// ********** drain ********** //
+// write every message in the ring to its stream; returns the //
+// number of messages written                                 //
+static int drain(void)
+{
+  struct logslot *slot;
+  int count = 0;
+
+  while (1)
+    {
+      slot = &ring[tail % LOG_RING_SIZE];
+      if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + 1)
+        {
+          break; // the ring is empty, or the next slot is still being filled //
+        }
+
+      fputs(slot->message, slot->level <= LOG_WARN ? stderr : stdout);
+      atomic_store_explicit(&slot->seq, tail + LOG_RING_SIZE, memory_order_release);
+      tail++;
+      count++;
+    }
+
+  if (count > 0)
+    {
+      fflush(stdout);
+      fflush(stderr);
+    }
+
+  return count;
+}
+
+// ********** drain_thread ********** //
+// background thread draining the ring until the logger is stopped //
+static void *drain_thread(void *arg)
+{
+  struct timespec idle = { .tv_sec = 0, .tv_nsec = 10 * 1000 * 1000 };
+
+  (void)arg;
+
+  while (atomic_load(&running))
+    {
+      if (drain() == 0)
+        {
+          nanosleep(&idle, NULL); // nothing to write, check again in 10 ms //
+        }
+    }
+
+  drain(); // what was logged before the stop //
+
+  return NULL;
+}
+
+// ********** log_start ********** //
+// start the logger at the given runtime level; returns 0 on //
+// success, -1 if the background thread could not be created //
+int log_start(int level)
+{
+  log_level = level;
+
+  for (size_t i = 0; i < LOG_RING_SIZE; i++)
+    {
+      atomic_init(&ring[i].seq, i);
+    }
+
+  atomic_init(&head, 0);
+  tail = 0;
+  atomic_store(&running, 1);
+
+  if (pthread_create(&drainer, NULL, drain_thread, NULL) != 0)
+    {
+      atomic_store(&running, 0);
+      return -1;
+    }
+
+  return 0;
+}
+
+// ********** log_stop ********** //
+// write out the remaining messages and stop the background thread //
+void log_stop(void)
+{
+  if (atomic_exchange(&running, 0))
+    {
+      pthread_join(drainer, NULL);
+    }
+}
+
+// ********** log_write ********** //
+// format a message into the next free slot of the ring; called    //
+// through the log_* macros, which filter on the level beforehand  //
+void log_write(int level, const char *format, ...)
+{
+  struct logslot *slot;
+  size_t position, seq;
+  va_list args;
+
+  // without the background thread, e.g. before log_start, write directly //
+  if (!atomic_load_explicit(&running, memory_order_relaxed))
+    {
+      va_start(args, format);
+      vfprintf(level <= LOG_WARN ? stderr : stdout, format, args);
+      va_end(args);
+      return;
+    }
+
+  // claim a slot; the ring is shared by all the threads that log //
+  position = atomic_load_explicit(&head, memory_order_relaxed);
+  while (1)
+    {
+      slot = &ring[position % LOG_RING_SIZE];
+      seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+      if (seq == position)
+        {
+          if (atomic_compare_exchange_weak_explicit(&head, &position, position + 1,
+                                                    memory_order_relaxed, memory_order_relaxed))
+            {
+              break;
+            }
+        }
+      else if (seq < position)
+        {
+          atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed); // the ring is full //
+          return;
+        }
+      else
+        {
+          position = atomic_load_explicit(&head, memory_order_relaxed);
+        }
+    }
+
+  slot->level = level;
+  va_start(args, format);
+  vsnprintf(slot->message, LOG_MSG_MAX, format, args);
+  va_end(args);
+
+  atomic_store_explicit(&slot->seq, position + 1, memory_order_release);
+}
+
+// ********** log_dropped ********** //
+// the number of messages dropped because the ring was full //
+unsigned long log_dropped(void)
+{
+  return atomic_load(&dropped);
+}
@@ -0,0 +1,58 @@
+// Header file for the leveled, asynchronous logger of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+/* Messages are formatted by the thread that logs them into a slot of a
+lock-free ring buffer, and a background thread drains the ring to stdout
+(info and debug) or stderr (warnings and errors). Logging never blocks: if
+the ring is full the message is dropped and counted.
+
+Messages above the runtime level are filtered before any formatting, and
+messages above LOG_COMPILE_LEVEL are not compiled in at all, so at the
+default level the request path does no formatted I/O.
+*/
+
+#ifndef __LOGGER_H_
+#define __LOGGER_H_
+
+// Preprocessor //
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+// the most verbose level built into the program; debug messages //
+// are compiled out unless it is raised, e.g. -DLOG_COMPILE_LEVEL=3 //
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_INFO
+#endif
+
+#define LOG_RING_SIZE 1024 // the number of messages the ring holds, a power of two //
+#define LOG_MSG_MAX 256 // the longest message, longer ones are cut //
+
+#define log_msg(level, ...) \
+  do \
+    { \
+      if ((level) <= LOG_COMPILE_LEVEL && (level) <= log_level) \
+        { \
+          log_write((level), __VA_ARGS__); \
+        } \
+    } \
+  while (0)
+
+#define log_error(...) log_msg(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...) log_msg(LOG_WARN, __VA_ARGS__)
+#define log_info(...) log_msg(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) log_msg(LOG_DEBUG, __VA_ARGS__)
+
+// Globals //
+extern int log_level; // the runtime level, messages above it are dropped before formatting //
+
+// Function Prototypes //
+int parse_log_level(const char *name);
+int log_start(int level);
+void log_stop(void);
+void log_write(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+unsigned long log_dropped(void);
+
+#endif
@@ -0,0 +1,164 @@
+// Register cache of the client //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+#include "regcache.h"
+#include "commonfunc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ********** find_entry ********** //
+// get the entry of a register; with create set, its chunk is //
+// allocated if needed; returns NULL if there is no entry     //
+static cacheentry_t *find_entry(regcache_t *cache, int id, int create)
+{
+  cacheentry_t **chunk;
+
+  if (id < 1 || (id - 1) >> REGCACHE_CHUNK_BITS >= REGCACHE_MAX_CHUNKS)
+    {
+      return NULL;
+    }
+
+  id--;
+  chunk = &cache->chunks[id >> REGCACHE_CHUNK_BITS];
+  if (*chunk == NULL)
+    {
+      if (!create)
+        {
+          return NULL;
+        }
+
+      *chunk = (cacheentry_t *)calloc(REGCACHE_CHUNK_SIZE, sizeof(cacheentry_t));
+      if (*chunk == NULL)
+        {
+          fprintf(stderr, "ERROR: Not enough memory for the register cache\n");
+          exit(1);
+        }
+    }
+
+  return &(*chunk)[id & (REGCACHE_CHUNK_SIZE - 1)];
+}
+
+// ********** regcache_init ********** //
+// create an empty cache keeping values for ttl milliseconds //
+void regcache_init(regcache_t *cache, int ttl)
+{
+  memset(cache->chunks, 0, sizeof(cache->chunks));
+  cache->ttl = ttl;
+  cache->hits = 0;
+  arena_init(&cache->arena);
+}
+
+// ********** regcache_bounds ********** //
+// get the cached bounds of a register, or NULL //
+const char *regcache_bounds(regcache_t *cache, int id)
+{
+  cacheentry_t *entry = find_entry(cache, id, 0);
+
+  return entry != NULL ? entry->bounds : NULL;
+}
+
+// ********** regcache_set_bounds ********** //
+// keep the bounds of a register; they never change //
+void regcache_set_bounds(regcache_t *cache, int id, const char *bounds)
+{
+  cacheentry_t *entry = find_entry(cache, id, 1);
+
+  if (entry == NULL || entry->bounds != NULL)
+    {
+      return;
+    }
+
+  entry->bounds = arena_strdup(&cache->arena, bounds);
+  if (entry->bounds == NULL || bounds_compile(&entry->limits, slice_of(bounds), &cache->arena) != 0)
+    {
+      fprintf(stderr, "ERROR: Not enough memory for the register cache\n");
+      exit(1);
+    }
+}
+
+// ********** regcache_value ********** //
+// get the cached value of a register; returns 1 if it //
+// is known and has not expired, 0 if not              //
+int regcache_value(regcache_t *cache, int id, int *value)
+{
+  cacheentry_t *entry = find_entry(cache, id, 0);
+
+  if (entry == NULL || entry->expires == 0 || entry->expires <= monotonic_ms())
+    {
+      return 0;
+    }
+
+  *value = entry->value;
+  return 1;
+}
+
+// ********** regcache_set_value ********** //
+// keep the value of a register for the TTL //
+void regcache_set_value(regcache_t *cache, int id, int value)
+{
+  cacheentry_t *entry;
+
+  if (cache->ttl <= 0 || (entry = find_entry(cache, id, 1)) == NULL)
+    {
+      return;
+    }
+
+  entry->value = value;
+  entry->expires = monotonic_ms() + cache->ttl;
+}
+
+// ********** regcache_invalidate ********** //
+// forget the value of a register //
+void regcache_invalidate(regcache_t *cache, int id)
+{
+  cacheentry_t *entry = find_entry(cache, id, 0);
+
+  if (entry != NULL)
+    {
+      entry->expires = 0;
+    }
+}
+
+// ********** regcache_invalidate_all ********** //
+// forget the values of all the registers; the bounds stay //
+void regcache_invalidate_all(regcache_t *cache)
+{
+  for (int i = 0; i < REGCACHE_MAX_CHUNKS; i++)
+    {
+      for (int j = 0; cache->chunks[i] != NULL && j < REGCACHE_CHUNK_SIZE; j++)
+        {
+          cache->chunks[i][j].expires = 0;
+        }
+    }
+}
+
+// ********** regcache_check ********** //
+// check a value against the cached bounds of a register; returns //
+// 0 if it is allowed, -1 if it is not and 1 if the bounds are not //
+// known                                                           //
+int regcache_check(regcache_t *cache, int id, int value)
+{
+  cacheentry_t *entry = find_entry(cache, id, 0);
+
+  if (entry == NULL || entry->bounds == NULL)
+    {
+      return 1;
+    }
+
+  return bounds_check(&entry->limits, value);
+}
+
+// ********** regcache_free ********** //
+// free the cache //
+void regcache_free(regcache_t *cache)
+{
+  for (int i = 0; i < REGCACHE_MAX_CHUNKS; i++)
+    {
+      free(cache->chunks[i]);
+      cache->chunks[i] = NULL;
+    }
+
+  arena_free(&cache->arena);
+}
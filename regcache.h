@@ -0,0 +1,59 @@
+// Header file for the register cache of the client //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+/* The client may keep what it learns about the registers from the server
+responses. The bounds of a register never change after its insertion, so
+they are kept for good once read. The values may be changed by other clients,
+so they are kept for a limited time only (the TTL); a TTL of 0 keeps no
+values at all. With the bounds known, writes of values out of them can be
+refused without asking the server.
+*/
+
+#ifndef __REGISTER_CACHE_H_
+#define __REGISTER_CACHE_H_
+
+#include "bounds.h"
+#include "arena.h"
+
+// Preprocessor //
+#define REGCACHE_CHUNK_BITS 12 // every chunk of the cache holds 4096 registers //
+#define REGCACHE_CHUNK_SIZE (1 << REGCACHE_CHUNK_BITS)
+#define REGCACHE_MAX_CHUNKS 16384 // as many registers as a server table holds //
+
+// Structs //
+// Cache Entry Struct //
+// What is known about one register //
+struct cacheentry{
+	char *bounds; // the bounds string, NULL if not known //
+	bounds_t limits; // the bounds compiled, to check writes //
+	int value; // the last value known //
+	long long expires; // monotonic_ms() time the value expires, 0 if it is not known //
+};
+
+typedef struct cacheentry cacheentry_t;
+
+// Register Cache Struct //
+// The entries live in chunks allocated once a register of them is //
+// cached, so a few registers with high ids take little memory     //
+struct regcache{
+	cacheentry_t *chunks[REGCACHE_MAX_CHUNKS]; // the chunk directory //
+	int ttl; // milliseconds a value is kept //
+	arena_t arena; // the bounds strings and compiled bounds //
+	long hits; // requests answered from the cache //
+};
+
+typedef struct regcache regcache_t;
+
+// Function Prototypes //
+void regcache_init(regcache_t *cache, int ttl);
+const char *regcache_bounds(regcache_t *cache, int id);
+void regcache_set_bounds(regcache_t *cache, int id, const char *bounds);
+int regcache_value(regcache_t *cache, int id, int *value);
+void regcache_set_value(regcache_t *cache, int id, int value);
+void regcache_invalidate(regcache_t *cache, int id);
+void regcache_invalidate_all(regcache_t *cache);
+int regcache_check(regcache_t *cache, int id, int value);
+void regcache_free(regcache_t *cache);
+
+#endif
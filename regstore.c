@@ -0,0 +1,524 @@
+// Register store used by the server //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+#include "regstore.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// ********** hash_bounds ********** //
+// FNV-1a hash of a bounds string //
+static unsigned int hash_bounds(slice_t bounds)
+{
+  unsigned int hash = 2166136261u;
+
+  for (size_t i = 0; i < bounds.len; i++)
+    {
+      hash = (hash ^ (unsigned char)bounds.ptr[i]) * 16777619u;
+    }
+
+  return hash;
+}
+
+// ********** grow_interned ********** //
+// double the slots of the bounds hash table //
+static void grow_interned(regstore_t *store)
+{
+  size_t slots = store->internslots ? 2 * store->internslots : REGSTORE_INTERN_INITIAL;
+  boundsdesc_t **table = (boundsdesc_t **)calloc(slots, sizeof(boundsdesc_t *));
+
+  if (table == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in insertion\n");
+      exit(1);
+    }
+
+  for (size_t i = 0; i < store->internslots; i++)
+    {
+      boundsdesc_t *desc = store->interned[i];
+
+      if (desc != NULL)
+        {
+          size_t slot = desc->hash & (slots - 1);
+
+          while (table[slot] != NULL)
+            {
+              slot = (slot + 1) & (slots - 1);
+            }
+          table[slot] = desc;
+        }
+    }
+
+  free(store->interned);
+  store->interned = table;
+  store->internslots = slots;
+}
+
+// ********** intern_bounds ********** //
+// get the descriptor of a bounds string, creating and //
+// compiling it the first time the string is seen; the  //
+// string is only copied then, into the arena           //
+static const boundsdesc_t *intern_bounds(regstore_t *store, slice_t bounds)
+{
+  unsigned int hash = hash_bounds(bounds);
+  boundsdesc_t *desc;
+  size_t slot;
+
+  // keep the table at most three quarters full //
+  if (4 * (store->numofinterned + 1) > 3 * store->internslots)
+    {
+      grow_interned(store);
+    }
+
+  for (slot = hash & (store->internslots - 1); store->interned[slot] != NULL; slot = (slot + 1) & (store->internslots - 1))
+    {
+      desc = store->interned[slot];
+      if (desc->hash == hash && strncmp(desc->bounds, bounds.ptr, bounds.len) == 0 && desc->bounds[bounds.len] == '\0')
+        {
+          return desc;
+        }
+    }
+
+  desc = (boundsdesc_t *)arena_alloc(&store->arena, sizeof(boundsdesc_t));
+  if (desc == NULL || (desc->bounds = arena_strndup(&store->arena, bounds.ptr, bounds.len)) == NULL
+      || bounds_compile(&desc->limits, bounds, &store->arena) != 0)
+    {
+      fprintf(stderr, "Memory allocation error in insertion\n");
+      exit(1);
+    }
+
+  desc->hash = hash;
+  desc->id = (unsigned int)store->numofinterned;
+  store->interned[slot] = desc;
+  store->numofinterned++;
+
+  return desc;
+}
+
+// ********** new_register ********** //
+// get the slot of a new register at the given 0-based //
+// position, adding a chunk if it is the first of one  //
+static registers_t *new_register(regstore_t *store, int index)
+{
+  if (store->chunks[index >> REGSTORE_CHUNK_BITS] == NULL)
+    {
+      store->chunks[index >> REGSTORE_CHUNK_BITS] = (registers_t *)malloc(REGSTORE_CHUNK_SIZE * sizeof(registers_t));
+
+      if (store->chunks[index >> REGSTORE_CHUNK_BITS] == NULL)
+        {
+          fprintf(stderr, "Memory allocation error in insertion\n");
+          exit(1);
+        }
+    }
+
+  return &store->chunks[index >> REGSTORE_CHUNK_BITS][index & (REGSTORE_CHUNK_SIZE - 1)];
+}
+
+// ********** regstore_init ********** //
+// create an empty register store //
+void regstore_init(regstore_t *store)
+{
+  memset(store->chunks, 0, sizeof(store->chunks));
+  for (int i = 0; i < REGSTORE_MAX_CHUNKS; i++)
+    {
+      atomic_init(&store->dirty[i], 0);
+    }
+  store->tracked = 0;
+  atomic_init(&store->count, 0);
+  pthread_mutex_init(&store->insert_lock, NULL);
+  arena_init(&store->arena);
+  store->interned = NULL;
+  store->numofinterned = 0;
+  store->internslots = 0;
+  memset(store->blocks, 0, sizeof(store->blocks));
+  atomic_init(&store->numofblocks, 0);
+}
+
+// ********** regstore_add ********** //
+// append a new register at the end of the table, adding a chunk //
+// when the last one is full; returns the new register index,    //
+// or -1 if the table is full                                    //
+int regstore_add(regstore_t *store, int value, slice_t bounds)
+{
+  registers_t *new;
+  int index;
+
+  pthread_mutex_lock(&store->insert_lock);
+
+  index = atomic_load_explicit(&store->count, memory_order_relaxed);
+  if (index == REGSTORE_MAX_CHUNKS * REGSTORE_CHUNK_SIZE)
+    {
+      pthread_mutex_unlock(&store->insert_lock);
+      return -1; // the table is full //
+    }
+
+  new = new_register(store, index);
+  atomic_init(&new->regvalue, value); // set new register value and bounds //
+  new->desc = intern_bounds(store, bounds);
+
+  // publish the register only once it is complete //
+  atomic_store_explicit(&store->count, index + 1, memory_order_release);
+
+  pthread_mutex_unlock(&store->insert_lock);
+
+  return index + 1;
+}
+
+// ********** regstore_add_many ********** //
+// append count registers in one pass, taking the lock and publishing //
+// the new count once; returns the index of the first new register,   //
+// or -1 if they do not all fit in the table                          //
+int regstore_add_many(regstore_t *store, int count, const int *values, const slice_t *bounds)
+{
+  int index;
+
+  pthread_mutex_lock(&store->insert_lock);
+
+  index = atomic_load_explicit(&store->count, memory_order_relaxed);
+  if (count > REGSTORE_MAX_CHUNKS * REGSTORE_CHUNK_SIZE - index)
+    {
+      pthread_mutex_unlock(&store->insert_lock);
+      return -1;
+    }
+
+  for (int i = 0; i < count; i++)
+    {
+      registers_t *new = new_register(store, index + i);
+
+      atomic_init(&new->regvalue, values[i]);
+      new->desc = intern_bounds(store, bounds[i]);
+    }
+
+  atomic_store_explicit(&store->count, index + count, memory_order_release);
+
+  pthread_mutex_unlock(&store->insert_lock);
+
+  return index + 1;
+}
+
+// ********** regstore_load ********** //
+// fill an empty store in one go, e.g. from a snapshot: register i //
+// gets values[i] and the bounds with id boundsids[i], where the    //
+// bounds are numbered in the order they are given; returns 0 on    //
+// success and -1 if the data is not consistent                     //
+int regstore_load(regstore_t *store, int count, const int32_t *values, const uint32_t *boundsids,
+                  char **bounds, unsigned int numofbounds)
+{
+  const boundsdesc_t **descs;
+  int result = 0;
+
+  if (count < 0 || count > REGSTORE_MAX_CHUNKS * REGSTORE_CHUNK_SIZE || regstore_count(store) != 0)
+    {
+      return -1;
+    }
+
+  descs = (const boundsdesc_t **)malloc((numofbounds + 1) * sizeof(boundsdesc_t *));
+  if (descs == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in insertion\n");
+      exit(1);
+    }
+
+  pthread_mutex_lock(&store->insert_lock);
+
+  // every bounds string is compiled once; the same string //
+  // twice would get one id for two, so it is refused      //
+  for (unsigned int i = 0; i < numofbounds && result == 0; i++)
+    {
+      descs[i] = intern_bounds(store, slice_of(bounds[i]));
+      result = descs[i]->id == i ? 0 : -1;
+    }
+
+  for (int i = 0; i < count && result == 0; i++)
+    {
+      registers_t *new;
+
+      if (boundsids[i] >= numofbounds)
+        {
+          result = -1;
+          break;
+        }
+
+      new = new_register(store, i);
+      atomic_init(&new->regvalue, values[i]);
+      new->desc = descs[boundsids[i]];
+    }
+
+  if (result == 0)
+    {
+      atomic_store_explicit(&store->count, count, memory_order_release);
+    }
+
+  pthread_mutex_unlock(&store->insert_lock);
+  free(descs);
+
+  return result;
+}
+
+// ********** regstore_count ********** //
+// get the number of registers in the table //
+int regstore_count(regstore_t *store)
+{
+  return atomic_load_explicit(&store->count, memory_order_acquire);
+}
+
+// ********** regstore_find ********** //
+// get the register with the given index, or NULL //
+// if the register does not exist in the table    //
+registers_t *regstore_find(regstore_t *store, int index)
+{
+  if (index < 1 || index > regstore_count(store))
+    {
+      return NULL;
+    }
+
+  index--;
+  return &store->chunks[index >> REGSTORE_CHUNK_BITS][index & (REGSTORE_CHUNK_SIZE - 1)];
+}
+
+// ********** add_block ********** //
+// add a block of existing registers to the directory; the caller //
+// holds the insert lock; returns the block id, or -1 if the      //
+// directory is full                                              //
+static int add_block(regstore_t *store, int first, int count, const boundsdesc_t *desc)
+{
+  int id = atomic_load_explicit(&store->numofblocks, memory_order_relaxed);
+  regblock_t *block;
+
+  if (id == REGSTORE_MAX_BLOCKS)
+    {
+      return -1;
+    }
+
+  block = (regblock_t *)arena_alloc(&store->arena, sizeof(regblock_t));
+  if (block == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in insertion\n");
+      exit(1);
+    }
+
+  block->first = first;
+  block->count = count;
+  block->desc = desc;
+  atomic_init(&block->seq, 0);
+  store->blocks[id] = block;
+
+  // publish the block only once it is complete //
+  atomic_store_explicit(&store->numofblocks, id + 1, memory_order_release);
+
+  return id + 1;
+}
+
+// ********** regstore_add_block ********** //
+// append a block of count registers with the same value and //
+// bounds; returns the block id, or -1 if the block is too   //
+// large, or it or its registers do not fit in the table      //
+int regstore_add_block(regstore_t *store, int count, int value, slice_t bounds)
+{
+  const boundsdesc_t *desc;
+  int index, id;
+
+  if (count < 1 || count > REGSTORE_BLOCK_MAX)
+    {
+      return -1;
+    }
+
+  pthread_mutex_lock(&store->insert_lock);
+
+  index = atomic_load_explicit(&store->count, memory_order_relaxed);
+  if (count > REGSTORE_MAX_CHUNKS * REGSTORE_CHUNK_SIZE - index
+      || atomic_load_explicit(&store->numofblocks, memory_order_relaxed) == REGSTORE_MAX_BLOCKS)
+    {
+      pthread_mutex_unlock(&store->insert_lock);
+      return -1;
+    }
+
+  desc = intern_bounds(store, bounds);
+  for (int i = 0; i < count; i++)
+    {
+      registers_t *new = new_register(store, index + i);
+
+      atomic_init(&new->regvalue, value);
+      new->desc = desc;
+    }
+
+  atomic_store_explicit(&store->count, index + count, memory_order_release);
+  id = add_block(store, index + 1, count, desc);
+
+  pthread_mutex_unlock(&store->insert_lock);
+
+  return id;
+}
+
+// ********** regstore_define_block ********** //
+// make a block of count registers from first on, which exist //
+// and share their bounds, after the last block, e.g. from a  //
+// snapshot; returns the block id, or -1 if they do not       //
+int regstore_define_block(regstore_t *store, int first, int count)
+{
+  regblock_t *last = NULL;
+  registers_t *reg;
+  int id = -1, blocks;
+
+  pthread_mutex_lock(&store->insert_lock);
+
+  blocks = atomic_load_explicit(&store->numofblocks, memory_order_relaxed);
+  last = blocks > 0 ? store->blocks[blocks - 1] : NULL;
+  if (count >= 1 && count <= REGSTORE_BLOCK_MAX && first >= 1
+      && first <= atomic_load_explicit(&store->count, memory_order_relaxed) - count + 1
+      && (last == NULL || first >= last->first + last->count))
+    {
+      reg = regstore_find(store, first);
+      id = 0;
+      for (int i = 1; i < count && id == 0; i++)
+        {
+          id = regstore_find(store, first + i)->desc == reg->desc ? 0 : -1;
+        }
+
+      id = id == 0 ? add_block(store, first, count, reg->desc) : -1;
+    }
+
+  pthread_mutex_unlock(&store->insert_lock);
+
+  return id;
+}
+
+// ********** regstore_block_count ********** //
+// get the number of blocks in the table //
+int regstore_block_count(regstore_t *store)
+{
+  return atomic_load_explicit(&store->numofblocks, memory_order_acquire);
+}
+
+// ********** regstore_find_block ********** //
+// get the block with the given id, or NULL if //
+// the block does not exist in the table       //
+regblock_t *regstore_find_block(regstore_t *store, int id)
+{
+  if (id < 1 || id > regstore_block_count(store))
+    {
+      return NULL;
+    }
+
+  return store->blocks[id - 1];
+}
+
+// ********** regstore_block_read ********** //
+// copy the values of a block, all of them from the same block //
+// write: the copy is retried if a write went on meanwhile     //
+void regstore_block_read(regstore_t *store, regblock_t *block, int *values)
+{
+  unsigned int before, after;
+
+  do
+    {
+      while ((before = atomic_load_explicit(&block->seq, memory_order_acquire)) & 1)
+        {
+          continue; // a write is storing the values //
+        }
+
+      // one lookup per chunk, the registers of a chunk are next to each other //
+      for (int i = 0; i < block->count; )
+        {
+          registers_t *reg = regstore_find(store, block->first + i);
+          int left = REGSTORE_CHUNK_SIZE - ((block->first + i - 1) & (REGSTORE_CHUNK_SIZE - 1));
+
+          for (; left > 0 && i < block->count; left--, i++, reg++)
+            {
+              values[i] = register_get(reg);
+            }
+        }
+
+      atomic_thread_fence(memory_order_acquire);
+      after = atomic_load_explicit(&block->seq, memory_order_relaxed);
+    }
+  while (before != after);
+}
+
+// ********** regstore_block_write ********** //
+// write all the values of a block, if the bounds allow every one //
+// of them; the block writes wait for each other; returns 0 on    //
+// success and -1 if a value is out of the bounds                 //
+int regstore_block_write(regstore_t *store, regblock_t *block, const int *values)
+{
+  unsigned int seq;
+
+  if (bounds_check_all(&block->desc->limits, values, block->count) != 0)
+    {
+      return -1;
+    }
+
+  // take the seqlock, from even to odd //
+  for (;;)
+    {
+      seq = atomic_load_explicit(&block->seq, memory_order_relaxed);
+      if (!(seq & 1) && atomic_compare_exchange_weak_explicit(&block->seq, &seq, seq + 1, memory_order_acquire,
+                                                              memory_order_relaxed))
+        {
+          break;
+        }
+    }
+  atomic_thread_fence(memory_order_release);
+
+  for (int i = 0; i < block->count; )
+    {
+      int index = block->first + i; // the first register of the block in this chunk //
+      registers_t *reg = regstore_find(store, index);
+      int left = REGSTORE_CHUNK_SIZE - ((index - 1) & (REGSTORE_CHUNK_SIZE - 1));
+
+      for (; left > 0 && i < block->count; left--, i++, reg++)
+        {
+          register_set(reg, values[i]);
+        }
+      regstore_touch(store, index); // for the snapshot, once the values are stored //
+    }
+
+  atomic_store_explicit(&block->seq, seq + 2, memory_order_release);
+
+  return 0;
+}
+
+// ********** regstore_usage ********** //
+// report the memory held by the table: the bytes of the chunks and //
+// the bounds hash table, the number of distinct bounds, and the    //
+// bytes used and reserved for the bounds in the arena              //
+void regstore_usage(regstore_t *store, size_t *table, size_t *descriptors, size_t *used, size_t *reserved)
+{
+  pthread_mutex_lock(&store->insert_lock);
+
+  *table = sizeof(store->chunks) + store->internslots * sizeof(boundsdesc_t *);
+  for (int i = 0; i < REGSTORE_MAX_CHUNKS && store->chunks[i] != NULL; i++)
+    {
+      *table += REGSTORE_CHUNK_SIZE * sizeof(registers_t);
+    }
+
+  *descriptors = store->numofinterned;
+  *used = store->arena.used;
+  *reserved = store->arena.reserved;
+
+  pthread_mutex_unlock(&store->insert_lock);
+}
+
+// ********** regstore_clear ********** //
+// free the table and all the registers in it; the bounds //
+// go all at once, together with the arena                //
+void regstore_clear(regstore_t *store)
+{
+  arena_free(&store->arena);
+  free(store->interned);
+  store->interned = NULL;
+  store->numofinterned = 0;
+  store->internslots = 0;
+
+  for (int i = 0; i < REGSTORE_MAX_CHUNKS && store->chunks[i] != NULL; i++)
+    {
+      free(store->chunks[i]);
+      store->chunks[i] = NULL;
+    }
+
+  memset(store->blocks, 0, sizeof(store->blocks)); // they were in the arena //
+  atomic_store(&store->numofblocks, 0);
+  atomic_store(&store->count, 0);
+  pthread_mutex_destroy(&store->insert_lock);
+}
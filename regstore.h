@@ -0,0 +1,133 @@
+// Header file for the register store of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+#ifndef __REGISTER_STORE_H_
+#define __REGISTER_STORE_H_
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include "bounds.h"
+#include "arena.h"
+
+// Preprocessor //
+#define REGSTORE_CHUNK_BITS 12 // every chunk of the table holds 4096 registers //
+#define REGSTORE_CHUNK_SIZE (1 << REGSTORE_CHUNK_BITS)
+#define REGSTORE_MAX_CHUNKS 16384 // so a table holds up to 64M registers //
+#define REGSTORE_INTERN_INITIAL 64 // the initial number of slots of the bounds hash table, a power of two //
+#define REGSTORE_MAX_BLOCKS 4096 // the most register blocks of a table //
+#define REGSTORE_BLOCK_MAX 4096 // the most registers of a block, so all its values fit in one reply //
+
+// Structs //
+// Bounds Descriptor Struct //
+// The bounds of a register, both as the original string and in compiled  //
+// form. Registers with identical bounds strings share one descriptor, so //
+// a million registers with the same bounds hold a single copy of them    //
+struct boundsdescriptor{
+	char *bounds; // number bounds, as string //
+	bounds_t limits; // the bounds compiled once, used to check writes //
+	unsigned int hash; // hash of the bounds string //
+	unsigned int id; // the descriptors are numbered from 0 in the order they were created //
+};
+
+typedef struct boundsdescriptor boundsdesc_t;
+
+// Register Struct //
+// The structure of a register the server processes. It contains the register //
+// value and the descriptor of its bounds. The register id is not stored,   //
+// since it is the position of the register in the table, i.e. REG1 is the  //
+// first entry of chunk 0. The bounds never change after insertion; the     //
+// value is atomic, so it may be read and written from several threads     //
+struct registerentry{
+	atomic_int regvalue; // register value //
+	const boundsdesc_t *desc; // the bounds of the register //
+};
+
+// define it as "register_t" for simplicity //
+typedef struct registerentry registers_t;
+
+// Register Block Struct //
+// A run of registers declared together, e.g. the channels of an ADC, //
+// read and written as a whole. They are ordinary registers of the   //
+// table, so each may still be used on its own, but their bounds are //
+// one descriptor, checked once for a whole write. Block writes bump  //
+// seq to odd and back to even around the stores, so a block read     //
+// that sees the same even seq before and after got all of one write  //
+struct registerblock{
+	int first; // the index of the first register //
+	int count; // the number of registers //
+	const boundsdesc_t *desc; // the bounds of all the registers //
+	atomic_uint seq; // the seqlock of the block writes //
+};
+
+typedef struct registerblock regblock_t;
+
+// Register Store Struct (chunked table) //
+// The registers live in fixed size chunks reached through a directory, so  //
+// growing the table only adds chunks and never moves a register. Readers   //
+// take no lock: a register is visible once the count covers it, and the    //
+// count is published after the register is complete. Insertions are        //
+// serialised by a mutex. The bounds descriptors are interned in a hash    //
+// table and kept in an arena, and are all freed together                  //
+struct registerstore{
+	registers_t *chunks[REGSTORE_MAX_CHUNKS]; // the chunk directory //
+	atomic_uchar dirty[REGSTORE_MAX_CHUNKS]; // set when a value of the chunk changes, see snapshot.h //
+	int tracked; // set once a snapshot follows the table, before any write; only then is dirty kept //
+	atomic_int count; // the total number of registers //
+	pthread_mutex_t insert_lock; // taken by the insertions, and to look at the arena //
+	arena_t arena; // the bounds descriptors //
+	boundsdesc_t **interned; // open addressing hash table of the bounds descriptors //
+	size_t numofinterned; // the number of bounds descriptors //
+	size_t internslots; // the number of slots of the hash table //
+	regblock_t *blocks[REGSTORE_MAX_BLOCKS]; // the blocks, in the arena; BLKn is blocks[n - 1] //
+	atomic_int numofblocks; // published once the block is complete, like count //
+};
+
+typedef struct registerstore regstore_t;
+
+// ********** register_get ********** //
+// read the value of a register //
+static inline int register_get(registers_t *reg)
+{
+  return atomic_load_explicit(&reg->regvalue, memory_order_relaxed);
+}
+
+// ********** register_set ********** //
+// change the value of a register //
+static inline void register_set(registers_t *reg, int value)
+{
+  atomic_store_explicit(&reg->regvalue, value, memory_order_relaxed);
+}
+
+// ********** regstore_touch ********** //
+// mark the chunk of a register as changed, after its value is   //
+// stored, if a snapshot follows the table. The release RMW keeps //
+// the store of the value before the flag is set, and pairs with  //
+// the acquire exchange of the snapshot clearing it: that either  //
+// sees the value, or the flag is set again for the next snapshot //
+static inline void regstore_touch(regstore_t *store, int index)
+{
+  if (store->tracked)
+    {
+      atomic_fetch_or_explicit(&store->dirty[(index - 1) >> REGSTORE_CHUNK_BITS], 1, memory_order_release);
+    }
+}
+
+// Function Prototypes //
+void regstore_init(regstore_t *store);
+int regstore_add(regstore_t *store, int value, slice_t bounds);
+int regstore_add_many(regstore_t *store, int count, const int *values, const slice_t *bounds);
+int regstore_load(regstore_t *store, int count, const int32_t *values, const uint32_t *boundsids,
+                  char **bounds, unsigned int numofbounds);
+int regstore_count(regstore_t *store);
+registers_t *regstore_find(regstore_t *store, int index);
+int regstore_add_block(regstore_t *store, int count, int value, slice_t bounds);
+int regstore_define_block(regstore_t *store, int first, int count);
+int regstore_block_count(regstore_t *store);
+regblock_t *regstore_find_block(regstore_t *store, int id);
+void regstore_block_read(regstore_t *store, regblock_t *block, int *values);
+int regstore_block_write(regstore_t *store, regblock_t *block, const int *values);
+void regstore_usage(regstore_t *store, size_t *table, size_t *descriptors, size_t *used, size_t *reserved);
+void regstore_clear(regstore_t *store);
+
+#endif
@@ -0,0 +1,199 @@
+// Vectorized scanning of requests and bounds //
+// Author: Vangelis Bakas //
+// Last Edited: 2/2/2023 //
+
+#include "scan.h"
+#include <string.h>
+
+#if defined(SCAN_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_SSE2 1
+#elif defined(SCAN_SIMD) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCAN_NEON 1
+#endif
+
+#ifdef SCAN_NEON
+// ********** neon_mask ********** //
+// the 0x00/0xff bytes of a comparison as a 64-bit mask, //
+// four bits per byte, as NEON has no movemask           //
+static inline uint64_t neon_mask(uint8x16_t matches)
+{
+  return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+}
+#endif
+
+// ********** scan_count ********** //
+// count the bytes of a string equal to c //
+size_t scan_count(const char *string, size_t length, char c)
+{
+  size_t count = 0, i = 0;
+
+#if defined(SCAN_SSE2)
+  __m128i needle = _mm_set1_epi8(c);
+
+  for (; i + 16 <= length; i += 16)
+    {
+      __m128i block = _mm_loadu_si128((const __m128i *)(string + i));
+
+      count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    }
+#elif defined(SCAN_NEON)
+  uint8x16_t needle = vdupq_n_u8((uint8_t)c), one = vdupq_n_u8(1);
+
+  for (; i + 16 <= length; i += 16)
+    {
+      uint8x16_t block = vld1q_u8((const uint8_t *)(string + i));
+
+      count += vaddvq_u8(vandq_u8(vceqq_u8(block, needle), one));
+    }
+#endif
+
+  for (; i < length; i++)
+    {
+      count += (string[i] == c);
+    }
+
+  return count;
+}
+
+// ********** scan_find2 ********** //
+// find the first byte of a string equal to a or b; //
+// returns a pointer to it, or NULL if there is none //
+const char *scan_find2(const char *string, size_t length, char a, char b)
+{
+  size_t i = 0;
+
+#if defined(SCAN_SSE2)
+  __m128i first = _mm_set1_epi8(a), second = _mm_set1_epi8(b);
+
+  for (; i + 16 <= length; i += 16)
+    {
+      __m128i block = _mm_loadu_si128((const __m128i *)(string + i));
+      int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, first), _mm_cmpeq_epi8(block, second)));
+
+      if (mask != 0)
+        {
+          return string + i + __builtin_ctz(mask);
+        }
+    }
+#elif defined(SCAN_NEON)
+  uint8x16_t first = vdupq_n_u8((uint8_t)a), second = vdupq_n_u8((uint8_t)b);
+
+  for (; i + 16 <= length; i += 16)
+    {
+      uint8x16_t block = vld1q_u8((const uint8_t *)(string + i));
+      uint64_t mask = neon_mask(vorrq_u8(vceqq_u8(block, first), vceqq_u8(block, second)));
+
+      if (mask != 0)
+        {
+          return string + i + __builtin_ctzll(mask) / 4;
+        }
+    }
+#endif
+
+  for (; i < length; i++)
+    {
+      if (string[i] == a || string[i] == b)
+        {
+          return string + i;
+        }
+    }
+
+  return NULL;
+}
+
+// ********** scan_contains ********** //
+// check if an array of values holds the target, four //
+// values at a time; returns 1 if it does, 0 if not   //
+int scan_contains(const int *values, size_t count, int target)
+{
+  size_t i = 0;
+
+#if defined(SCAN_SSE2)
+  __m128i needle = _mm_set1_epi32(target);
+
+  for (; i + 4 <= count; i += 4)
+    {
+      __m128i block = _mm_loadu_si128((const __m128i *)(values + i));
+
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(block, needle)) != 0)
+        {
+          return 1;
+        }
+    }
+#elif defined(SCAN_NEON)
+  int32x4_t needle = vdupq_n_s32(target);
+
+  for (; i + 4 <= count; i += 4)
+    {
+      if (vmaxvq_u32(vceqq_s32(vld1q_s32(values + i), needle)) != 0)
+        {
+          return 1;
+        }
+    }
+#endif
+
+  for (; i < count; i++)
+    {
+      if (values[i] == target)
+        {
+          return 1;
+        }
+    }
+
+  return 0;
+}
+
+// ********** scan_digits8 ********** //
+// convert 8 decimal digits in one go, within a 64-bit word; //
+// returns 1 with the value, or 0 if they are not all digits //
+int scan_digits8(const char *digits, uint32_t *value)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64_t word;
+
+  memcpy(&word, digits, sizeof(word));
+
+  // every byte is '0' to '9' if its high nibble is 3 and adding 6 keeps it so //
+  if ((word & 0xf0f0f0f0f0f0f0f0ULL) != 0x3030303030303030ULL
+      || ((word + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) != 0x3030303030303030ULL)
+    {
+      return 0;
+    }
+
+  // combine the digits in pairs, then the pairs, then the fours //
+  word = (word & 0x0f0f0f0f0f0f0f0fULL) * 2561 >> 8;
+  word = (word & 0x00ff00ff00ff00ffULL) * 6553601 >> 16;
+  *value = (uint32_t)((word & 0x0000ffff0000ffffULL) * 42949672960001ULL >> 32);
+
+  return 1;
+#else
+  uint32_t result = 0;
+
+  for (int i = 0; i < 8; i++)
+    {
+      if (digits[i] < '0' || digits[i] > '9')
+        {
+          return 0;
+        }
+      result = result * 10 + (digits[i] - '0');
+    }
+
+  *value = result;
+  return 1;
+#endif
+}
+
+// ********** scan_implementation ********** //
+// the name of the scanning loops built in, for the logs //
+const char *scan_implementation(void)
+{
+#if defined(SCAN_SSE2)
+  return "SSE2";
+#elif defined(SCAN_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
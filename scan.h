@@ -0,0 +1,28 @@
+// Header file for the vectorized scanning of requests and bounds //
+// Author: Vangelis Bakas //
+// Last Edited: 2/2/2023 //
+
+/* The loops that look at every byte of a request, or at every value of a
+distinct bounds list, are done here 16 bytes at a time with SSE2 on x86-64
+or NEON on AArch64, both of which every such CPU has, so no check is needed
+at runtime. A build with -DSCAN_SIMD=OFF, or for any other CPU, uses the
+scalar loops, which give the same results.
+
+Decimal numbers are converted 8 digits at a time within a 64-bit word,
+which needs no vector unit at all.
+*/
+
+#ifndef __SCAN_H_
+#define __SCAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Function Prototypes //
+size_t scan_count(const char *string, size_t length, char c);
+const char *scan_find2(const char *string, size_t length, char a, char b);
+int scan_contains(const int *values, size_t count, int target);
+int scan_digits8(const char *digits, uint32_t *value);
+const char *scan_implementation(void);
+
+#endif
@@ -0,0 +1,864 @@
+// Asynchronous client library of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 2/2/2023 //
+
+#include "serialcomm.h"
+#include "binproto.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// ********** encode_binary ********** //
+// translate a text request into a binary frame with the given //
+// sequence tag; returns the frame length, or 0 if the request //
+// has no binary form, e.g. a batch                            //
+static size_t encode_binary(const char *request, unsigned int seq, uint8_t *frame)
+{
+  binmsg_t msg;
+  slice_t regid; // the "REGn" part of an AT-command //
+  const char *value = NULL, *bounds = NULL;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.seq = seq;
+
+  if (strcmp(request, "quit") == 0)
+    {
+      msg.opcode = BIN_QUIT;
+      return bin_encode_request(frame, &msg);
+    }
+
+  if (strncmp(request, "insert+", 7) == 0)
+    {
+      // insert+<value>+<bounds> //
+      bounds = strchr(request + 7, '+');
+      if (bounds == NULL)
+        {
+          return 0;
+        }
+
+      msg.opcode = BIN_INSERT;
+      msg.value = atoi(request + 7);
+      msg.bounds = bounds + 1;
+      msg.boundslen = strlen(bounds + 1);
+      return bin_encode_request(frame, &msg);
+    }
+
+  if (strncmp(request, "AT+REG", 6) != 0 || strpbrk(request, ";.") != NULL)
+    {
+      return 0;
+    }
+
+  // a register id that does not parse is sent as index 0, which is //
+  // never in the table, so the server answers INVALID REGISTER      //
+  value = strchr(request, '=');
+  regid.ptr = request + 3;
+  regid.len = value != NULL ? (size_t)(value - regid.ptr) : strlen(regid.ptr);
+  msg.index = slice_regid(regid) == -1 ? 0 : slice_regid(regid);
+  if (value == NULL || value[1] == '\0')
+    {
+      msg.opcode = BIN_READ;
+    }
+  else if (strcmp(value, "=?") == 0)
+    {
+      msg.opcode = BIN_BOUNDS;
+    }
+  else
+    {
+      msg.opcode = BIN_WRITE;
+      msg.value = atoi(value + 1);
+    }
+
+  return bin_encode_request(frame, &msg);
+}
+
+// ********** format_binary ********** //
+// translate a binary response into the text the server would have //
+// sent in FRAME_LINE mode, including the sequence tag if it has one //
+static void format_binary(const binmsg_t *msg, char *text, size_t size)
+{
+  char tag[16] = "";
+  int length = 0;
+
+  if (msg->seq != 0)
+    {
+      sprintf(tag, "#%u ", msg->seq);
+    }
+
+  if (msg->status == BIN_INVALID_REGISTER)
+    {
+      snprintf(text, size, "%sINVALID REGISTER", tag);
+      return;
+    }
+  else if (msg->status == BIN_INVALID_INPUT)
+    {
+      snprintf(text, size, "%sInvalidInput", tag);
+      return;
+    }
+  else if (msg->status != BIN_OK)
+    {
+      snprintf(text, size, "%sINVALID AT-COMMAND", tag);
+      return;
+    }
+
+  switch (msg->opcode)
+    {
+    case BIN_READ:
+      snprintf(text, size, "%s%d", tag, msg->value);
+      break;
+
+    case BIN_BOUNDS:
+      length = msg->boundslen < size ? (int)msg->boundslen : (int)size - 1;
+      snprintf(text, size, "%s%.*s", tag, length, msg->bounds);
+      break;
+
+    case BIN_INSERT:
+      snprintf(text, size, "%sINSERTION COMPLETE", tag);
+      break;
+
+    case BIN_QUIT:
+      snprintf(text, size, "%sTERMINATING", tag);
+      break;
+
+    case BIN_NOTIFY:
+      snprintf(text, size, "!REG%u=%d", msg->index, msg->value);
+      break;
+
+    default:
+      snprintf(text, size, "%sOK", tag);
+      break;
+    }
+}
+
+
+// ********** watch ********** //
+// add a descriptor to an epoll set, to be watched for reading //
+static int watch(int events, int fd)
+{
+  struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+
+  return epoll_ctl(events, EPOLL_CTL_ADD, fd, &event);
+}
+
+// ********** serialcomm_open ********** //
+// set up a client on a serial port that is already open and set up, //
+// see set_interface_attributes; the port is made non-blocking, and  //
+// the requests are sent in the given framing mode until AT+BIN is   //
+// accepted; returns 0 on success and -1 on failure                  //
+int serialcomm_open(serialcomm_t *client, int port, int frame_mode)
+{
+  memset(client, 0, sizeof(*client));
+  client->port = port;
+  client->frame_mode = frame_mode;
+  client->depth = SERIALCOMM_DEFAULT_DEPTH;
+  client->timeout = SERIALCOMM_DEFAULT_TIMEOUT;
+  client->nextseq = 1;
+  frame_reader_init(&client->reader, frame_mode);
+  outbuf_init(&client->out);
+
+  client->portflags = fcntl(port, F_GETFL);
+  if (client->portflags == -1 || fcntl(port, F_SETFL, client->portflags | O_NONBLOCK) == -1)
+    {
+      perror("fcntl");
+      return -1;
+    }
+
+  // the port and the submissions wake the event loop up through one descriptor //
+  client->events = epoll_create1(EPOLL_CLOEXEC);
+  client->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (client->events < 0 || client->wakeup < 0 || watch(client->events, port) != 0
+      || watch(client->events, client->wakeup) != 0)
+    {
+      perror("serialcomm_open");
+      if (client->events >= 0)
+        {
+          close(client->events);
+        }
+      if (client->wakeup >= 0)
+        {
+          close(client->wakeup);
+        }
+      fcntl(port, F_SETFL, client->portflags);
+      return -1;
+    }
+
+  pthread_mutex_init(&client->lock, NULL);
+  return 0;
+}
+
+// ********** serialcomm_set_depth ********** //
+// keep up to depth requests in flight, 1 to SERIALCOMM_MAX_DEPTH; //
+// above 1 they are tagged, which needs FRAME_LINE or binary mode; //
+// to be set before the first request                              //
+void serialcomm_set_depth(serialcomm_t *client, int depth)
+{
+  client->depth = depth < 1 ? 1 : depth > SERIALCOMM_MAX_DEPTH ? SERIALCOMM_MAX_DEPTH : depth;
+}
+
+// ********** serialcomm_set_timeout ********** //
+// give up on the requests in flight once no response has //
+// arrived for timeout milliseconds                       //
+void serialcomm_set_timeout(serialcomm_t *client, int timeout)
+{
+  client->timeout = timeout;
+}
+
+// ********** serialcomm_set_notify ********** //
+// call notify with arg for every notification and late response //
+void serialcomm_set_notify(serialcomm_t *client, serialcomm_notify_t notify, void *arg)
+{
+  client->notify = notify;
+  client->notifyarg = arg;
+}
+
+// ********** submit_parts ********** //
+// queue the request made of prefix and rest for sending; the //
+// sending thread is woken up if the queue was empty; returns //
+// 0 on success and -1 on memory allocation failure           //
+static int submit_parts(serialcomm_t *client, const char *prefix, const char *rest, serialcomm_callback_t callback, void *arg)
+{
+  size_t prefixlen = strlen(prefix), restlen = strlen(rest);
+  screquest_t *request = (screquest_t *)malloc(sizeof(screquest_t) + prefixlen + restlen + 1);
+  uint64_t signal = 1;
+  int wasempty;
+
+  if (request == NULL)
+    {
+      return -1;
+    }
+
+  request->next = NULL;
+  request->callback = callback;
+  request->arg = arg;
+  request->seq = 0;
+  request->request = (char *)(request + 1);
+  memcpy(request->request, prefix, prefixlen);
+  memcpy(request->request + prefixlen, rest, restlen + 1);
+
+  pthread_mutex_lock(&client->lock);
+  wasempty = client->queued == NULL;
+  if (wasempty)
+    {
+      client->queued = request;
+    }
+  else
+    {
+      client->lastqueued->next = request;
+    }
+  client->lastqueued = request;
+  client->numofqueued++;
+  pthread_mutex_unlock(&client->lock);
+
+  // a queue that was not empty is sent on as the responses arrive //
+  if (wasempty && write(client->wakeup, &signal, sizeof(signal)) == -1 && errno != EAGAIN)
+    {
+      perror("eventfd");
+    }
+
+  return 0;
+}
+
+// ********** serialcomm_submit ********** //
+// queue any request, e.g. "AT+REG1..REG4" or "bulkinsert+..."; //
+// callback is called with arg once it is complete; returns 0   //
+// on success and -1 on memory allocation failure               //
+int serialcomm_submit(serialcomm_t *client, const char *request, serialcomm_callback_t callback, void *arg)
+{
+  return submit_parts(client, request, "", callback, arg);
+}
+
+// ********** serialcomm_read ********** //
+// queue a read of the value of register id, "AT+REGn" //
+int serialcomm_read(serialcomm_t *client, int id, serialcomm_callback_t callback, void *arg)
+{
+  char request[32];
+
+  snprintf(request, sizeof(request), "AT+REG%d", id);
+  return submit_parts(client, request, "", callback, arg);
+}
+
+// ********** serialcomm_bounds ********** //
+// queue a read of the bounds of register id, "AT+REGn=?" //
+int serialcomm_bounds(serialcomm_t *client, int id, serialcomm_callback_t callback, void *arg)
+{
+  char request[32];
+
+  snprintf(request, sizeof(request), "AT+REG%d=?", id);
+  return submit_parts(client, request, "", callback, arg);
+}
+
+// ********** serialcomm_write ********** //
+// queue a write of value to register id, "AT+REGn=<int>" //
+int serialcomm_write(serialcomm_t *client, int id, int value, serialcomm_callback_t callback, void *arg)
+{
+  char request[48];
+
+  snprintf(request, sizeof(request), "AT+REG%d=%d", id, value);
+  return submit_parts(client, request, "", callback, arg);
+}
+
+// ********** serialcomm_insert ********** //
+// queue an insertion of a register, "insert+<value>+<bounds>" //
+int serialcomm_insert(serialcomm_t *client, int value, const char *bounds, serialcomm_callback_t callback, void *arg)
+{
+  char prefix[32];
+
+  snprintf(prefix, sizeof(prefix), "insert+%d+", value);
+  return submit_parts(client, prefix, bounds, callback, arg);
+}
+
+// ********** serialcomm_pending ********** //
+// the number of requests queued or in flight //
+int serialcomm_pending(serialcomm_t *client)
+{
+  int pending;
+
+  pthread_mutex_lock(&client->lock);
+  pending = client->numofqueued + client->numofinflight;
+  pthread_mutex_unlock(&client->lock);
+
+  return pending;
+}
+
+// ********** serialcomm_fd ********** //
+// the descriptor to watch for reading; once it is readable //
+// serialcomm_process has something to do                   //
+int serialcomm_fd(const serialcomm_t *client)
+{
+  return client->events;
+}
+
+// ********** serialcomm_timeout ********** //
+// milliseconds until serialcomm_process must give up on the //
+// requests in flight, or -1 if there are none               //
+int serialcomm_timeout(const serialcomm_t *client)
+{
+  long long remaining;
+
+  if (client->inflight == NULL && client->late == 0)
+    {
+      return -1;
+    }
+
+  remaining = client->deadline - monotonic_ms();
+  return remaining > 0 ? (int)remaining : 0;
+}
+
+// ********** complete ********** //
+// hand a request its result and free it; the framing //
+// switches to binary once AT+BIN has been accepted   //
+static void complete(serialcomm_t *client, screquest_t *request, int status, const char *response)
+{
+  if (status == SERIALCOMM_OK && !client->binary && strcmp(request->request, "AT+BIN") == 0
+      && strncmp(response, "OK", 2) == 0)
+    {
+      client->binary = 1;
+      client->reader.mode = FRAME_BINARY;
+    }
+
+  if (request->callback != NULL)
+    {
+      request->callback(request->arg, status, response);
+    }
+
+  free(request);
+}
+
+// ********** take_inflight ********** //
+// take a request out of the requests in flight; previous is //
+// the one before it, NULL if it is the oldest               //
+static void take_inflight(serialcomm_t *client, screquest_t *previous, screquest_t *request)
+{
+  if (previous == NULL)
+    {
+      client->inflight = request->next;
+    }
+  else
+    {
+      previous->next = request->next;
+    }
+
+  if (client->lastinflight == request)
+    {
+      client->lastinflight = previous;
+    }
+
+  pthread_mutex_lock(&client->lock);
+  client->numofinflight--;
+  pthread_mutex_unlock(&client->lock);
+}
+
+// ********** give_up ********** //
+// complete all the requests in flight with the given status, //
+// and the queued ones as well if the port has failed          //
+static void give_up(serialcomm_t *client, int status)
+{
+  screquest_t *request = NULL;
+
+  while ((request = client->inflight) != NULL)
+    {
+      take_inflight(client, NULL, request);
+      client->late += status == SERIALCOMM_TIMEDOUT && request->seq == 0;
+      complete(client, request, status, NULL);
+    }
+
+  // the late responses are waited for as long as for a request //
+  if (client->late > 0)
+    {
+      client->deadline = monotonic_ms() + client->timeout;
+    }
+
+  while (client->broken || status == SERIALCOMM_CLOSED)
+    {
+      pthread_mutex_lock(&client->lock);
+      if ((request = client->queued) != NULL)
+        {
+          client->queued = request->next;
+          client->numofqueued--;
+        }
+      pthread_mutex_unlock(&client->lock);
+
+      if (request == NULL)
+        {
+          break;
+        }
+      complete(client, request, status, NULL);
+    }
+}
+
+// ********** dispatch ********** //
+// hand a response in its text form to its request: a tagged  //
+// one by its sequence tag, an untagged one to the oldest     //
+// request in flight, unless it is the late response of one   //
+// given up on; the rest go to the notify callback            //
+static void dispatch(serialcomm_t *client, char *response)
+{
+  screquest_t *request = NULL, *previous = NULL;
+  unsigned long seq;
+  char *end = NULL;
+
+  if (response[0] != '!')
+    {
+      client->deadline = monotonic_ms() + client->timeout; // the server is still answering //
+
+      if (response[0] == '#')
+        {
+          seq = strtoul(response + 1, &end, 10);
+          if (*end == ' ')
+            {
+              end++;
+            }
+          for (request = client->inflight; request != NULL && request->seq != seq; request = request->next)
+            {
+              previous = request;
+            }
+          response = request != NULL ? end : response;
+        }
+      else if (client->late > 0)
+        {
+          client->late--; // the response of a request given up on //
+        }
+      else if (client->inflight != NULL && client->inflight->seq == 0)
+        {
+          request = client->inflight;
+        }
+    }
+
+  if (request != NULL)
+    {
+      take_inflight(client, previous, request);
+      complete(client, request, SERIALCOMM_OK, response);
+    }
+  else if (client->notify != NULL)
+    {
+      client->notify(client->notifyarg, response);
+    }
+}
+
+// ********** receive ********** //
+// read what the port has and dispatch the complete responses; //
+// binary responses are dispatched as their text equivalent    //
+static void receive(serialcomm_t *client)
+{
+  const uint8_t *body = NULL;
+  char *response = NULL;
+  size_t length;
+  binmsg_t msg;
+
+  if (frame_fill(&client->reader, client->port) == -1)
+    {
+      client->broken = 1;
+      return;
+    }
+
+  while (1)
+    {
+      if (!client->binary && (response = frame_next(&client->reader)) != NULL)
+        {
+          dispatch(client, response);
+        }
+      else if (client->binary && (body = bin_next_frame(&client->reader, &length)) != NULL)
+        {
+          if (bin_decode_response(body, length, &msg) == 0)
+            {
+              format_binary(&msg, client->text, sizeof(client->text));
+              dispatch(client, client->text);
+            }
+        }
+      else
+        {
+          break;
+        }
+    }
+}
+
+// ********** encode_request ********** //
+// add a request to the output buffer in the current framing; //
+// returns 0 on success, 1 if the request has no binary form  //
+// and -1 on memory allocation failure                        //
+static int encode_request(serialcomm_t *client, const screquest_t *request)
+{
+  uint8_t frame[BIN_FRAME_MAX];
+  char tag[16]; // the sequence tag, written in front of the request //
+  size_t length;
+
+  if (client->binary)
+    {
+      length = encode_binary(request->request, request->seq, frame);
+      return length == 0 ? 1 : outbuf_append(&client->out, frame, length);
+    }
+
+  if (request->seq == 0)
+    {
+      return frame_append(&client->out, client->frame_mode, request->request);
+    }
+
+  length = snprintf(tag, sizeof(tag), "#%u ", request->seq);
+  if (outbuf_append(&client->out, tag, length) != 0)
+    {
+      return -1;
+    }
+  return frame_append(&client->out, FRAME_LINE, request->request);
+}
+
+// ********** send_queued ********** //
+// move the queued requests in flight while there is room, //
+// tagging them if more than one may be in flight          //
+static void send_queued(serialcomm_t *client)
+{
+  screquest_t *request = NULL;
+  int result;
+
+  while (1)
+    {
+      // an untagged request is not sent until the late responses have //
+      // arrived, or could not anymore, or it would be given one of them //
+      pthread_mutex_lock(&client->lock);
+      request = client->numofinflight < client->depth && (client->late == 0 || client->depth > 1) ? client->queued : NULL;
+      if (request != NULL)
+        {
+          client->queued = request->next;
+          client->numofqueued--;
+          client->numofinflight++;
+        }
+      pthread_mutex_unlock(&client->lock);
+
+      if (request == NULL)
+        {
+          break;
+        }
+
+      request->next = NULL;
+      if (client->depth > 1)
+        {
+          request->seq = client->nextseq++;
+          client->nextseq = client->nextseq ? client->nextseq : 1; // 0 means untagged //
+        }
+
+      if ((result = encode_request(client, request)) != 0)
+        {
+          pthread_mutex_lock(&client->lock);
+          client->numofinflight--;
+          pthread_mutex_unlock(&client->lock);
+
+          // without a binary form the server would not accept it either //
+          if (result == 1)
+            {
+              complete(client, request, SERIALCOMM_OK, "INVALID AT-COMMAND");
+            }
+          else
+            {
+              fprintf(stderr, "Memory allocation error in serialcomm\n");
+              complete(client, request, SERIALCOMM_CLOSED, NULL);
+            }
+          continue;
+        }
+
+      if (client->inflight == NULL)
+        {
+          client->inflight = request;
+          client->deadline = monotonic_ms() + client->timeout;
+        }
+      else
+        {
+          client->lastinflight->next = request;
+        }
+      client->lastinflight = request;
+    }
+}
+
+// ********** flush ********** //
+// write what the port can take of the output buffer, and //
+// watch it for room to write if there is more            //
+static void flush(serialcomm_t *client)
+{
+  struct epoll_event event = { .events = EPOLLIN };
+  int writing;
+
+  if (client->out.len > 0 && outbuf_flush(&client->out, client->port) == -1)
+    {
+      client->broken = 1;
+      return;
+    }
+
+  writing = client->out.len > 0;
+  if (writing != client->writing)
+    {
+      event.events |= writing ? EPOLLOUT : 0;
+      event.data.fd = client->port;
+      epoll_ctl(client->events, EPOLL_CTL_MOD, client->port, &event);
+      client->writing = writing;
+    }
+}
+
+// ********** serialcomm_process ********** //
+// do what can be done without waiting: read the responses that //
+// have arrived, give up on the requests that timed out, send   //
+// the queued requests there is room for and call the callbacks //
+void serialcomm_process(serialcomm_t *client)
+{
+  struct epoll_event ready[2];
+  uint64_t signals;
+  int count = client->broken ? 0 : epoll_wait(client->events, ready, 2, 0);
+
+  for (int i = 0; i < count; i++)
+    {
+      if (ready[i].data.fd == client->wakeup)
+        {
+          if (read(client->wakeup, &signals, sizeof(signals)) == -1 && errno != EAGAIN)
+            {
+              perror("eventfd");
+            }
+        }
+      else if (ready[i].events & EPOLLIN)
+        {
+          receive(client);
+        }
+      else if (ready[i].events & (EPOLLHUP | EPOLLERR))
+        {
+          client->broken = 1;
+        }
+    }
+
+  if (!client->broken && client->inflight != NULL && monotonic_ms() >= client->deadline)
+    {
+      give_up(client, SERIALCOMM_TIMEDOUT);
+    }
+  else if (client->inflight == NULL && client->late > 0 && monotonic_ms() >= client->deadline)
+    {
+      client->late = 0; // they were lost, the stream is in step again //
+    }
+
+  if (!client->broken)
+    {
+      send_queued(client);
+      flush(client);
+    }
+
+  // a broken port is left out of the epoll set, or it would always be ready //
+  if (client->broken)
+    {
+      epoll_ctl(client->events, EPOLL_CTL_DEL, client->port, NULL);
+      if (read(client->wakeup, &signals, sizeof(signals)) == -1 && errno != EAGAIN)
+        {
+          perror("eventfd");
+        }
+      give_up(client, SERIALCOMM_CLOSED);
+    }
+}
+
+// ********** serialcomm_poll ********** //
+// wait at most timeout_ms milliseconds (-1 waits as long as  //
+// needed) for something to do, then do it, see              //
+// serialcomm_process; for programs without an event loop;   //
+// returns 1 if there was something to do, 0 if not          //
+int serialcomm_poll(serialcomm_t *client, int timeout_ms)
+{
+  int wait = serialcomm_timeout(client), result;
+
+  if (timeout_ms >= 0 && (wait < 0 || timeout_ms < wait))
+    {
+      wait = timeout_ms;
+    }
+
+  result = wait_readable(client->events, wait);
+  serialcomm_process(client);
+
+  return result == 1;
+}
+
+// ********** thread_main ********** //
+// thread function, run the client until serialcomm_stop //
+static void *thread_main(void *arg)
+{
+  serialcomm_t *client = (serialcomm_t *)arg;
+  int stopping = 0;
+
+  while (!stopping)
+    {
+      serialcomm_poll(client, -1);
+
+      pthread_mutex_lock(&client->lock);
+      stopping = client->stopping;
+      pthread_mutex_unlock(&client->lock);
+    }
+
+  return NULL;
+}
+
+// ********** serialcomm_start ********** //
+// run the client on a thread of its own, which calls the //
+// callbacks; returns 0 on success and -1 on failure      //
+int serialcomm_start(serialcomm_t *client)
+{
+  client->stopping = 0;
+  if (pthread_create(&client->thread, NULL, thread_main, client) != 0)
+    {
+      return -1;
+    }
+
+  client->running = 1;
+  return 0;
+}
+
+// ********** serialcomm_stop ********** //
+// stop the thread of serialcomm_start; the requests not //
+// complete yet stay queued or in flight                 //
+void serialcomm_stop(serialcomm_t *client)
+{
+  uint64_t signal = 1;
+
+  if (!client->running)
+    {
+      return;
+    }
+
+  pthread_mutex_lock(&client->lock);
+  client->stopping = 1;
+  pthread_mutex_unlock(&client->lock);
+
+  if (write(client->wakeup, &signal, sizeof(signal)) == -1 && errno != EAGAIN)
+    {
+      perror("eventfd");
+    }
+  pthread_join(client->thread, NULL);
+  client->running = 0;
+}
+
+// ********** serialcomm_close ********** //
+// stop the client and complete the requests left with //
+// SERIALCOMM_CLOSED; the port is left open            //
+void serialcomm_close(serialcomm_t *client)
+{
+  serialcomm_stop(client);
+  give_up(client, SERIALCOMM_CLOSED);
+
+  close(client->events);
+  close(client->wakeup);
+  fcntl(client->port, F_SETFL, client->portflags);
+  outbuf_free(&client->out);
+  pthread_mutex_destroy(&client->lock);
+}
+
+// ********** serialcomm_future_init ********** //
+// prepare a future, to be handed to a request as the arg //
+// of serialcomm_complete                                 //
+void serialcomm_future_init(scfuture_t *future)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&future->ready, &attr);
+  pthread_condattr_destroy(&attr);
+
+  pthread_mutex_init(&future->lock, NULL);
+  future->done = 0;
+  future->status = SERIALCOMM_OK;
+  future->response = NULL;
+}
+
+// ********** serialcomm_complete ********** //
+// the callback that fills a future, see serialcomm_future_init //
+void serialcomm_complete(void *arg, int status, const char *response)
+{
+  scfuture_t *future = (scfuture_t *)arg;
+
+  pthread_mutex_lock(&future->lock);
+  future->status = status;
+  future->response = response != NULL ? strdup(response) : NULL;
+  future->done = 1;
+  pthread_cond_broadcast(&future->ready);
+  pthread_mutex_unlock(&future->lock);
+}
+
+// ********** serialcomm_future_wait ********** //
+// wait at most timeout_ms milliseconds (-1 waits forever) for //
+// the request of a future to complete; returns its status, or //
+// -1 if it is not complete yet                                //
+int serialcomm_future_wait(scfuture_t *future, int timeout_ms)
+{
+  struct timespec deadline;
+  int status;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+  pthread_mutex_lock(&future->lock);
+  while (!future->done)
+    {
+      if (timeout_ms < 0)
+        {
+          pthread_cond_wait(&future->ready, &future->lock);
+        }
+      else if (pthread_cond_timedwait(&future->ready, &future->lock, &deadline) == ETIMEDOUT)
+        {
+          break;
+        }
+    }
+  status = future->done ? future->status : -1;
+  pthread_mutex_unlock(&future->lock);
+
+  return status;
+}
+
+// ********** serialcomm_future_free ********** //
+// free what a future holds, once its request is complete //
+void serialcomm_future_free(scfuture_t *future)
+{
+  free(future->response);
+  future->response = NULL;
+  pthread_cond_destroy(&future->ready);
+  pthread_mutex_destroy(&future->lock);
+}
@@ -0,0 +1,139 @@
+// Header file for the asynchronous client library of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 2/2/2023 //
+
+/* The client side of the protocol, for any program that talks to the server:
+the framing, the binary encoding, the sequence tags and the matching of the
+responses to their requests. Nothing here blocks on the serial port.
+
+A request is submitted with a completion callback and queued; the requests of
+the queue are sent as soon as fewer than depth of them are in flight, tagged
+with a sequence number when depth is above 1, so several can be in flight at
+once. The callback gets the response, or a status telling why there is none.
+
+The port is driven by serialcomm_process, which sends what it can, reads what
+has arrived and calls the callbacks, without ever waiting. It is called when
+the descriptor of serialcomm_fd is readable, which it is whenever there is
+something to do, or when serialcomm_timeout milliseconds have passed, so the
+client fits into the event loop of the program. Programs without one can have
+serialcomm_start run the loop on a thread of its own.
+
+serialcomm_process, and so the callbacks, run on one thread at a time, while
+the requests may be submitted from any thread. A future, see scfuture_t,
+turns a callback into a value another thread may wait for.
+*/
+
+#ifndef __SERIALCOMM_H_
+#define __SERIALCOMM_H_
+
+#include <pthread.h>
+#include "commonfunc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Preprocessor //
+#define SERIALCOMM_DEFAULT_DEPTH 1 // default requests in flight; 1 sends them untagged, one at a time //
+#define SERIALCOMM_MAX_DEPTH 256 // the most requests in flight //
+#define SERIALCOMM_DEFAULT_TIMEOUT 500 // default milliseconds to wait for a response //
+
+// completion statuses //
+#define SERIALCOMM_OK 0 // the server answered //
+#define SERIALCOMM_TIMEDOUT 1 // the server did not answer in time //
+#define SERIALCOMM_CLOSED 2 // the port failed or the client was closed first //
+
+// Callbacks //
+// called once per request with its status and, if SERIALCOMM_OK, the //
+// response; the response is only valid until the callback returns    //
+typedef void (*serialcomm_callback_t)(void *arg, int status, const char *response);
+// called for the notifications of the subscribed registers, "!REGn=<int>", //
+// and for the responses that arrived too late to match any request        //
+typedef void (*serialcomm_notify_t)(void *arg, const char *message);
+
+// Structs //
+// Client Request Struct //
+// A submitted request, queued and then in flight //
+struct screquest{
+	struct screquest *next; // the next request of the same list //
+	serialcomm_callback_t callback; // called once the request is complete //
+	void *arg; // handed to the callback //
+	unsigned int seq; // sequence tag, 0 if untagged //
+	char *request; // the request itself, allocated with the struct //
+};
+
+typedef struct screquest screquest_t;
+
+// Client Struct //
+struct serialcomm{
+	int port; // the serial port, opened and set up by the caller //
+	int portflags; // the file status flags of the port before serialcomm_open //
+	int events; // epoll descriptor of the port and the wakeup, see serialcomm_fd //
+	int wakeup; // eventfd signalled when a request is submitted //
+	int frame_mode; // the framing of the text requests, see commonfunc.h //
+	int binary; // set once the server has accepted AT+BIN //
+	int depth; // the most requests in flight //
+	int timeout; // milliseconds to wait for a response //
+	int broken; // set once the port has failed //
+	int writing; // set while the port is watched for room to write //
+	framereader_t reader; // the responses received //
+	outbuf_t out; // the requests not written yet //
+	char text[FRAME_MAX + 16]; // text form of a binary response //
+	pthread_mutex_t lock; // guards the queue //
+	screquest_t *queued, *lastqueued; // the requests waiting to be sent, oldest first //
+	int numofqueued; // the number of queued requests //
+	screquest_t *inflight, *lastinflight; // the requests sent, oldest first //
+	int numofinflight; // the number of requests in flight //
+	unsigned int nextseq; // sequence tag of the next tagged request //
+	long long deadline; // monotonic_ms() time the requests in flight are given up //
+	int late; // untagged requests given up on whose responses may still arrive, see dispatch //
+	serialcomm_notify_t notify; // called for notifications, NULL to drop them //
+	void *notifyarg; // handed to notify //
+	int running; // set while the thread of serialcomm_start runs //
+	int stopping; // set to stop that thread //
+	pthread_t thread; // the thread of serialcomm_start //
+};
+
+typedef struct serialcomm serialcomm_t;
+
+// Future Struct //
+// The result of a request, for serialcomm_complete to fill //
+// and any thread to wait for                               //
+struct scfuture{
+	pthread_mutex_t lock; // guards the others //
+	pthread_cond_t ready; // signalled once the request is complete //
+	int done; // set once the request is complete //
+	int status; // the status of the request //
+	char *response; // a copy of the response, NULL if there is none //
+};
+
+typedef struct scfuture scfuture_t;
+
+// Function Prototypes //
+int serialcomm_open(serialcomm_t *client, int port, int frame_mode);
+void serialcomm_set_depth(serialcomm_t *client, int depth);
+void serialcomm_set_timeout(serialcomm_t *client, int timeout);
+void serialcomm_set_notify(serialcomm_t *client, serialcomm_notify_t notify, void *arg);
+int serialcomm_submit(serialcomm_t *client, const char *request, serialcomm_callback_t callback, void *arg);
+int serialcomm_read(serialcomm_t *client, int id, serialcomm_callback_t callback, void *arg);
+int serialcomm_bounds(serialcomm_t *client, int id, serialcomm_callback_t callback, void *arg);
+int serialcomm_write(serialcomm_t *client, int id, int value, serialcomm_callback_t callback, void *arg);
+int serialcomm_insert(serialcomm_t *client, int value, const char *bounds, serialcomm_callback_t callback, void *arg);
+int serialcomm_pending(serialcomm_t *client);
+int serialcomm_fd(const serialcomm_t *client);
+int serialcomm_timeout(const serialcomm_t *client);
+void serialcomm_process(serialcomm_t *client);
+int serialcomm_poll(serialcomm_t *client, int timeout_ms);
+int serialcomm_start(serialcomm_t *client);
+void serialcomm_stop(serialcomm_t *client);
+void serialcomm_close(serialcomm_t *client);
+void serialcomm_future_init(scfuture_t *future);
+void serialcomm_complete(void *future, int status, const char *response);
+int serialcomm_future_wait(scfuture_t *future, int timeout_ms);
+void serialcomm_future_free(scfuture_t *future);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
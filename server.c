@@ -7,22 +7,38 @@
 When a request from the client is received, it performs the following actions:
   1. Checks if the request is valid.
   2. If valid, performs one of the following actions:
-    a. If it is an insertion request, adds a new register to the list.
+    a. If it is an insertion request, adds a new register to the table.
     b. If it is an AT+REG command, it prints the requested register's value.
     c. If it is an AT+REG=? command, it prints the requested register's bounds for accepted values.
     d. If it is an AT+REG=<int> command, it changes the desired register's value with the one entered.
 
 In all the above cases, the server checks for the following errors:
   1. If the AT-Command received is valid.
-  2. If the register given exist on the list.
+  2. If the register given exist in the table.
   3. If the desired value is allowed within the bounds of the selected register.
 
 After the server processes each requests, it sends the appropriate answer to the client, or an error
 message in case of a failure. 
 
-The list of registers is implemented as a singly linked list with a terminal node. It contains two
-registers by default, but more can be added through the client user interface. When the server receives
-a termination request from the client, the list is destroyed freeing all the allocated memory.
+The registers are kept in a contiguous table indexed by the register number, so a "REGn" id is
+parsed once into n and the register is reached directly. The table contains two registers by default,
+but more can be added through the client user interface.
+
+The server can serve several serial ports at once; all of them are watched by a single epoll event
+loop, and each one has its own reader, framing and replies. By default the ports share one register
+table, but with -i every port gets a table of its own. When the client on a port sends a termination
+request, that port is closed; once every port is closed the tables are destroyed freeing all the
+allocated memory and the server terminates.
+
+With -w N the requests are executed by a pool of N worker threads instead of the event loop thread.
+The event loop still reads and frames the requests of every port, and hands them to the worker of
+that port, so the requests of a port are answered in order while the ports are served in parallel.
+The register table takes no lock for reads and writes, so the workers never contend with each other
+unless they insert registers.
+
+A client may subscribe to registers with AT+SUB; the registers written by a request are then pushed
+to every subscribed port sharing the table as "!REGn=<value>" notifications, once the request is done.
+A subscription with an interval holds the changes back, and the event loop sends them when it is over.
 */
 
 // Libraries //
@@ -33,425 +49,2399 @@ a termination request from the client, the list is destroyed freeing all the all
 #include <string.h>
 #include <sys/types.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include "commonfunc.h"
+#include "regstore.h"
+#include "binproto.h"
+#include "workpool.h"
+#include "snapshot.h"
+#include "wal.h"
+#include "arena.h"
+#include "logger.h"
+#include "stats.h"
+#include "scan.h"
 
 // Preprocessor //
-#define MAX_STRING 512
-#define MAX_FILENAME 12
-#define BOUNDS_MAX 20
-#define REGID_MAX 6
-#define MAX_REQ_SIZE 20
+#define MAX_TAG 12 // the longest sequence tag echoed back, e.g. "#4294967295 " //
+#define MAX_REPLY (FRAME_MAX - 1) // the longest reply a batch command may produce //
+
+#define MAX_EVENTS 64 // the most port events handled per epoll_wait //
+#define BULK_BATCH 4096 // the registers of a definition file added together //
+#define MAX_NOTIFICATION 32 // the longest notification, e.g. "!REG2147483647=-2147483648" //
+#define MAX_LIST 2048 // the longest reply to AT+LIST in line mode, well within the response timeout //
+
+// the work handed to the workers is a request, and its kind is the //
+// framing mode of the request, or JOB_HANGUP if the port hung up    //
+#define JOB_HANGUP -1
+
+// Structs //
+// Subscription Struct //
+// A range of registers the client of a port is told about when they change. //
+// With an interval, a register is reported at most once per interval: the   //
+// changes in between are kept as pending and sent together once it is over //
+struct subscription{
+	int first; // the first register of the range //
+	int last; // the last register of the range //
+	int interval; // milliseconds between two notifications, 0 to report every change //
+	long long next_send; // when the next notification may be sent, see monotonic_ms //
+	int *pending; // the registers changed since the last notification //
+	size_t numofpending; // the number of pending registers //
+	size_t pendingsize; // room for pending registers //
+};
+
+typedef struct subscription subscription_t;
+
+// Serial Port Struct //
+// Everything the server keeps for one of the serial ports it serves. Each //
+// port has its own reader, replies and framing, so requests arriving on   //
+// different ports never mix; the register table may be shared. The reader //
+// belongs to the event loop thread, the rest to whoever executes the       //
+// requests, and the output lock guards the replies shared by the two       //
+struct serialport{
+	const char *name; // the serial port name //
+	int fd; // file descriptor of the port, -1 once it is closed //
+	lineconf_t line; // the serial line settings of the port //
+	int next_speed; // the baud rate to switch to once the reply to AT+BAUD is out, 0 if none //
+	int shard; // selects the worker executing the requests of the port //
+	framereader_t reader; // to split the bytes read into requests //
+	int ascii_mode; // the text framing mode to return to when leaving FRAME_BINARY //
+	pthread_mutex_t output_lock; // taken while the replies are queued or written //
+	outbuf_t output; // replies waiting to be written to the port //
+	uint64_t commit_wait; // the end of the log the replies tell of, 0 once it is on the disk, see hold_output //
+	int frame_mode; // the framing of the request being executed and its reply, see commonfunc.h //
+	char reply_tag[MAX_TAG + 1]; // sequence tag of the request being processed, "" if untagged //
+	atomic_int terminated; // set once the port is done with and may be closed //
+	regstore_t *regs; // the register table this port works on //
+	regstore_t own_regs; // the port's own table, when the ports do not share one //
+	subscription_t *subs; // what the client subscribed to, guarded by the output lock //
+	int numofsubs; // the number of subscriptions //
+	int subssize; // room for subscriptions //
+	int notify_mode; // the framing of the notifications, guarded by the output lock //
+	int notify_ascii; // the text framing to notify in once the port leaves FRAME_BINARY //
+	int *changes; // the registers written by the request being executed //
+	size_t numofchanges; // the number of written registers //
+	size_t changessize; // room for written registers //
+	int held_index; // the register of the write held back, 0 if none, see hold_write //
+	int held_value; // the value it is written //
+	registers_t *held_reg; // and the register itself //
+	int read_index; // the register the last request read, 0 if it was no read, see process_atcommand //
+	int read_bounds; // set if it read the bounds, not the value //
+	registers_t *read_reg; // the register itself, so a repeated read needs no lookup //
+	char read_value[16]; // the value it got, as the reply //
+	int read_result; // and as a number, to check it has not changed since //
+};
+
+typedef struct serialport port_t;
 
 // Server Globals // 
-registers_t *regs; // the registers list head - also the first register //
-int numofregs = 0; // the total number of registers //
-char *request; // client request //
-char insertion[MAX_STRING]; // insertion properties in case of insert command //
+regstore_t shared_regs; // the register table shared by all the ports //
+wal_t wal; // the mutation log of the shared table; it is logged while wal.store is set //
+port_t *ports = NULL; // the served ports //
+int numofports = 0; // the number of served ports //
+atomic_int subscriptions = 0; // the subscriptions of all the ports, to skip the notifications when 0 //
+int epfd; // the epoll instance watching all the ports //
+int wakefd = -1; // eventfd to tell the event loop a port is done with, or a notification is due //
+int workers = 0; // the number of worker threads, 0 to execute in the event loop //
+lineconf_t line_config; // the serial line settings the ports are opened with //
+workpool_t pool; // the workers //
 
-// ********** init_reglist ********** //
-// function for the server to create the list of registers. //
-// the head is initialised along with a default value.      //
-void init_reglist()
+// ********** send_reply ********** //
+// queue a reply to the client in the selected framing mode; a   //
+// tagged request gets its tag echoed in front of the reply; the //
+// replies are written out together, see outbuf_flush            //
+void send_reply(port_t *port, const char *reply)
 {
-  // allocate memory for the first register //
-  regs = (registers_t *)malloc(sizeof(registers_t));
-
-  if (regs == NULL)
+  if (port->reply_tag[0] != '\0')
     {
-      fprintf(stderr, "Memory allocation error in initialisation\n");
-      exit(1);
+      outbuf_append(&port->output, port->reply_tag, strlen(port->reply_tag));
     }
 
-  // set default values for the first register //
-  regs->regvalue = 0;
-  strcpy(regs->regid, "REG1");
-  strcpy(regs->bounds, "0-16535"); // set number bounds //
-  regs->next = NULL; 
-
-  numofregs++; // increase the number of registers //
+  frame_append(&port->output, port->frame_mode, reply);
 }
 
-// ********** add_register ********** //
-// add a new register to the list at the end //
-void add_register(int value, char* bounds) 
+// ********** tag_length ********** //
+// in FRAME_LINE mode a pipelined request starts with a sequence //
+// tag, e.g. "#17 AT+REG1"; returns the length of the tag with   //
+// its space, or 0 if the request has no well formed tag         //
+size_t tag_length(int mode, const char *request)
 {
-  registers_t *new, *current; // current node for the traversal //
-  char tempid[REGID_MAX] = {"REG"};
-  char stringnum[REGID_MAX];
+  size_t length = 1;
+
+  if (mode != FRAME_LINE || request[0] != '#')
+    {
+      return 0;
+    }
 
-  new = (registers_t *)malloc(sizeof(registers_t));
+  while (request[length] >= '0' && request[length] <= '9' && length < MAX_TAG - 1)
+    {
+      length++;
+    }
 
-  if (new == NULL)
+  // not a well formed tag; leave it to fail as an invalid command //
+  if (length == 1 || request[length] != ' ')
     {
-      fprintf(stderr, "Memory allocation error in insertion\n");
-      exit(1);
+      return 0;
     }
 
-  numofregs++; // increase the number of registers //
-  sprintf(stringnum, "%d", numofregs);
-  strcat(tempid, stringnum);
-  strcpy(new->regid, tempid); // create the complete reg id, e.g. REG5 //
+  return length + 1;
+}
+
+// ********** strip_tag ********** //
+// keep the sequence tag of a request in the port reply_tag //
+// and return the request without it                        //
+char *strip_tag(port_t *port, char *request)
+{
+  size_t length = tag_length(port->frame_mode, request);
+
+  memcpy(port->reply_tag, request, length); // keep the tag with its space //
+  port->reply_tag[length] = '\0';
+
+  return request + length;
+}
 
-  new->regvalue = value; // set new register value and bounds // 
-  strcpy(new->bounds, bounds);
-  new->next = NULL; // new register next pointer set to NULL //
+// ********** add_register ********** //
+// add a new register to the table at the end //
+// returns the new register index, or -1 if   //
+// the table is full                          //
+int add_register(regstore_t *regs, int value, slice_t bounds)
+{
+  int index = regs == wal.store ? wal_add(&wal, value, bounds) : regstore_add(regs, value, bounds);
 
-  current = regs; // assign current to the first register to traverse the list //
-  while (current->next != NULL)
+  if (index < 0)
     {
-      current = current->next; // last node always points to NULL, so traverse the list until the last node is reached //  
+      log_error("ERROR: The register table is full\n");
     }
-  current->next = new; // change last node next pointer to point to the new register //
+
+  return index;
+}
+
+// ********** add_default_registers ********** //
+// add the two registers every new table starts with //
+void add_default_registers(regstore_t *regs)
+{
+  add_register(regs, 0, slice_of("0-16535")); // set default value and number bounds //
+  add_register(regs, 3, slice_of("1|2|3")); // add the second register //
+}
+
+// ********** init_reglist ********** //
+// function for the server to create the table of registers. //
+// the first register is added along with a default value.   //
+void init_reglist(regstore_t *regs)
+{
+  regstore_init(regs);
+  add_default_registers(regs);
 }
 
 // ********** print_register ********** //
-// display selected register value                    //
-// returns the result on success and -1               //
-// if the desired register does not exist on the list //
-int print_register(char *targetid)
+// display selected register value                     //
+// returns the result on success and -1                //
+// if the desired register does not exist on the table //
+// found is set to the register, or NULL               //
+int print_register(regstore_t *regs, slice_t targetid, registers_t **found)
 {
-  registers_t *current; // for list traversal //
+  registers_t *current; // the register found //
   int result; // to store the result for safety //
+  long long started = stats_start_timer();
 
-  // traverse the list to find desired register //
-  current = regs; 
-  while (current != NULL)
+  current = *found = regstore_find(regs, slice_regid(targetid));
+  stats_stop_timer(TIME_LOOKUP, started);
+  if (current != NULL)
     {
-      if (strcmp(current->regid, targetid) == 0)
-        {
-          printf("%d\n", current->regvalue); // server print the value found - for debugging purposes //
-          result = current->regvalue;
-          return result;
-        }
-      current = current->next; 
+      result = register_get(current);
+      log_debug("%d\n", result); // server print the value found - for debugging purposes //
+      return result;
     }
 
-  return -1; // register is not on the list //
+  stats_add(STAT_BADREGS, 1);
+  return -1; // register is not on the table //
 }
 
 // ********** print_bounds ********** //
 // function to get the bounds of the desired register //
 // in case of success, the bounds are returned as     //
-// a string; if the register is not on the list,      //
-// NULL is returned                                   //
-char *print_bounds(char *targetid)
+// a string; if the register is not on the table,     //
+// NULL is returned; found is set like print_register //
+char *print_bounds(regstore_t *regs, slice_t targetid, registers_t **found)
 {
-  registers_t *current; // for list travesral //
+  registers_t *current; // the register found //
   char *result = NULL;
+  long long started = stats_start_timer();
 
-  current = regs;
-  while (current != NULL)
+  current = *found = regstore_find(regs, slice_regid(targetid));
+  stats_stop_timer(TIME_LOOKUP, started);
+  if (current != NULL)
     {
-      if (strcmp(current->regid, targetid) == 0)
-        {
-          printf("%s\n", current->bounds); // server prints the bounds found - for debugging purposes //
-          result = current->bounds;
-          return result;
-        }
-      current = current->next; 
+      log_debug("%s\n", current->desc->bounds); // server prints the bounds found - for debugging purposes //
+      result = current->desc->bounds;
+      return result;
     }
 
+  stats_add(STAT_BADREGS, 1);
   return NULL;
 }
 
-// ********** bound_check ********** //
-// check if the number requested is allowed depending on the target //
-// register bounds; returns 0 on success, -1 on failure             //
-int bound_check(int target_value, char *bounds)
+// ********** set_register ********** //
+// change the value of a register, and log the change //
+// if the table is logged; the value is already valid //
+void set_register(regstore_t *regs, registers_t *reg, int index, int value)
 {
-  char *distinctcheck = NULL; // to search the string if we have distinct or continuous bounds //
-  int distinctnum; // in case of distinct number bounds, to check if the number is allowed //
-  char *lower_bound = NULL, *upper_bound = NULL, *token = NULL; // in case of continous bounds, to separate lower from upper bound //
-  char helper[MAX_STRING]; // in order not to edit the bounds //
-
-  sprintf(helper, "%s", bounds); // copy the bounds string here, because strtok edits the haystack string //
-
-  distinctcheck = strchr(helper,'|'); // if this character is present, then we have distinct number bounds //
+  if (regs == wal.store)
+    {
+      wal_write(&wal, reg, index, value);
+      return;
+    }
 
-  if (distinctcheck != NULL)
-    { 
-      token = strtok(helper, "|");
-      while (token != NULL)
-        {
-          if (target_value == atoi(token))
-            {
-              return 0; // success //
-            }
+  register_set(reg, value);
+  regstore_touch(regs, index); // for the snapshot //
+}
 
-          token = strtok(NULL, "|");
-        }
+// ********** check_register ********** //
+// function to check if the register with the given index may be  //
+// given a value, according to the register bounds; the register  //
+// is returned in found; returns 0 if it may, -1 if the number is //
+// invalid and -2 if the register does not exist in the table     //
+int check_register(regstore_t *regs, int index, int target_value, registers_t **found)
+{
+  registers_t *current; // the register found //
+  long long started = stats_start_timer();
 
-      return -1; // failure, number not allowed //
+  current = regstore_find(regs, index);
+  stats_stop_timer(TIME_LOOKUP, started);
+  if (current == NULL)
+    {
+      // register is not on the table; return -2 //
+      stats_add(STAT_BADREGS, 1);
+      return -2; 
     }
-  else // in any other case, we have continuous bounds //
-    { 
-      lower_bound = strtok(helper, "-");
-      upper_bound = strtok(NULL, "-");
 
-      if (target_value > atoi(lower_bound) && target_value < atoi(upper_bound))
-        {
-          return 0; // success, number within bounds //
-        }
-      else
-        {
-          return -1; // failure, number out of bounds //
-        }
+  // check the compiled bounds to see if the number is valid //
+  if (bounds_check(&current->desc->limits, target_value) == -1)
+    {
+      stats_add(STAT_REJECTS, 1);
+      return -1; // failure, number out of bounds //
     }
+
+  *found = current;
+  return 0;
 }
 
-// ********** replace_value ********** //
-// function to replace target register value with the desired one; //
-// if it is valid according to the desired regiser bounds          //
+// ********** write_register ********** //
+// function to replace the value of the register with the given   //
+// index, if the value is valid according to the register bounds  //
 // returns 0 on sucess, -1 if the number is invalid and -2         //
-// if the register does not exist in the list                      //
-int replace_value(int target_value, char *targetid)
+// if the register does not exist in the table                     //
+int write_register(regstore_t *regs, int index, int target_value)
 {
-  int replace_result, boundcheck_result;
-  registers_t *current; // for list traversal //
+  registers_t *current = NULL; // the register found //
+  int result = check_register(regs, index, target_value, &current);
 
-  current = regs;
-  while (current != NULL)
+  if (result == 0)
     {
-      if (strcmp(current->regid, targetid) == 0)
-        {
-          printf("Register found, commencing replace operation\n");
-          boundcheck_result = bound_check(target_value, current->bounds); // call bound_check() to see if the number is valid within the bounds //
+      set_register(regs, current, index, target_value); // success, change value //
+    }
 
-          if (boundcheck_result != -1)
-            {
-              current->regvalue = target_value; // success, change value //
-              return 0;
-            }
-          else
-            {
-              return -1; // failure, number out of bounds //
-            }
+  return result;
+}
+
+// ********** note_change ********** //
+// remember a register written by the request being executed,  //
+// for the ports subscribed to it, see publish_changes; nothing //
+// is kept while no port has a subscription                     //
+void note_change(port_t *port, int index)
+{
+  if (atomic_load_explicit(&subscriptions, memory_order_relaxed) == 0)
+    {
+      return;
+    }
+
+  if (port->numofchanges == port->changessize)
+    {
+      port->changessize = port->changessize ? port->changessize * 2 : 16;
+      port->changes = (int *)realloc(port->changes, port->changessize * sizeof(int));
+      if (port->changes == NULL)
+        {
+          fprintf(stderr, "Memory allocation error in notification\n");
+          exit(1);
         }
-      current = current->next;  
     }
 
-  // register is not on the list; return -2 //
-  return -2; 
+  port->changes[port->numofchanges++] = index;
 }
 
-// ********** clear_regs ********** //
-// clear the regs list and free all the allocated memory //
-void clear_regs()
+// ********** release_write ********** //
+// store the write held back on a port, if there is one; called //
+// before any request that could see it, and before the replies //
+// go out, see hold_write                                       //
+void release_write(port_t *port)
 {
-  registers_t *current;
+  if (port->held_index == 0)
+    {
+      return;
+    }
+
+  set_register(port->regs, port->held_reg, port->held_index, port->held_value);
+  note_change(port, port->held_index);
+  port->held_index = 0;
+}
+
+// ********** hold_write ********** //
+// write a register for the request being executed, if the value  //
+// is valid according to the register bounds; the write is held   //
+// back until the next request that is not a write of the same    //
+// register, which stores only the last value, so a register      //
+// written many times in a burst is stored, logged and published  //
+// once; nothing is held while there are subscriptions, which are //
+// told of every change; returns as write_register                //
+int hold_write(port_t *port, int index, int target_value)
+{
+  registers_t *current = NULL; // the register found //
+  int result = check_register(port->regs, index, target_value, &current);
+
+  if (result != 0)
+    {
+      return result;
+    }
 
-  while (regs != NULL)
+  if (port->held_index == index)
+    {
+      stats_add(STAT_COALESCED, 1);
+    }
+  else
     {
-      current = regs;
-      regs = regs->next;
+      release_write(port);
+    }
+
+  port->held_index = index;
+  port->held_value = target_value;
+  port->held_reg = current;
 
-      free(current);
+  if (atomic_load_explicit(&subscriptions, memory_order_relaxed) != 0)
+    {
+      release_write(port);
     }
+
+  return 0;
+}
+
+// ********** replace_value ********** //
+// function to replace target register value with the desired one; //
+// if it is valid according to the desired regiser bounds          //
+// returns 0 on sucess, -1 if the number is invalid and -2         //
+// if the register does not exist in the table                     //
+int replace_value(port_t *port, int target_value, slice_t targetid)
+{
+  int index = slice_regid(targetid);
+
+  log_debug("Commencing replace operation on register %d\n", index);
+  return hold_write(port, index, target_value);
+}
+
+// ********** clear_regs ********** //
+// clear the regs table and free all the allocated memory //
+void clear_regs(regstore_t *regs)
+{
+  regstore_clear(regs);
 }
 
 // ********** process_insertion ********** //
 // function to process an insertion request from the client //
 // it takes the request as an argument, parses it and       //
-// adds the new register to the list                        //
-void process_insertion(char *target_request)
+// adds the new register to the table; returns the index   //
+// of the new register, or -1 if the request has no value   //
+// or no bounds, or the table is full                       //
+int process_insertion(regstore_t *regs, const char *target_request)
 {
-  char *token = NULL; // to break the request in order to get the separate info //
-  char reg_bounds[MAX_STRING]; // new reg bounds //
+  slice_t rest = slice_of(target_request); // the part of the request not parsed yet //
+  slice_t token; // to break the request in order to get the separate info //
   int reg_value; // the new register value to take from the request //
 
   // get the first token from the request - 'insert' - no use for it here //
-  token = strtok(target_request,"+");
+  slice_token(&rest, '+', &token);
 
   // second token: new register value //
-  token = strtok(NULL, "+");
-  reg_value = atoi(token);
+  if (slice_token(&rest, '+', &token) != 0)
+    {
+      return -1;
+    }
+  reg_value = slice_atoi(token);
 
   // third token: new register bounds //
-  token = strtok(NULL, "+");
-  strcpy(reg_bounds, token);
+  if (slice_token(&rest, '+', &token) != 0)
+    {
+      return -1;
+    }
 
-  // call the add_register() function to add the register into the lsit //
-  add_register(reg_value, reg_bounds);
+  // call the add_register() function to add the register into the table //
+  return add_register(regs, reg_value, token);
 }
 
-// ********** process_atcommand ********** //
-// function to process any AT-command the client sends //
-// it takes as argument the client request, parses it, //
-// performs error checking and if there are no errors, //
-// then executes the desired action; the function      //
-// returns 0 if successful, 1 if reg input is invalid, //
-// 2 if target number is not valid for the selected    //
-// register and 3 if the desired request is not an     //
-// accepted AT-command                                 //
-int process_atcommand(int fd, char *target_request)
+// ********** process_block_insert ********** //
+// function to process a block insertion request from the client, //
+// "block+<count>+<value>+<bounds>": count registers are added   //
+// with the same value and bounds, as one block                  //
+void process_block_insert(port_t *port, const char *target_request)
 {
-  int requested_value; // in case of value change, this is to convert the value from string to int //
-  int reg_result = 0; // in case of print, this is to store the reg result //
-  int value_swap_check; // to check if the value swap was completed successfully, or the desired value was out of bounds //
-  char *reg_bounds = NULL; // to store the target reg bounds //
-  char *main_command = NULL, *at_section = NULL, *target_regid = NULL, *target_value = NULL;
-  char reg_result_string[2];
-  // main_command is the AT+<CMD> part of the command //
-  // at_section is the "AT" part of the command - used to get the reg id for searching //
-  // target_value gets the value after the '=' in order to perform the desired action //
+  slice_t rest = slice_of(target_request), count, value, bounds;
+  regblock_t *block = NULL;
+  char reply[64];
+  int id;
 
-  if (strncmp(target_request, "AT+REG", 6) == 0)
+  if (slice_token(&rest, '+', &count) != 0 || slice_token(&rest, '+', &value) != 0
+      || slice_token(&rest, '+', &bounds) != 0
+      || (id = port->regs == wal.store ? wal_add_block(&wal, slice_atoi(count), slice_atoi(value), bounds)
+                                       : regstore_add_block(port->regs, slice_atoi(count), slice_atoi(value), bounds)) < 0)
     {
-      main_command = strtok(target_request, "="); // "e.g. AT+REG3" //
-      target_value = strtok(NULL, "="); // value after the '=' //
+      send_reply(port, "INVALID INPUT\n");
+      return;
+    }
 
-      at_section = strtok(main_command, "+"); // separate the "AT" to get the reg id //
-      target_regid = strtok(NULL, "+"); // get the target reg id, e.g. "REG2" // 
+  // tell the client the id of the block and of its registers //
+  block = regstore_find_block(port->regs, id);
+  snprintf(reply, sizeof(reply), "INSERTED BLK%d REG%d..REG%d\n", id, block->first, block->first + block->count - 1);
+  send_reply(port, reply);
+}
 
-      // select the appropriate function depending on the target_value //
-      if (target_value == NULL)
+// ********** parse_definition ********** //
+// split a register definition "<value><separator><bounds>", e.g.  //
+// "5+1|2|5" or "5,0-100", into the value and the bounds; returns  //
+// 0 on success and -1 if it is not a valid definition             //
+int parse_definition(slice_t definition, char separator, int *value, slice_t *bounds)
+{
+  slice_t number;
+
+  slice_split(&definition, separator, &number);
+  if (definition.ptr == NULL || definition.len == 0 || slice_int(number, value) != 0)
+    {
+      return -1;
+    }
+
+  *bounds = definition;
+  return 0;
+}
+
+// ********** process_bulkinsert ********** //
+// function to process a bulk insertion request from the client, //
+// "bulkinsert+<value>+<bounds>;<value>+<bounds>;...": either all //
+// the registers are added, in a single pass, or none of them     //
+void process_bulkinsert(port_t *port, const char *definitions)
+{
+  slice_t rest = slice_of(definitions), element;
+  char reply[64];
+  int count = 1, first;
+  int *values;
+  slice_t *bounds;
+
+  // there are at most as many definitions as ';' separators plus one //
+  count += (int)scan_count(definitions, strlen(definitions), ';');
+
+  values = (int *)malloc(count * sizeof(int));
+  bounds = (slice_t *)malloc(count * sizeof(slice_t));
+  if (values == NULL || bounds == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in insertion\n");
+      exit(1);
+    }
+
+  count = 0;
+  while (slice_token(&rest, ';', &element) == 0)
+    {
+      if (parse_definition(element, '+', &values[count], &bounds[count]) != 0)
         {
-          // print reg value - if print returns -1, the selected register is not in the list //
-          reg_result = print_register(target_regid);
-          if (reg_result != -1)
-            {
-              printf("Value found %d, sending to client\n", reg_result);
-              sprintf(reg_result_string, "%d\n", reg_result);
-              my_write(fd, reg_result_string, MAX_REQ_SIZE);
-              return 0;
-            }
-          else
-            {
-              fprintf(stderr, "Failure, selected reg not found\n");
-              my_write(fd, "INVALID REGISTER\n", MAX_REQ_SIZE);
-              return 1;
-            }
+          count = -1;
+          break;
         }
-      else if (strcmp(target_value, "?") == 0)
+      count++;
+    }
+
+  if (count <= 0)
+    {
+      send_reply(port, "INVALID INPUT\n");
+    }
+  else if ((first = port->regs == wal.store ? wal_add_many(&wal, count, values, bounds)
+                                            : regstore_add_many(port->regs, count, values, bounds)) < 0)
+    {
+      log_error("ERROR: The register table is full\n");
+      send_reply(port, "INVALID INPUT\n");
+    }
+  else
+    {
+      // tell the client the ids of the new registers //
+      snprintf(reply, sizeof(reply), "INSERTED REG%d..REG%d\n", first, first + count - 1);
+      send_reply(port, reply);
+    }
+
+  free(values);
+  free(bounds);
+}
+
+// ********** load_definitions ********** //
+// add the registers defined in a file, one "<value>,<bounds>" per  //
+// line; empty lines and lines starting with '#' are skipped. The   //
+// registers are added in batches of BULK_BATCH; returns the number //
+// of registers added, or -1 if the file cannot be read or a line   //
+// is not a valid definition                                        //
+int load_definitions(regstore_t *regs, const char *path)
+{
+  FILE *file = fopen(path, "r");
+  char *line = NULL;
+  size_t size = 0;
+  int lineno = 0, count = 0, total = 0, result = 0;
+  int values[BULK_BATCH];
+  slice_t bounds[BULK_BATCH];
+  arena_t strings; // the bounds of the current batch //
+
+  if (file == NULL)
+    {
+      log_error("ERROR: Could not open %s\n", path);
+      return -1;
+    }
+
+  arena_init(&strings);
+  while (result == 0 && getline(&line, &size, file) != -1)
+    {
+      lineno++;
+      line[strcspn(line, "\r\n")] = '\0';
+      if (line[0] == '\0' || line[0] == '#')
         {
-          // print bounds //
-          reg_bounds = print_bounds(target_regid);
-          if (reg_bounds != NULL)
-            {
-              printf("Bounds found %s, sending to client\n", reg_bounds);
-              my_write(fd, reg_bounds, MAX_REQ_SIZE);
-              return 0;
-            }
-          else
-            {
-              fprintf(stderr, "Failure, selected reg not found\n");
-              my_write(fd, "INVALID REGISTER\n", MAX_REQ_SIZE);
-              return 1;
-            }
+          continue;
         }
-      else
+
+      // getline reuses the line, so the bounds are kept until the batch is added //
+      if (parse_definition(slice_of(line), ',', &values[count], &bounds[count]) != 0
+          || (bounds[count].ptr = arena_strndup(&strings, bounds[count].ptr, bounds[count].len)) == NULL)
         {
-          // check bound and insert value to target reg // 
-          requested_value = atoi(target_value);
-          value_swap_check = replace_value(requested_value, target_regid);
+          log_error("ERROR: %s:%d: not a register definition\n", path, lineno);
+          result = -1;
+          break;
+        }
 
-          if (value_swap_check == -2)
-            {
-              fprintf(stderr, "Failure, selected reg not found\n");
-              my_write(fd, "INVALID REGISTER\n", MAX_REQ_SIZE);
-              return 1;
-            }
-          else if (value_swap_check == -1)
-            {
-              fprintf(stderr, "Invalid input, not accepted by set bounds. Sending to client\n");
-              my_write(fd, "InvalidInput\n", MAX_REQ_SIZE);
-              return 2;
-            }
-          else
-            {
-              printf("Register value changed, sending OK to client\n");
-              my_write(fd, "OK\n", MAX_REQ_SIZE);
-              return 0;
-            }
+      if (++count == BULK_BATCH)
+        {
+          result = regstore_add_many(regs, count, values, bounds) < 0 ? -1 : 0;
+          total += count;
+          count = 0;
+          arena_free(&strings);
         }
     }
-  else
+
+  if (result == 0 && count > 0)
     {
-      fprintf(stderr, "ERROR: Desired request is not a valid AT-Command. Sending error message to client\n");
-      my_write(fd, "INVALID AT-COMMAND\n", MAX_REQ_SIZE);
-      return 3;
+      result = regstore_add_many(regs, count, values, bounds) < 0 ? -1 : 0;
+      total += count;
+    }
+
+  if (result != 0 && total > 0)
+    {
+      log_error("ERROR: %s: stopped after %d registers\n", path, total);
     }
+
+  arena_free(&strings);
+  free(line);
+  fclose(file);
+
+  return result == 0 ? total : -1;
 }
 
-// ********** main program ********** //
-int main(int argc, char *argv[])
+// ********** provision_table ********** //
+// add the registers of a definition file to a table //
+// returns 0 on success and -1 on failure            //
+int provision_table(regstore_t *regs, const char *path)
 {
-  // atcommand_res is used to check the result of the process_atcommand function for debugging purposes //
-  int fd, atcommand_res; 
-  char filename[MAX_FILENAME]; // to store the server serial port name //
-  int bytes = 0; // bytes read from the read system call //
+  long long start = monotonic_ms();
+  int added = load_definitions(regs, path);
 
-  // check argument count //
-  if (argc < 2)
+  if (added < 0)
     {
-      fprintf(stderr, "ERROR: You must specify a serial port name\n");
-      return 1;
+      return -1;
     }
 
-  // get serial port name //
-  strcpy(filename, argv[1]);
+  log_info("Added %d registers from %s in %lld ms\n", added, path, monotonic_ms() - start);
+  return 0;
+}
 
-  // print server port //
-  printf("Server port is: %s\n", filename);
+// ********** parse_regrange ********** //
+// parse the register part of a batch element, "REGa" or "REGa..REGb", //
+// with or without the "AT+" prefix, into the first and last register //
+// indexes; returns 0 on success and -1 if it is not a valid range     //
+int parse_regrange(slice_t element, int *first, int *last)
+{
+  int dots;
 
-  init_reglist(); // create the list of registers //
-  add_register(3, "1|2|3"); // add the second register //
+  if (slice_prefix(element, "AT+"))
+    {
+      element.ptr += 3;
+      element.len -= 3;
+    }
 
-  fd = my_open(filename, O_RDWR | O_NOCTTY | O_SYNC);
-  if (fd < 0)
+  dots = slice_find(element, "..");
+  if (dots == -1)
     {
-      fprintf(stderr, "ERROR: Open syscall failed from server\n");
-      return 1;
+      *first = *last = slice_regid(element);
+    }
+  else
+    {
+      slice_t upper = { element.ptr + dots + 2, element.len - dots - 2 };
+
+      element.len = dots;
+      *first = slice_regid(element);
+      *last = slice_regid(upper);
     }
 
-  // set the serial port attributes, i.e baud rate and parity //
-  set_interface_attributes(fd, B115200, 0);
+  return (*first == -1 || *last == -1 || *first > *last) ? -1 : 0;
+}
 
-  // allocate memory for client request - for some reason, didn't work as a static //
-  request = (char *)malloc(MAX_STRING * sizeof(char));
-  memset(request, 0, sizeof(request));
+// ********** append_reply ********** //
+// append a batch element result to the reply, separated by ';' //
+// returns 0 on success and -1 if the reply would be too long    //
+int append_reply(char *reply, size_t *length, const char *result)
+{
+  size_t needed = strlen(result) + (*length > 0);
 
-  // main loop to read and process requests from the client //
-  while (1)
+  if (*length + needed > MAX_REPLY)
     {
-      wait_for_response(fd, 1); // block until you get a request //
-      bytes = my_read(fd, request, MAX_REQ_SIZE);
-      if (bytes < 0)
-        {
-          fprintf(stderr, "ERROR: Something went terribly wrong...\n");
-        }
-      else
-        {
-          printf("Client request: %s\n", request);  
-        }
+      return -1;
+    }
+
+  *length += sprintf(reply + *length, "%s%s", *length > 0 ? ";" : "", result);
+  return 0;
+}
+
+// ********** is_batch ********** //
+// check if a request is a batch, i.e. holds a ';' or a ".." range, //
+// in a single pass over it                                         //
+int is_batch(const char *request)
+{
+  size_t length = strlen(request);
+  const char *end = request + length;
+  const char *found = scan_find2(request, length, ';', '.');
 
-      if (strncmp(request, "insert", 6) == 0)
+  while (found != NULL)
+    {
+      if (*found == ';' || (found + 1 < end && found[1] == '.'))
         {
-          // add a new register to the list and inform the client //
-          printf("Got insertion request from client\n");
-          strcpy(insertion, request);
-          process_insertion(insertion);
-          my_write(fd, "INSERTION COMPLETE\n", MAX_REQ_SIZE);
+          return 1;
         }
-      else if (strncmp(request, "quit", 4) == 0)
+      found = scan_find2(found + 1, end - found - 1, ';', '.');
+    }
+
+  return 0;
+}
+
+// ********** process_batch ********** //
+// function to process a batch of AT-commands separated by ';', e.g. //
+// "AT+REG1;AT+REG7=5;REG2=?", where any register may also be a      //
+// range, e.g. "AT+REG1..REG64"; every element is validated and      //
+// executed in turn, and the results are sent back in one reply,     //
+// one result per register separated by ';'; the function returns 0  //
+// if every element succeeded, or the code of the first failure as   //
+// in process_atcommand                                              //
+int process_batch(port_t *port, const char *target_request)
+{
+  char reply[MAX_REPLY + 1]; // the combined reply //
+  size_t length = 0;
+  char result[16]; // the result of a single register //
+  slice_t rest = slice_of(target_request), element, target_value;
+  int first, last, failure = 0, overflow = 0;
+  registers_t *current = NULL;
+
+  reply[0] = '\0';
+
+  while (!overflow && slice_split(&rest, ';', &element) == 0)
+    {
+      // the value is everything after the first '=', if there is one //
+      target_value = element;
+      slice_split(&target_value, '=', &element);
+
+      // the whole range is validated before anything is executed //
+      if (parse_regrange(element, &first, &last) != 0 || regstore_find(port->regs, last) == NULL)
         {
-          printf("Got termination request from client. Bye\n");
-          my_write(fd, "TERMINATING\n", MAX_REQ_SIZE);
-          break;
+          failure = failure ? failure : 1;
+          overflow = append_reply(reply, &length, "INVALID REGISTER");
+          continue;
         }
-      else
+
+      for (int index = first; index <= last && !overflow; index++)
         {
-          atcommand_res = process_atcommand(fd, request); // process the AT-Command //
-          if (atcommand_res == 0)
+          current = regstore_find(port->regs, index);
+
+          if (target_value.ptr == NULL || target_value.len == 0)
             {
-              printf("OK!\n");
+              release_write(port); // the register may be the one held //
+              sprintf(result, "%d", register_get(current));
+              overflow = append_reply(reply, &length, result);
             }
+          else if (slice_equal(target_value, "?"))
+            {
+              overflow = append_reply(reply, &length, current->desc->bounds);
+            }
+          else if (hold_write(port, index, slice_atoi(target_value)) == 0)
+            {
+              overflow = append_reply(reply, &length, "OK");
+            }
+          else
+            {
+              failure = failure ? failure : 2;
+              overflow = append_reply(reply, &length, "InvalidInput");
+            }
+        }
+    }
+
+  if (overflow)
+    {
+      log_debug("Failure, batch reply too long. Sending error message to client\n");
+      send_reply(port, "REPLY TOO LONG\n");
+      return 3;
+    }
+
+  log_debug("Batch processed, sending results to client\n");
+  send_reply(port, reply);
+  return failure;
+}
+
+// ********** process_block ********** //
+// function to process an AT-command on a register block: "AT+BLKn" //
+// reads all its values, separated by ';', "AT+BLKn=?" its bounds   //
+// and "AT+BLKn=<int>;<int>;..." writes all of them, if every value //
+// is allowed; the function returns as process_atcommand            //
+int process_block(port_t *port, const char *target_request)
+{
+  int values[REGSTORE_BLOCK_MAX]; // the values of the block //
+  char reply[MAX_REPLY + 1]; // all the values, a block always fits //
+  size_t length = 0;
+  slice_t target_value = slice_of(target_request + 3), blkid, element;
+  regblock_t *block = NULL;
+  int count = 0;
+
+  // the value is everything after the first '=', if there is one //
+  slice_split(&target_value, '=', &blkid);
+  block = regstore_find_block(port->regs, slice_id(blkid, "BLK"));
+  if (block == NULL)
+    {
+      log_debug("Failure, selected block not found\n");
+      stats_add(STAT_BADREGS, 1);
+      send_reply(port, "INVALID REGISTER\n");
+      return 1;
+    }
+
+  if (target_value.ptr == NULL)
+    {
+      regstore_block_read(port->regs, block, values);
+      for (int i = 0; i < block->count; i++)
+        {
+          length += sprintf(reply + length, "%s%d", i > 0 ? ";" : "", values[i]);
+        }
+      send_reply(port, reply);
+      return 0;
+    }
+
+  if (slice_equal(target_value, "?"))
+    {
+      send_reply(port, block->desc->bounds);
+      return 0;
+    }
+
+  // one value for every register of the block, no more and no less //
+  while (count <= block->count && slice_split(&target_value, ';', &element) == 0)
+    {
+      if (count < block->count)
+        {
+          values[count] = slice_atoi(element);
+        }
+      count++;
+    }
+
+  if (count != block->count)
+    {
+      log_debug("Failure, %d values for a block of %d registers\n", count, block->count);
+      send_reply(port, "INVALID INPUT\n");
+      return 2;
+    }
+
+  if ((port->regs == wal.store ? wal_block_write(&wal, slice_id(blkid, "BLK"), values)
+                                : regstore_block_write(port->regs, block, values)) != 0)
+    {
+      log_debug("Invalid input, not accepted by the block bounds. Sending to client\n");
+      stats_add(STAT_REJECTS, 1);
+      send_reply(port, "InvalidInput\n");
+      return 2;
+    }
+
+  for (int i = 0; i < block->count; i++)
+    {
+      note_change(port, block->first + i);
+    }
+  send_reply(port, "OK\n");
+  return 0;
+}
+
+// ********** process_atcommand ********** //
+// function to process any AT-command the client sends //
+// it takes as argument the client request, parses it, //
+// performs error checking and if there are no errors, //
+// then executes the desired action; the function      //
+// returns 0 if successful, 1 if reg input is invalid, //
+// 2 if target number is not valid for the selected    //
+// register and 3 if the desired request is not an     //
+// accepted AT-command; requests holding a ';' or a    //
+// ".." range are batches, see process_batch, and the  //
+// "AT+BLKn" requests go to process_block              //
+int process_atcommand(port_t *port, const char *target_request)
+{
+  int requested_value; // in case of value change, this is to convert the value from string to int //
+  int reg_result = 0; // in case of print, this is to store the reg result //
+  int value_swap_check; // to check if the value swap was completed successfully, or the desired value was out of bounds //
+  char *reg_bounds = NULL; // to store the target reg bounds //
+  slice_t rest = slice_of(target_request); // the part of the request not parsed yet //
+  slice_t main_command, at_section, target_regid, target_value;
+  int index, read_index = port->read_index; // the register of the request, and of the read before //
+  // main_command is the AT+<CMD> part of the command //
+  // at_section is the "AT" part of the command - used to get the reg id for searching //
+  // target_value gets the value after the '=' in order to perform the desired action //
+
+  port->read_index = 0; // set again if this is a read too //
+  if (strncmp(target_request, "AT+REG", 6) == 0)
+    {
+      if (is_batch(target_request))
+        {
+          stats_add(STAT_BATCHES, 1);
+          return process_batch(port, target_request);
+        }
+
+      // the request is split in place, into slices of it //
+      slice_token(&rest, '=', &main_command); // "e.g. AT+REG3" //
+      slice_token(&rest, '=', &target_value); // value after the '=' //
+
+      slice_token(&main_command, '+', &at_section); // separate the "AT" to get the reg id //
+      slice_token(&main_command, '+', &target_regid); // get the target reg id, e.g. "REG2" // 
+
+      // the same read as the request before gets the same reply      //
+      // without a lookup, from the register kept: the bounds always,  //
+      // and the value if no write changed it since, from this port or //
+      // any other sharing the table                                   //
+      index = slice_regid(target_regid);
+      if (index > 0 && index == read_index && port->read_bounds == (target_value.ptr != NULL)
+          && (target_value.ptr == NULL ? register_get(port->read_reg) == port->read_result
+                                       : slice_equal(target_value, "?")))
+        {
+          stats_add(target_value.ptr == NULL ? STAT_READS : STAT_BOUNDS, 1);
+          stats_add(STAT_REUSED, 1);
+          port->read_index = index;
+          send_reply(port, port->read_bounds ? port->read_reg->desc->bounds : port->read_value);
+          return 0;
+        }
+
+      // select the appropriate function depending on the target_value //
+      if (target_value.ptr == NULL)
+        {
+          // print reg value - if print returns -1, the selected register is not in the table //
+          stats_add(STAT_READS, 1);
+          release_write(port); // the register may be the one held //
+          reg_result = print_register(port->regs, target_regid, &port->read_reg);
+          if (reg_result != -1)
+            {
+              log_debug("Value found %d, sending to client\n", reg_result);
+              sprintf(port->read_value, "%d\n", reg_result);
+              port->read_result = reg_result;
+              port->read_index = index;
+              port->read_bounds = 0;
+              send_reply(port, port->read_value);
+              return 0;
+            }
+          else
+            {
+              log_debug("Failure, selected reg not found\n");
+              send_reply(port, "INVALID REGISTER\n");
+              return 1;
+            }
+        }
+      else if (slice_equal(target_value, "?"))
+        {
+          // print bounds //
+          stats_add(STAT_BOUNDS, 1);
+          reg_bounds = print_bounds(port->regs, target_regid, &port->read_reg);
+          if (reg_bounds != NULL)
+            {
+              log_debug("Bounds found %s, sending to client\n", reg_bounds);
+              port->read_index = index;
+              port->read_bounds = 1;
+              send_reply(port, reg_bounds);
+              return 0;
+            }
+          else
+            {
+              log_debug("Failure, selected reg not found\n");
+              send_reply(port, "INVALID REGISTER\n");
+              return 1;
+            }
+        }
+      else
+        {
+          // check bound and insert value to target reg // 
+          stats_add(STAT_WRITES, 1);
+          requested_value = slice_atoi(target_value);
+          value_swap_check = replace_value(port, requested_value, target_regid);
+
+          if (value_swap_check == -2)
+            {
+              log_debug("Failure, selected reg not found\n");
+              send_reply(port, "INVALID REGISTER\n");
+              return 1;
+            }
+          else if (value_swap_check == -1)
+            {
+              log_debug("Invalid input, not accepted by set bounds. Sending to client\n");
+              send_reply(port, "InvalidInput\n");
+              return 2;
+            }
+          else
+            {
+              log_debug("Register value changed, sending OK to client\n");
+              send_reply(port, "OK\n");
+              return 0;
+            }
+        }
+    }
+  else if (strncmp(target_request, "AT+BLK", 6) == 0)
+    {
+      stats_add(STAT_BLOCKS, 1);
+      return process_block(port, target_request);
+    }
+  else
+    {
+      log_debug("ERROR: Desired request is not a valid AT-Command. Sending error message to client\n");
+      stats_add(STAT_INVALID, 1);
+      send_reply(port, "INVALID AT-COMMAND\n");
+      return 3;
+    }
+}
+
+// ********** process_binary ********** //
+// function to process a single request frame in FRAME_BINARY mode //
+// it goes through the same register operations as the AT-commands //
+// but without any text parsing or formatting; returns 1 if it was //
+// a termination request, 0 if not                                 //
+int process_binary(port_t *port, const uint8_t *body, size_t length)
+{
+  binmsg_t msg, reply;
+  uint8_t frame[BIN_FRAME_MAX];
+  slice_t bounds; // bounds of an inserted register, in the frame //
+  registers_t *current = NULL;
+  int terminate = 0;
+  int result;
+
+  memset(&reply, 0, sizeof(reply));
+  reply.status = BIN_OK;
+  stats_add(STAT_BINARY, 1);
+
+  if (bin_decode_request(body, length, &msg) != 0)
+    {
+      reply.opcode = body[0];
+      reply.seq = msg.seq;
+      reply.status = BIN_INVALID_COMMAND;
+      outbuf_append(&port->output, frame, bin_encode_response(frame, &reply));
+      return 0;
+    }
+
+  reply.opcode = msg.opcode;
+  reply.seq = msg.seq;
+
+  // indexes that do not fit an int are never in the table //
+  current = msg.index <= INT_MAX ? regstore_find(port->regs, (int)msg.index) : NULL;
+
+  switch (msg.opcode)
+    {
+    case BIN_READ:
+      if (current == NULL)
+        {
+          reply.status = BIN_INVALID_REGISTER;
+        }
+      else
+        {
+          reply.value = register_get(current);
+        }
+      break;
+
+    case BIN_BOUNDS:
+      if (current == NULL)
+        {
+          reply.status = BIN_INVALID_REGISTER;
+        }
+      else
+        {
+          reply.bounds = current->desc->bounds;
+          reply.boundslen = strlen(current->desc->bounds);
+        }
+      break;
+
+    case BIN_WRITE:
+      if (current == NULL)
+        {
+          reply.status = BIN_INVALID_REGISTER;
+        }
+      else if (write_register(port->regs, (int)msg.index, msg.value) != 0)
+        {
+          reply.status = BIN_INVALID_INPUT;
+        }
+      else
+        {
+          note_change(port, (int)msg.index);
+        }
+      break;
+
+    case BIN_INSERT:
+      // the bounds are taken from the frame, up to a '\0' if there is one //
+      bounds.ptr = (const char *)msg.bounds;
+      bounds.len = strnlen(bounds.ptr, msg.boundslen);
+      if ((result = add_register(port->regs, msg.value, bounds)) < 0)
+        {
+          reply.status = BIN_INVALID_INPUT;
+        }
+      else
+        {
+          reply.index = result; // other ports may insert at the same time //
+        }
+      break;
+
+    case BIN_QUIT:
+      log_info("Got termination request from client. Bye\n");
+      terminate = 1;
+      break;
+
+    case BIN_ASCII:
+      // the reader switches back, see service_port; the reply is still a binary frame //
+      port->notify_mode = port->notify_ascii;
+      break;
+    }
+
+  outbuf_append(&port->output, frame, bin_encode_response(frame, &reply));
+
+  return terminate;
+}
+
+// ********** report_memory ********** //
+// reply with the memory held by the register table of the port, //
+// as "<registers>;<table bytes>;<distinct bounds>;<arena used>;  //
+// <arena reserved>"                                              //
+void report_memory(port_t *port)
+{
+  char reply[112]; // enough for the five numbers //
+  size_t table, descriptors, used, reserved;
+
+  regstore_usage(port->regs, &table, &descriptors, &used, &reserved);
+  snprintf(reply, sizeof(reply), "%d;%zu;%zu;%zu;%zu\n",
+           regstore_count(port->regs), table, descriptors, used, reserved);
+  send_reply(port, reply);
+}
+
+// ********** format_run ********** //
+// write a run of AT+LIST, "REGa..REGb:<bounds>" or "REGa:<bounds>", //
+// or without the bounds if they are NULL, and the ';' if more runs  //
+// follow; returns the length it needs, as snprintf                  //
+int format_run(char *buffer, size_t size, int first, int last, const char *bounds, int more)
+{
+  if (last > first)
+    {
+      return snprintf(buffer, size, "REG%d..REG%d%s%s%s", first, last, bounds != NULL ? ":" : "",
+                      bounds != NULL ? bounds : "", more ? ";" : "");
+    }
+
+  return snprintf(buffer, size, "REG%d%s%s%s", first, bounds != NULL ? ":" : "", bounds != NULL ? bounds : "", more ? ";" : "");
+}
+
+// ********** process_list ********** //
+// reply to "AT+LIST" or "AT+LIST=REGn" with the registers of the  //
+// table from the first, or from REGn, as runs of registers one    //
+// after the other that share their bounds, "REGa..REGb:<bounds>"  //
+// or "REGa:<bounds>", separated by ';'; as many runs as fit in    //
+// one reply are sent, and a reply ending in ';' is followed by    //
+// more runs, from the register after its last one on; a table of  //
+// ten thousand alike registers is a single run. A run is never    //
+// cut: one too long for a whole reply, e.g. in a fixed frame, is  //
+// sent without its bounds, to be asked for with AT+REGa=?         //
+void process_list(port_t *port, const char *target)
+{
+  char reply[MAX_LIST + 1]; // the runs //
+  size_t length = 0, limit = port->frame_mode == FRAME_FIXED ? FIXED_FRAME_SIZE : MAX_LIST;
+  int first = target == NULL ? 1 : slice_regid(slice_of(target)), count = regstore_count(port->regs), last;
+  const boundsdesc_t *desc = NULL;
+  int needed;
+
+  if (first < 1)
+    {
+      stats_add(STAT_BADREGS, 1);
+      send_reply(port, "INVALID REGISTER\n");
+      return;
+    }
+
+  reply[0] = '\0';
+  for (int index = first; index <= count; index = last + 1)
+    {
+      desc = regstore_find(port->regs, index)->desc;
+      for (last = index; last < count && regstore_find(port->regs, last + 1)->desc == desc; last++)
+        {
+          continue;
+        }
+
+      needed = format_run(reply + length, sizeof(reply) - length, index, last, desc->bounds, last < count);
+      if (length + needed > limit)
+        {
+          // a run that does not fit is left for the next reply, unless it is the first //
+          if (length > 0)
+            {
+              break;
+            }
+
+          needed = format_run(reply, sizeof(reply), index, last, NULL, last < count);
+          if ((size_t)needed > limit)
+            {
+              last = index; // a single register always fits //
+              needed = format_run(reply, sizeof(reply), index, last, NULL, last < count);
+            }
+        }
+
+      length += needed;
+    }
+
+  reply[length] = '\0';
+  send_reply(port, reply);
+}
+
+// ********** report_stats ********** //
+// reply with the request statistics of the server, see stats_format //
+void report_stats(port_t *port)
+{
+  char reply[STATS_REPLY_MAX + 1];
+  size_t length;
+
+  length = stats_format(reply, STATS_REPLY_MAX);
+  reply[length] = '\n';
+  reply[length + 1] = '\0';
+  send_reply(port, reply);
+}
+
+// ********** drop_subscriptions ********** //
+// remove the subscriptions of a port within the given registers //
+// and free their pending changes; the caller holds the output   //
+// lock                                                          //
+void drop_subscriptions(port_t *port, int first, int last)
+{
+  int kept = 0;
+
+  for (int i = 0; i < port->numofsubs; i++)
+    {
+      if (port->subs[i].first >= first && port->subs[i].last <= last)
+        {
+          free(port->subs[i].pending);
+          atomic_fetch_sub(&subscriptions, 1);
+        }
+      else
+        {
+          port->subs[kept++] = port->subs[i];
+        }
+    }
+
+  port->numofsubs = kept;
+}
+
+// ********** process_subscribe ********** //
+// subscribe the port to "REGa[..REGb][,<ms>]": every change of //
+// one of the registers is pushed to the client, at most once   //
+// every <ms> milliseconds per register if given; returns 0 on  //
+// success and 1 if the registers or the interval are invalid   //
+int process_subscribe(port_t *port, const char *target)
+{
+  subscription_t *sub = NULL;
+  slice_t interval_part = slice_of(target), range;
+  int interval = 0;
+  int first, last;
+
+  slice_split(&interval_part, ',', &range);
+  if (interval_part.ptr != NULL && (slice_int(interval_part, &interval) != 0 || interval < 0))
+    {
+      send_reply(port, "INVALID INPUT\n");
+      return 1;
+    }
+
+  if (parse_regrange(range, &first, &last) != 0 || regstore_find(port->regs, last) == NULL)
+    {
+      send_reply(port, "INVALID REGISTER\n");
+      return 1;
+    }
+
+  if (port->numofsubs == port->subssize)
+    {
+      port->subssize = port->subssize ? port->subssize * 2 : 4;
+      port->subs = (subscription_t *)realloc(port->subs, port->subssize * sizeof(subscription_t));
+      if (port->subs == NULL)
+        {
+          fprintf(stderr, "Memory allocation error in subscription\n");
+          exit(1);
+        }
+    }
+
+  sub = &port->subs[port->numofsubs++];
+  memset(sub, 0, sizeof(*sub));
+  sub->first = first;
+  sub->last = last;
+  sub->interval = interval;
+  atomic_fetch_add(&subscriptions, 1);
+
+  log_debug("Subscribed to REG%d..REG%d every %d ms\n", first, last, sub->interval);
+  send_reply(port, "OK\n");
+  return 0;
+}
+
+// ********** process_unsubscribe ********** //
+// drop the subscriptions within "REGa[..REGb]", or all of them //
+// if target is NULL; returns 0 on success and 1 if the         //
+// registers are invalid                                         //
+int process_unsubscribe(port_t *port, const char *target)
+{
+  int first = 0, last = INT_MAX;
+
+  if (target != NULL && parse_regrange(slice_of(target), &first, &last) != 0)
+    {
+      send_reply(port, "INVALID REGISTER\n");
+      return 1;
+    }
+
+  drop_subscriptions(port, first, last);
+  send_reply(port, "OK\n");
+  return 0;
+}
+
+// ********** process_baud ********** //
+// negotiate the speed of the port: the client offers the highest //
+// baud rate it supports, and the port switches to the highest    //
+// one both sides support, up to the configured maxspeed, once    //
+// the reply is out, see flush_port; "AT+BAUD" alone reports the  //
+// current speed; the reply is "BAUD <speed>"                      //
+void process_baud(port_t *port, const char *offer)
+{
+  char reply[32];
+  int limit = port->line.maxspeed > port->line.speed ? port->line.maxspeed : port->line.speed;
+  int speed = port->line.speed;
+
+  if (offer != NULL)
+    {
+      speed = best_speed(atoi(offer) < limit ? atoi(offer) : limit);
+      if (speed == 0)
+        {
+          send_reply(port, "INVALID INPUT\n");
+          return;
+        }
+
+      if (speed != port->line.speed)
+        {
+          log_info("Switching %s to %d baud\n", port->name, speed);
+          port->next_speed = speed;
+        }
+    }
+
+  snprintf(reply, sizeof(reply), "BAUD %d\n", speed);
+  send_reply(port, reply);
+}
+
+// ********** process_request ********** //
+// function to process a single request from the client //
+// returns 1 if it was a termination request, 0 if not  //
+int process_request(port_t *port, char *request)
+{
+  // atcommand_res is used to check the result of the process_atcommand function for debugging purposes //
+  int atcommand_res;
+
+  log_debug("Client request: %s\n", request);
+  request = strip_tag(port, request);
+
+  // only the register requests may follow a held write or a read, see hold_write //
+  if (strncmp(request, "AT+REG", 6) != 0)
+    {
+      release_write(port);
+      port->read_index = 0;
+    }
+
+  if (strncmp(request, "bulkinsert+", 11) == 0)
+    {
+      log_debug("Got bulk insertion request from client\n");
+      stats_add(STAT_BULKINSERTS, 1);
+      process_bulkinsert(port, request + 11);
+    }
+  else if (strncmp(request, "block+", 6) == 0)
+    {
+      log_debug("Got block insertion request from client\n");
+      stats_add(STAT_BLOCKS, 1);
+      process_block_insert(port, request + 6);
+    }
+  else if (strncmp(request, "insert", 6) == 0)
+    {
+      // add a new register to the table and inform the client //
+      log_debug("Got insertion request from client\n");
+      stats_add(STAT_INSERTS, 1);
+      if (process_insertion(port->regs, request) < 0)
+        {
+          send_reply(port, "INVALID INPUT\n");
+        }
+      else
+        {
+          send_reply(port, "INSERTION COMPLETE\n");
+        }
+    }
+  else if (strcmp(request, "AT+BIN") == 0)
+    {
+      // the requests after this one are read as FRAME_BINARY, see service_port //
+      stats_add(STAT_OTHER, 1);
+      log_info("Got binary mode request from client\n");
+      send_reply(port, "OK\n");
+      port->notify_ascii = port->frame_mode;
+      port->notify_mode = FRAME_BINARY;
+    }
+  else if (strncmp(request, "AT+SUB=", 7) == 0)
+    {
+      stats_add(STAT_OTHER, 1);
+      process_subscribe(port, request + 7);
+    }
+  else if (strcmp(request, "AT+UNSUB") == 0 || strncmp(request, "AT+UNSUB=", 9) == 0)
+    {
+      stats_add(STAT_OTHER, 1);
+      process_unsubscribe(port, request[8] == '=' ? request + 9 : NULL);
+    }
+  else if (strcmp(request, "AT+LIST") == 0 || strncmp(request, "AT+LIST=", 8) == 0)
+    {
+      stats_add(STAT_OTHER, 1);
+      process_list(port, request[7] == '=' ? request + 8 : NULL);
+    }
+  else if (strcmp(request, "AT+MEM") == 0)
+    {
+      stats_add(STAT_OTHER, 1);
+      report_memory(port);
+    }
+  else if (strcmp(request, "AT+STATS") == 0)
+    {
+      stats_add(STAT_OTHER, 1);
+      report_stats(port);
+    }
+  else if (strcmp(request, "AT+BAUD") == 0 || strncmp(request, "AT+BAUD=", 8) == 0)
+    {
+      stats_add(STAT_OTHER, 1);
+      process_baud(port, request[7] == '=' ? request + 8 : NULL);
+    }
+  else if (strncmp(request, "quit", 4) == 0)
+    {
+      log_info("Got termination request from client. Bye\n");
+      stats_add(STAT_OTHER, 1);
+      send_reply(port, "TERMINATING\n");
+      return 1;
+    }
+  else
+    {
+      long long started = stats_start_timer();
+
+      atcommand_res = process_atcommand(port, request); // process the AT-Command //
+      stats_stop_timer(TIME_ATCOMMAND, started);
+      if (atcommand_res == 0)
+        {
+          log_debug("OK!\n");
+        }
+    }
+
+  return 0;
+}
+
+// ********** open_port ********** //
+// open a serial port for the event loop and register it with epoll //
+// returns 0 on success and -1 on failure                           //
+int open_port(port_t *port, const char *name, int mode, int sync_writes, int own_table)
+{
+  struct epoll_event event;
+
+  port->name = name;
+  port->frame_mode = mode;
+  port->ascii_mode = mode == FRAME_BINARY ? FRAME_LINE : mode;
+  port->notify_mode = mode;
+  port->notify_ascii = port->ascii_mode;
+  port->reply_tag[0] = '\0';
+  atomic_init(&port->terminated, 0);
+  pthread_mutex_init(&port->output_lock, NULL);
+  frame_reader_init(&port->reader, mode);
+  outbuf_init(&port->output);
+  port->commit_wait = 0;
+
+  // each port either works on its own table or on the shared one //
+  if (own_table)
+    {
+      init_reglist(&port->own_regs);
+      port->regs = &port->own_regs;
+    }
+  else
+    {
+      port->regs = &shared_regs;
+    }
+
+  // writes are buffered and coalesced, synchronous writes are opt-in //
+  port->fd = my_open(name, O_RDWR | O_NOCTTY | O_NONBLOCK | (sync_writes ? O_SYNC : 0));
+  if (port->fd < 0)
+    {
+      log_error("ERROR: Open syscall failed from server for %s\n", name);
+      return -1;
+    }
+
+  // set the serial port attributes, i.e baud rate and parity //
+  port->line = line_config;
+  port->next_speed = 0;
+  set_interface_attributes(port->fd, &port->line);
+
+  event.events = EPOLLIN;
+  event.data.ptr = port;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, port->fd, &event) != 0)
+    {
+      perror("epoll_ctl");
+      my_close(port->fd);
+      port->fd = -1;
+      return -1;
+    }
+
+  log_info("Server port is: %s\n", name);
+  return 0;
+}
+
+// ********** close_port ********** //
+// stop serving a port and close it; its subscriptions are //
+// dropped, as the workers may be notifying it; the rest of //
+// what the port holds is freed by free_port, once no worker //
+// may be using it                                           //
+void close_port(port_t *port)
+{
+  if (port->fd < 0)
+    {
+      return;
+    }
+
+  pthread_mutex_lock(&port->output_lock);
+  drop_subscriptions(port, 0, INT_MAX);
+  epoll_ctl(epfd, EPOLL_CTL_DEL, port->fd, NULL);
+  my_close(port->fd); // close the port //
+  port->fd = -1;
+  pthread_mutex_unlock(&port->output_lock);
+}
+
+// ********** free_port ********** //
+// free the replies, the subscriptions and the own table of a port //
+void free_port(port_t *port)
+{
+  free(port->subs);
+  free(port->changes);
+  outbuf_free(&port->output);
+  pthread_mutex_destroy(&port->output_lock);
+  if (port->regs == &port->own_regs)
+    {
+      clear_regs(&port->own_regs);
+    }
+}
+
+// ********** hold_output ********** //
+// tell if the queued replies of a port are kept back, as the  //
+// changes of the calling thread they may tell of are not on  //
+// the disk yet; the event loop flushes them once they are, as //
+// the log wakes it up; the caller holds the output lock       //
+int hold_output(port_t *port)
+{
+  int result;
+
+  if (wal.store == NULL || port->output.len == 0)
+    {
+      return 0;
+    }
+
+  if (wal_position > port->commit_wait)
+    {
+      port->commit_wait = wal_position;
+    }
+  if (port->commit_wait == 0 || (result = wal_durable(&wal, port->commit_wait)) == 0)
+    {
+      return port->commit_wait != 0;
+    }
+
+  if (result < 0)
+    {
+      log_error("ERROR: The changes are not in the log\n");
+    }
+  port->commit_wait = 0;
+  return 0;
+}
+
+// ********** flush_port ********** //
+// write out the queued replies of a port; if the port cannot   //
+// take them all now, epoll reports when it can take the rest;  //
+// a speed negotiated with AT+BAUD is switched to after them;   //
+// the caller holds the output lock                             //
+void flush_port(port_t *port)
+{
+  struct epoll_event event;
+  ssize_t bytes_written;
+  int held = hold_output(port);
+
+  if (port->output.len > 0 && !held)
+    {
+      stats_add(STAT_WRITE_CALLS, 1);
+      if ((bytes_written = outbuf_flush(&port->output, port->fd)) < 0)
+        {
+          log_error("ERROR: Write failed on %s\n", port->name);
+        }
+      else
+        {
+          stats_add(STAT_BYTES_OUT, bytes_written);
+          stats_add(STAT_PARTIAL_WRITES, port->output.len > 0);
+        }
+    }
+
+  // a negotiated speed is taken once the reply has left at the old one //
+  if (port->next_speed != 0 && port->output.len == 0)
+    {
+      tcdrain(port->fd);
+      port->line.speed = port->next_speed;
+      port->next_speed = 0;
+      set_interface_attributes(port->fd, &port->line);
+    }
+
+  event.events = port->output.len > 0 && !held ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  event.data.ptr = port;
+  epoll_ctl(epfd, EPOLL_CTL_MOD, port->fd, &event);
+}
+
+// ********** compare_indexes ********** //
+// qsort comparison function for register indexes //
+int compare_indexes(const void *a, const void *b)
+{
+  int x = *(const int *)a, y = *(const int *)b;
+
+  return (x > y) - (x < y);
+}
+
+// ********** send_notification ********** //
+// queue an unsolicited "!REGn=<value>" frame with the current //
+// value of a register, or a BIN_NOTIFY frame in binary mode;  //
+// the caller holds the output lock                            //
+void send_notification(port_t *port, int index)
+{
+  registers_t *current = regstore_find(port->regs, index);
+  char text[MAX_NOTIFICATION];
+  uint8_t frame[BIN_FRAME_MAX];
+  binmsg_t msg;
+
+  if (port->notify_mode == FRAME_BINARY)
+    {
+      memset(&msg, 0, sizeof(msg));
+      msg.opcode = BIN_NOTIFY;
+      msg.status = BIN_OK;
+      msg.index = index;
+      msg.value = register_get(current);
+      outbuf_append(&port->output, frame, bin_encode_response(frame, &msg));
+      return;
+    }
+
+  snprintf(text, sizeof(text), "!REG%d=%d\n", index, register_get(current));
+  frame_append(&port->output, port->notify_mode, text);
+}
+
+// ********** add_pending ********** //
+// keep a changed register until the interval of the subscription //
+// is over; when the pending registers fill their room the         //
+// duplicates are dropped first, as a register is sent only once   //
+void add_pending(subscription_t *sub, int index)
+{
+  size_t kept = 0;
+
+  if (sub->numofpending == sub->pendingsize)
+    {
+      if (sub->pendingsize > 0)
+        {
+          qsort(sub->pending, sub->numofpending, sizeof(int), compare_indexes);
+          for (size_t i = 0; i < sub->numofpending; i++)
+            {
+              if (kept == 0 || sub->pending[kept - 1] != sub->pending[i])
+                {
+                  sub->pending[kept++] = sub->pending[i];
+                }
+            }
+          sub->numofpending = kept;
+        }
+
+      // still mostly distinct registers; make room //
+      if (sub->pendingsize == 0 || sub->numofpending > sub->pendingsize / 2)
+        {
+          sub->pendingsize = sub->pendingsize ? sub->pendingsize * 2 : 16;
+          sub->pending = (int *)realloc(sub->pending, sub->pendingsize * sizeof(int));
+          if (sub->pending == NULL)
+            {
+              fprintf(stderr, "Memory allocation error in notification\n");
+              exit(1);
+            }
+        }
+    }
+
+  sub->pending[sub->numofpending++] = index;
+}
+
+// ********** send_pending ********** //
+// queue one notification for every pending register of a //
+// subscription, and start its next interval; the caller  //
+// holds the output lock                                  //
+void send_pending(port_t *port, subscription_t *sub, long long now)
+{
+  qsort(sub->pending, sub->numofpending, sizeof(int), compare_indexes);
+  for (size_t i = 0; i < sub->numofpending; i++)
+    {
+      if (i == 0 || sub->pending[i - 1] != sub->pending[i])
+        {
+          send_notification(port, sub->pending[i]);
+        }
+    }
+
+  sub->numofpending = 0;
+  sub->next_send = now + sub->interval;
+}
+
+// ********** notify_port ********** //
+// tell a port the registers written by a request it subscribed //
+// to; returns 1 if notifications were queued, 0 if not, and 2  //
+// if some are left pending for the event loop to send, see      //
+// flush_subscriptions; the caller holds the output lock         //
+int notify_port(port_t *port, const int *changes, size_t numofchanges, long long now)
+{
+  subscription_t *sub = NULL;
+  int queued = 0, scheduled = 0;
+
+  for (int i = 0; i < port->numofsubs; i++)
+    {
+      sub = &port->subs[i];
+      for (size_t j = 0; j < numofchanges; j++)
+        {
+          if (changes[j] < sub->first || changes[j] > sub->last)
+            {
+              continue;
+            }
+
+          if (sub->interval == 0)
+            {
+              send_notification(port, changes[j]);
+              queued = 1;
+            }
+          else
+            {
+              scheduled |= sub->numofpending == 0; // the event loop does not know of it yet //
+              add_pending(sub, changes[j]);
+            }
+        }
+
+      if (sub->numofpending > 0 && now >= sub->next_send)
+        {
+          send_pending(port, sub, now);
+          queued = 1;
+        }
+    }
+
+  for (int i = 0; i < port->numofsubs && scheduled; i++)
+    {
+      if (port->subs[i].numofpending > 0)
+        {
+          return 2;
+        }
+    }
+
+  return queued;
+}
+
+// ********** commit_changes ********** //
+// wait for the changes the thread made to be in the log, //
+// before any reply or notification tells of them         //
+void commit_changes(void)
+{
+  if (wal.store != NULL && wal_commit(&wal) != 0)
+    {
+      log_error("ERROR: The changes are not in the log\n");
+    }
+}
+
+// ********** publish_changes ********** //
+// notify every port sharing the table of the registers written //
+// by the request just executed on the given port; called       //
+// without any output lock held, as it takes them one by one    //
+void publish_changes(port_t *port)
+{
+  port_t *target = NULL;
+  long long now;
+  uint64_t one = 1;
+  int result, wake = 0;
+
+  if (port->numofchanges == 0)
+    {
+      return;
+    }
+
+  if (workers > 0)
+    {
+      commit_changes(); // the event loop holds the notifications back instead, see hold_output //
+    }
+  now = monotonic_ms();
+  for (int i = 0; i < numofports; i++)
+    {
+      target = &ports[i];
+      if (target->regs != port->regs)
+        {
+          continue;
+        }
+
+      pthread_mutex_lock(&target->output_lock);
+      if (target->fd >= 0 && !atomic_load(&target->terminated) && target->numofsubs > 0)
+        {
+          result = notify_port(target, port->changes, port->numofchanges, now);
+          wake |= result == 2;
+
+          // the replies of the port itself are written out after the request //
+          if (result != 0 && target != port)
+            {
+              flush_port(target);
+            }
+        }
+      pthread_mutex_unlock(&target->output_lock);
+    }
+
+  port->numofchanges = 0;
+
+  // the event loop sends the pending notifications; it must hear of new ones //
+  if (wake && write(wakefd, &one, sizeof(one)) != sizeof(one))
+    {
+      log_error("ERROR: Could not wake up the event loop\n");
+    }
+}
+
+// ********** flush_subscriptions ********** //
+// called by the event loop to send the pending notifications //
+// whose interval is over; returns the milliseconds until the //
+// next ones are due, or -1 if there are none                 //
+int flush_subscriptions(void)
+{
+  subscription_t *sub = NULL;
+  long long now, next = -1;
+  int queued;
+
+  if (atomic_load(&subscriptions) == 0)
+    {
+      return -1;
+    }
+
+  now = monotonic_ms();
+  for (int i = 0; i < numofports; i++)
+    {
+      pthread_mutex_lock(&ports[i].output_lock);
+      queued = 0;
+      for (int j = 0; j < ports[i].numofsubs && ports[i].fd >= 0 && !atomic_load(&ports[i].terminated); j++)
+        {
+          sub = &ports[i].subs[j];
+          if (sub->numofpending == 0)
+            {
+              continue;
+            }
+
+          if (now >= sub->next_send)
+            {
+              send_pending(&ports[i], sub, now);
+              queued = 1;
+            }
+          else if (next < 0 || sub->next_send < next)
+            {
+              next = sub->next_send;
+            }
+        }
+
+      if (queued)
+        {
+          flush_port(&ports[i]);
+        }
+      pthread_mutex_unlock(&ports[i].output_lock);
+    }
+
+  return next < 0 ? -1 : (int)(next - now);
+}
+
+// ********** execute_request ********** //
+// execute a request framed in the given mode and queue its reply //
+// returns 1 if it was a termination request, 0 if not            //
+int execute_request(port_t *port, int mode, char *request, size_t length)
+{
+  int terminate;
+  long long started = stats_start_timer();
+
+  stats_add(STAT_REQUESTS, 1);
+  pthread_mutex_lock(&port->output_lock);
+
+  port->frame_mode = mode; // the reply goes out in the framing of the request //
+  port->notify_mode = mode; // and so do the notifications after it //
+  if (mode == FRAME_BINARY)
+    {
+      release_write(port);
+      port->read_index = 0;
+      terminate = process_binary(port, (const uint8_t *)request, length);
+    }
+  else
+    {
+      terminate = process_request(port, request);
+    }
+
+  pthread_mutex_unlock(&port->output_lock);
+
+  publish_changes(port); // without the lock, as it takes the locks of the subscribers //
+  stats_stop_timer(TIME_REQUEST, started);
+
+  return terminate;
+}
+
+// ********** end_burst ********** //
+// called once the requests read together on a port are executed, //
+// before their replies go out: store the write held back and, on  //
+// a worker, wait for the log; the event loop never waits for it,  //
+// it holds the replies back, see hold_output; a read is not       //
+// reused past the burst                                           //
+void end_burst(port_t *port)
+{
+  release_write(port);
+  port->read_index = 0;
+  publish_changes(port);
+  if (workers > 0)
+    {
+      commit_changes();
+    }
+}
+
+// ********** release_port ********** //
+// called by a worker once a port is done with: write out the //
+// last replies and let the event loop close the port         //
+void release_port(port_t *port)
+{
+  uint64_t one = 1;
+
+  end_burst(port);
+  pthread_mutex_lock(&port->output_lock);
+  flush_port(port);
+  pthread_mutex_unlock(&port->output_lock);
+
+  atomic_store(&port->terminated, 1);
+  if (write(wakefd, &one, sizeof(one)) != sizeof(one))
+    {
+      log_error("ERROR: Could not wake up the event loop\n");
+    }
+}
+
+// ********** execute_job ********** //
+// worker function, execute a request handed over by the event loop //
+void execute_job(workitem_t *item)
+{
+  port_t *port = (port_t *)item->owner;
+
+  if (atomic_load(&port->terminated))
+    {
+      return; // requests after the termination request are dropped //
+    }
+
+  if (item->kind == JOB_HANGUP)
+    {
+      release_port(port);
+    }
+  else if (execute_request(port, item->kind, item->data, item->length))
+    {
+      release_port(port);
+    }
+}
+
+// ********** finish_jobs ********** //
+// worker function, called after the last request of a port //
+// in the queue; all the replies go out in a single write   //
+void finish_jobs(void *owner)
+{
+  port_t *port = (port_t *)owner;
+
+  if (atomic_load(&port->terminated))
+    {
+      return;
+    }
+
+  end_burst(port);
+  pthread_mutex_lock(&port->output_lock);
+  flush_port(port);
+  pthread_mutex_unlock(&port->output_lock);
+}
+
+// ********** service_port ********** //
+// read what arrived on a port and execute every complete request, //
+// or hand them to the worker of the port; returns 1 if the client  //
+// sent a termination request and the port may be closed, -1 if      //
+// nothing could be read, e.g. from a port hung up, and 0 otherwise  //
+int service_port(port_t *port)
+{
+  char *request; // client request //
+  size_t length;
+  binmsg_t msg;
+  ssize_t bytes_read;
+  int mode, terminate = 0;
+
+  if ((bytes_read = frame_fill(&port->reader, port->fd)) < 0)
+    {
+      return -1;
+    }
+  stats_add(STAT_READ_CALLS, 1);
+  stats_add(STAT_BYTES_IN, bytes_read);
+  if (bytes_read == 0)
+    {
+      return -1; // nothing new, and so no new request either //
+    }
+
+  // a single read may hold several requests, or just a part of one; //
+  // a request may also switch the framing mode of the ones after it, //
+  // which is decided here, before the request is even executed       //
+  while (!terminate)
+    {
+      mode = port->reader.mode;
+      if (mode == FRAME_BINARY)
+        {
+          if ((request = (char *)bin_next_frame(&port->reader, &length)) == NULL)
+            {
+              break;
+            }
+          if (request[0] == BIN_ASCII && bin_decode_request((const uint8_t *)request, length, &msg) == 0)
+            {
+              port->reader.mode = port->ascii_mode;
+            }
+        }
+      else
+        {
+          if ((request = frame_next(&port->reader)) == NULL)
+            {
+              break;
+            }
+          length = strlen(request);
+          if (strcmp(request + tag_length(mode, request), "AT+BIN") == 0)
+            {
+              port->ascii_mode = mode;
+              port->reader.mode = FRAME_BINARY;
+            }
+        }
+
+      if (workers > 0)
+        {
+          workpool_submit(&pool, port->shard, workitem_new(port, mode, request, length));
+        }
+      else
+        {
+          terminate = execute_request(port, mode, request, length);
+        }
+    }
+
+  // the bytes left over are the start of a request still to come //
+  stats_add(STAT_PARTIAL_READS, port->reader.len > port->reader.start);
+
+  // all the replies to this read go out in a single write; //
+  // the port is closed after a termination request, so the  //
+  // replies before it cannot be held back for the log       //
+  if (workers == 0)
+    {
+      end_burst(port);
+      if (terminate)
+        {
+          commit_changes();
+        }
+      pthread_mutex_lock(&port->output_lock);
+      flush_port(port);
+      pthread_mutex_unlock(&port->output_lock);
+    }
+
+  return terminate;
+}
+
+// ********** main program ********** //
+int main(int argc, char *argv[])
+{
+  int option, count, open_ports = 0;
+  int hangup, result; // the events of a port, and what reading it gave //
+  port_t *port = NULL;
+  struct epoll_event events[MAX_EVENTS];
+  struct epoll_event event;
+  uint64_t wakeups;
+  int level = LOG_INFO; // the log level //
+  int sync_writes = 0; // set to open the ports with O_SYNC //
+  int mode = FRAME_FIXED; // the framing mode of the ports //
+  int own_tables = 0; // set to give every port its own register table //
+  const char *snapshot_path = NULL; // the snapshot file of the shared table, if any //
+  int snapshot_interval = SNAPSHOT_INTERVAL; // milliseconds between two snapshots //
+  snapshot_t snap;
+  const char *log_path = NULL; // the mutation log of the shared table, if any //
+  int log_window = WAL_WINDOW; // milliseconds the changes are gathered for one fsync //
+  int replayed = 0; // the number of changes replayed from the log //
+  int loaded = 0; // set if the table was loaded from the snapshot //
+  const char *definitions_path = NULL; // the register definition file, if any //
+  int stats_interval = 0; // milliseconds between two logged statistics, 0 for none //
+
+  line_config_init(&line_config);
+
+  // check the options, i.e. the framing mode, the log level, synchronous //
+  // writes, whether the ports share the register table, the workers, the //
+  // snapshot file with its interval, the mutation log with its window,  //
+  // the register definitions and the line settings: speed, format, flow //
+  // control, config file, max speed, and the statistics: the interval   //
+  // to log them and whether to time                                     //
+  while ((option = getopt(argc, argv, "m:l:yiw:d:s:L:g:f:b:o:rC:n:t:T")) != -1)
+    {
+      if (option == 'm' && parse_frame_mode(optarg) != -1)
+        {
+          mode = parse_frame_mode(optarg);
+        }
+      else if (option == 'l' && parse_log_level(optarg) != -1)
+        {
+          level = parse_log_level(optarg);
+        }
+      else if (option == 'y')
+        {
+          sync_writes = 1;
+        }
+      else if (option == 'i')
+        {
+          own_tables = 1;
+        }
+      else if (option == 'w' && atoi(optarg) > 0)
+        {
+          workers = atoi(optarg);
+        }
+      else if (option == 'd')
+        {
+          snapshot_path = optarg;
+        }
+      else if (option == 's' && atoi(optarg) > 0)
+        {
+          snapshot_interval = atoi(optarg);
+        }
+      else if (option == 'L')
+        {
+          log_path = optarg;
+        }
+      else if (option == 'g' && atoi(optarg) >= 0)
+        {
+          log_window = atoi(optarg);
+        }
+      else if (option == 'f')
+        {
+          definitions_path = optarg;
+        }
+      else if (option == 'b' && speed_constant(atoi(optarg)) != B0)
+        {
+          line_config.speed = atoi(optarg);
+        }
+      else if (option == 'o' && parse_line_format(optarg, &line_config) == 0)
+        {
+          continue;
+        }
+      else if (option == 'r')
+        {
+          line_config.rtscts = 1;
+        }
+      else if (option == 'C' && load_line_config(optarg, &line_config) == 0)
+        {
+          continue;
+        }
+      else if (option == 'n' && atoi(optarg) > 0)
+        {
+          line_config.maxspeed = atoi(optarg);
+        }
+      else if (option == 't' && atoi(optarg) > 0)
+        {
+          stats_interval = atoi(optarg);
+        }
+      else if (option == 'T')
+        {
+          stats_timing = 1;
+        }
+      else
+        {
+          fprintf(stderr, "Usage: %s [-m fixed|line|binary] [-l error|warn|info|debug] [-y] [-i] [-w workers] "
+                  "[-d snapshot file] [-s snapshot interval ms] [-L log file] [-g group commit ms] [-f register definitions] [-b baud] [-o 8N1] [-r] "
+                  "[-C line config] [-n max negotiated baud] [-t stats interval ms] [-T] <serial port>...\n", argv[0]);
+          return 1;
+        }
+    }
+
+  // the snapshot keeps the shared table only //
+  if (snapshot_path != NULL && own_tables)
+    {
+      fprintf(stderr, "ERROR: A snapshot file cannot be used with -i\n");
+      return 1;
+    }
+
+  // the log is compacted into the snapshot, and replayed on it //
+  if (log_path != NULL && snapshot_path == NULL)
+    {
+      fprintf(stderr, "ERROR: The log needs a snapshot file (-d)\n");
+      return 1;
+    }
+
+  // check argument count //
+  if (optind >= argc)
+    {
+      fprintf(stderr, "ERROR: You must specify a serial port name\n");
+      return 1;
+    }
+
+  if (log_start(level) != 0)
+    {
+      fprintf(stderr, "ERROR: Could not start the logger\n");
+      return 1;
+    }
+
+  // every remaining argument is a serial port to serve //
+  count = argc - optind;
+  ports = (port_t *)calloc(count, sizeof(port_t));
+  numofports = count;
+  epfd = epoll_create1(0);
+  if (ports == NULL || epfd < 0)
+    {
+      log_error("ERROR: Could not set up the event loop\n");
+      log_stop();
+      return 1;
+    }
+
+  // the workers and the notifications wake the event loop up //
+  // through an eventfd, which is the only event without a port //
+  wakefd = eventfd(0, EFD_NONBLOCK);
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;
+  if (wakefd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &event) != 0)
+    {
+      log_error("ERROR: Could not set up the event loop\n");
+      log_stop();
+      return 1;
+    }
+
+  if (workers > 0)
+    {
+      if (workpool_start(&pool, workers, execute_job, finish_jobs) != 0)
+        {
+          log_error("ERROR: Could not start the workers\n");
+          log_stop();
+          return 1;
+        }
+      log_info("Executing the requests with %d workers\n", workers);
+    }
+
+  log_info("Scanning the requests with the %s loops\n", scan_implementation());
+
+  if (stats_interval > 0 && stats_start(stats_interval) != 0)
+    {
+      log_error("ERROR: Could not start logging the statistics\n");
+    }
+
+  // create the table of registers, or get it back from the snapshot //
+  if (snapshot_path == NULL)
+    {
+      init_reglist(&shared_regs);
+      if (definitions_path != NULL && !own_tables && provision_table(&shared_regs, definitions_path) != 0)
+        {
+          log_stop();
+          return 1;
+        }
+    }
+  else
+    {
+      regstore_init(&shared_regs);
+      loaded = snapshot_open(&snap, snapshot_path, &shared_regs);
+      if (loaded < 0)
+        {
+          log_error("ERROR: %s is not a valid snapshot file\n", snapshot_path);
+          log_stop();
+          return 1;
+        }
+      else if (loaded == 0)
+        {
+          add_default_registers(&shared_regs);
+        }
+      else
+        {
+          log_info("Loaded %d registers from %s\n", regstore_count(&shared_regs), snapshot_path);
         }
+
+      if (loaded == 0 && definitions_path != NULL && provision_table(&shared_regs, definitions_path) != 0)
+        {
+          log_stop();
+          return 1;
+        }
+      else if (loaded == 1 && definitions_path != NULL)
+        {
+          log_info("Not adding the registers of %s again, the table is from the snapshot\n", definitions_path);
+        }
+
+      // the changes since the last snapshot, before any port is open //
+      if (log_path != NULL)
+        {
+          if ((replayed = wal_open(&wal, log_path, &shared_regs, loaded == 1)) < 0)
+            {
+              log_error("ERROR: %s is not a valid log of %s\n", log_path, snapshot_path);
+              log_stop();
+              return 1;
+            }
+          log_info("Replayed %d changes from %s\n", replayed, log_path);
+          snap.log = &wal;
+        }
+
+      if (snapshot_start(&snap, snapshot_interval) != 0)
+        {
+          log_error("ERROR: Could not start the snapshot of %s\n", snapshot_path);
+          log_stop();
+          return 1;
+        }
+
+      if (log_path != NULL && wal_start(&wal, log_window, workers == 0 ? wakefd : -1) != 0)
+        {
+          log_error("ERROR: Could not start the log %s\n", log_path);
+          log_stop();
+          return 1;
+        }
+    }
+
+  for (int i = 0; i < count; i++)
+    {
+      ports[i].shard = i;
+      if (open_port(&ports[i], argv[optind + i], mode, sync_writes, own_tables) == 0)
+        {
+          open_ports++;
+        }
+
+      // every table of its own gets the registers of the definition file //
+      if (own_tables && definitions_path != NULL && provision_table(ports[i].regs, definitions_path) != 0)
+        {
+          log_stop();
+          return 1;
+        }
+    }
+
+  // main loop to read and process requests from the clients; a port is //
+  // closed when its client sends a termination request or it hangs up; //
+  // the loop also sends the notifications held back by an interval     //
+  while (open_ports > 0)
+    {
+      int ready = epoll_wait(epfd, events, MAX_EVENTS, flush_subscriptions());
+
+      if (ready < 0 && errno != EINTR)
+        {
+          perror("epoll_wait");
+          break;
+        }
+
+      for (int i = 0; i < ready; i++)
+        {
+          port = (port_t *)events[i].data.ptr;
+          if (port == NULL)
+            {
+              // a worker is done with some ports, close them; or  //
+              // a notification is pending, see flush_subscriptions; //
+              // or the log is on the disk, the replies held go out  //
+              if (read(wakefd, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN)
+                {
+                  perror("read");
+                }
+              for (int j = 0; j < count; j++)
+                {
+                  if (ports[j].fd >= 0 && atomic_load(&ports[j].terminated))
+                    {
+                      close_port(&ports[j]);
+                      open_ports--;
+                    }
+                  else if (workers == 0 && ports[j].fd >= 0 && ports[j].commit_wait != 0)
+                    {
+                      pthread_mutex_lock(&ports[j].output_lock);
+                      flush_port(&ports[j]);
+                      pthread_mutex_unlock(&ports[j].output_lock);
+                    }
+                }
+              continue;
+            }
+
+          if (port->fd < 0 || atomic_load(&port->terminated))
+            {
+              continue; // closed, or about to be closed //
+            }
+
+          if (events[i].events & EPOLLOUT)
+            {
+              pthread_mutex_lock(&port->output_lock);
+              flush_port(port);
+              pthread_mutex_unlock(&port->output_lock);
+            }
+
+          // a port hung up is read until nothing is left, then closed; //
+          // left in the epoll set it would be reported again at once  //
+          hangup = events[i].events & (EPOLLHUP | EPOLLERR);
+          result = 0;
+          if (events[i].events & EPOLLIN)
+            {
+              while ((result = service_port(port)) == 0 && hangup)
+                {
+                  continue;
+                }
+            }
+
+          if (result == 1)
+            {
+              close_port(port);
+              open_ports--;
+            }
+          else if (hangup)
+            {
+              log_error("ERROR: The serial port %s was closed\n", port->name);
+              if (workers > 0)
+                {
+                  // stop watching the port; it is closed once its //
+                  // worker is done with the requests before it   //
+                  epoll_ctl(epfd, EPOLL_CTL_DEL, port->fd, NULL);
+                  workpool_submit(&pool, port->shard, workitem_new(port, JOB_HANGUP, "", 0));
+                }
+              else
+                {
+                  close_port(port);
+                  open_ports--;
+                }
+            }
+        }
+    }
+
+  if (workers > 0)
+    {
+      workpool_stop(&pool); // let the workers finish //
+    }
+  for (int i = 0; i < count; i++)
+    {
+      close_port(&ports[i]);
+      free_port(&ports[i]);
     }
 
-  my_close(fd); // close the port //
+  free(ports);
+  my_close(epfd);
+
+  if (snapshot_path != NULL)
+    {
+      snapshot_stop(&snap); // the last snapshot, after the last request //
+    }
+
+  if (log_path != NULL)
+    {
+      wal_stop(&wal); // empty now, the last snapshot holds all the changes //
+    }
+  my_close(wakefd); // after the log, which may still tell of a write //
+
+  clear_regs(&shared_regs); // clear the table and free all the allocated memory //
+
+  stats_stop(); // the last statistics, after the last request //
 
-  clear_regs(); // clear the list and free all the allocated memory //
+  log_stop(); // write out the remaining messages //
 
   return 0;
 }
@@ -0,0 +1,216 @@
+// String slices of the request parser //
+// Author: Vangelis Bakas //
+// Last Edited: 2/2/2023 //
+
+#include "slice.h"
+#include "scan.h"
+#include <string.h>
+#include <limits.h>
+
+// ********** slice_of ********** //
+// the slice of a whole string; a NULL string gives no slice //
+slice_t slice_of(const char *string)
+{
+  slice_t slice = { string, string != NULL ? strlen(string) : 0 };
+
+  return slice;
+}
+
+// ********** slice_token ********** //
+// take the next token of rest up to a separator, skipping empty //
+// tokens like strtok does; returns 0 with the token, or -1 if   //
+// rest holds nothing but separators                             //
+int slice_token(slice_t *rest, char separator, slice_t *token)
+{
+  const char *end;
+
+  while (rest->ptr != NULL && rest->len > 0 && *rest->ptr == separator)
+    {
+      rest->ptr++;
+      rest->len--;
+    }
+
+  if (rest->ptr == NULL || rest->len == 0)
+    {
+      token->ptr = NULL;
+      token->len = 0;
+      return -1;
+    }
+
+  token->ptr = rest->ptr;
+  end = (const char *)memchr(rest->ptr, separator, rest->len);
+  token->len = end != NULL ? (size_t)(end - rest->ptr) : rest->len;
+
+  rest->ptr += token->len;
+  rest->len -= token->len;
+
+  return 0;
+}
+
+// ********** slice_split ********** //
+// take the part of rest up to the first separator, which may be //
+// empty; after the last part rest is no slice at all; returns 0 //
+// with the part, or -1 if rest is no slice                      //
+int slice_split(slice_t *rest, char separator, slice_t *token)
+{
+  const char *end;
+
+  *token = *rest;
+  if (rest->ptr == NULL)
+    {
+      return -1;
+    }
+
+  end = (const char *)memchr(rest->ptr, separator, rest->len);
+  if (end == NULL)
+    {
+      rest->ptr = NULL;
+      rest->len = 0;
+      return 0;
+    }
+
+  token->len = end - rest->ptr;
+  rest->len -= token->len + 1;
+  rest->ptr = end + 1;
+
+  return 0;
+}
+
+// ********** slice_find ********** //
+// find a string in a slice; returns its offset, or -1 //
+int slice_find(slice_t haystack, const char *needle)
+{
+  size_t length = strlen(needle);
+  const char *found = haystack.ptr, *end = haystack.ptr + haystack.len;
+
+  if (haystack.ptr == NULL || length == 0 || length > haystack.len)
+    {
+      return haystack.ptr != NULL && length == 0 ? 0 : -1;
+    }
+
+  // only where the first byte matches is the rest compared //
+  while ((found = (const char *)memchr(found, needle[0], end - found - length + 1)) != NULL)
+    {
+      if (memcmp(found, needle, length) == 0)
+        {
+          return (int)(found - haystack.ptr);
+        }
+      found++;
+    }
+
+  return -1;
+}
+
+// ********** slice_equal ********** //
+// check if a slice holds exactly the given string //
+int slice_equal(slice_t slice, const char *string)
+{
+  return slice.ptr != NULL && strlen(string) == slice.len && memcmp(slice.ptr, string, slice.len) == 0;
+}
+
+// ********** slice_prefix ********** //
+// check if a slice starts with the given string //
+int slice_prefix(slice_t slice, const char *prefix)
+{
+  size_t length = strlen(prefix);
+
+  return slice.ptr != NULL && length <= slice.len && memcmp(slice.ptr, prefix, length) == 0;
+}
+
+// ********** slice_atoi ********** //
+// convert the number a slice starts with, the way atoi converts //
+// a string: leading spaces and a sign are taken, the rest after //
+// the digits is ignored, and a slice without digits gives 0     //
+int slice_atoi(slice_t slice)
+{
+  size_t i = 0;
+  long number = 0;
+  int negative = 0;
+
+  while (i < slice.len && (slice.ptr[i] == ' ' || (slice.ptr[i] >= '\t' && slice.ptr[i] <= '\r')))
+    {
+      i++;
+    }
+
+  if (i < slice.len && (slice.ptr[i] == '-' || slice.ptr[i] == '+'))
+    {
+      negative = slice.ptr[i++] == '-';
+    }
+
+  // long numbers are taken 8 digits at a time //
+  for (uint32_t eight; i + 8 <= slice.len && scan_digits8(slice.ptr + i, &eight); i += 8)
+    {
+      if (number > (long)((LONG_MAX - eight) / 100000000))
+        {
+          return (int)(negative ? LONG_MIN : LONG_MAX);
+        }
+      number = number * 100000000 + eight;
+    }
+
+  for (; i < slice.len && slice.ptr[i] >= '0' && slice.ptr[i] <= '9'; i++)
+    {
+      // like strtol, out of range numbers stop at the ends of a long //
+      if (number > (LONG_MAX - (slice.ptr[i] - '0')) / 10)
+        {
+          return (int)(negative ? LONG_MIN : LONG_MAX);
+        }
+      number = number * 10 + (slice.ptr[i] - '0');
+    }
+
+  return (int)(negative ? -number : number);
+}
+
+// ********** slice_int ********** //
+// convert a slice that is a whole int and nothing else, with //
+// optional leading spaces and sign; returns 0 on success and  //
+// -1 if it is not                                             //
+int slice_int(slice_t slice, int *value)
+{
+  size_t i = 0;
+  long long number = 0;
+  int negative = 0;
+
+  if (slice.ptr == NULL)
+    {
+      return -1;
+    }
+
+  // leading spaces are taken, as by strtol //
+  while (i < slice.len && (slice.ptr[i] == ' ' || (slice.ptr[i] >= '\t' && slice.ptr[i] <= '\r')))
+    {
+      i++;
+    }
+
+  if (i < slice.len && (slice.ptr[i] == '-' || slice.ptr[i] == '+'))
+    {
+      negative = slice.ptr[i++] == '-';
+    }
+
+  if (i == slice.len)
+    {
+      return -1;
+    }
+
+  for (uint32_t eight; i + 8 <= slice.len && number <= INT_MAX && scan_digits8(slice.ptr + i, &eight); i += 8)
+    {
+      number = number * 100000000 + eight;
+    }
+
+  for (; i < slice.len; i++)
+    {
+      if (slice.ptr[i] < '0' || slice.ptr[i] > '9' || number > (long long)INT_MAX + 1)
+        {
+          return -1;
+        }
+      number = number * 10 + (slice.ptr[i] - '0');
+    }
+
+  number = negative ? -number : number;
+  if (number < INT_MIN || number > INT_MAX)
+    {
+      return -1;
+    }
+
+  *value = (int)number;
+  return 0;
+}
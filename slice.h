@@ -0,0 +1,48 @@
+// Header file for the string slices of the request parser //
+// Author: Vangelis Bakas //
+// Last Edited: 2/2/2023 //
+
+/* A slice is a pointer into a string and a length, so a request is split
+into its parts where it was received, without writing '\0' into it and
+without copying the parts out. The bytes are only copied once, when they
+are kept, e.g. the bounds of a new register, see arena_strndup.
+
+slice_token splits like strtok, skipping empty parts, and slice_split like
+strchr, keeping them; neither has any state but the slice it is given.
+*/
+
+#ifndef __SLICE_H_
+#define __SLICE_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Structs //
+// Slice Struct //
+// A part of a string; ptr is NULL for no part at all, which //
+// is not the same as an empty part                          //
+struct slice{
+	const char *ptr; // the first byte of the part //
+	size_t len; // the number of bytes, not '\0' terminated //
+};
+
+typedef struct slice slice_t;
+
+// Function Prototypes //
+slice_t slice_of(const char *string);
+int slice_token(slice_t *rest, char separator, slice_t *token);
+int slice_split(slice_t *rest, char separator, slice_t *token);
+int slice_find(slice_t haystack, const char *needle);
+int slice_equal(slice_t slice, const char *string);
+int slice_prefix(slice_t slice, const char *prefix);
+int slice_atoi(slice_t slice);
+int slice_int(slice_t slice, int *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
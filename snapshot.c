@@ -0,0 +1,533 @@
+// Register table snapshot of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+#include "snapshot.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+// ********** map_file ********** //
+// map an open file of the given size for reading and writing //
+// returns the mapping, or NULL on failure                    //
+static unsigned char *map_file(int fd, size_t size)
+{
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  return map == MAP_FAILED ? NULL : (unsigned char *)map;
+}
+
+// ********** copy_blocks ********** //
+// copy the blocks from the given one on into the file, as long //
+// as all their registers are among the first count; returns    //
+// the number of blocks in the file then                        //
+static uint64_t copy_blocks(snapshot_t *snap, unsigned char *map, uint64_t from, int count)
+{
+  snapheader_t *header = (snapheader_t *)map;
+  uint32_t *blocks = (uint32_t *)(map + header->blocksoffset);
+  regblock_t *block;
+
+  // a block is added after its registers, so the blocks //
+  // beyond count are the last ones, and wait for the next snapshot //
+  for (; (block = regstore_find_block(snap->store, (int)from + 1)) != NULL; from++)
+    {
+      if (block->first + block->count - 1 > count)
+        {
+          break;
+        }
+
+      blocks[2 * from] = (uint32_t)block->first;
+      blocks[2 * from + 1] = (uint32_t)block->count;
+    }
+
+  return from;
+}
+
+// ********** write_full ********** //
+// write the whole table into a new file, with room for twice as //
+// many registers and bounds, and replace the old file with it   //
+// returns 0 on success and -1 on failure                        //
+static int write_full(snapshot_t *snap)
+{
+  char *tmppath = NULL;
+  int count = regstore_count(snap->store), fd;
+  uint64_t boundssize = 0, numofbounds = 0, capacity, boundscapacity;
+  snapheader_t *header;
+  unsigned char *map;
+  int32_t *values;
+  uint32_t *boundsids;
+  size_t size;
+
+  // the bounds strings, once each; a descriptor first //
+  // appears at a register in the order of the ids     //
+  for (int i = 0; i < count; i++)
+    {
+      const boundsdesc_t *desc = regstore_find(snap->store, i + 1)->desc;
+
+      if (desc->id == numofbounds)
+        {
+          boundssize += strlen(desc->bounds) + 1;
+          numofbounds++;
+        }
+    }
+
+  capacity = 2 * (uint64_t)count > SNAPSHOT_MIN_REGISTERS ? 2 * (uint64_t)count : SNAPSHOT_MIN_REGISTERS;
+  boundscapacity = 2 * boundssize > SNAPSHOT_MIN_BOUNDS ? 2 * boundssize : SNAPSHOT_MIN_BOUNDS;
+  size = ALIGN8(sizeof(snapheader_t)) + ALIGN8(capacity * sizeof(int32_t))
+         + ALIGN8(capacity * sizeof(uint32_t)) + ALIGN8(boundscapacity) + REGSTORE_MAX_BLOCKS * 2 * sizeof(uint32_t);
+
+  tmppath = (char *)malloc(strlen(snap->path) + 5);
+  if (tmppath == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in snapshot\n");
+      exit(1);
+    }
+  sprintf(tmppath, "%s.tmp", snap->path);
+
+  fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ftruncate(fd, (off_t)size) != 0 || (map = map_file(fd, size)) == NULL)
+    {
+      log_error("ERROR: Could not write the snapshot %s: %s\n", tmppath, strerror(errno));
+      if (fd >= 0)
+        {
+          close(fd);
+        }
+      free(tmppath);
+      return -1;
+    }
+
+  header = (snapheader_t *)map;
+  memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+  header->version = SNAPSHOT_VERSION;
+  header->headersize = sizeof(snapheader_t);
+  header->generation = snap->map != NULL ? ((snapheader_t *)snap->map)->generation + 1 : 1;
+  header->capacity = capacity;
+  header->boundscapacity = boundscapacity;
+  header->valuesoffset = ALIGN8(sizeof(snapheader_t));
+  header->boundsidsoffset = header->valuesoffset + ALIGN8(capacity * sizeof(int32_t));
+  header->boundsoffset = header->boundsidsoffset + ALIGN8(capacity * sizeof(uint32_t));
+  header->blockscapacity = REGSTORE_MAX_BLOCKS; // always room for all of them //
+  header->blocksoffset = header->boundsoffset + ALIGN8(boundscapacity);
+
+  // every chunk is written now, so none is left changed //
+  for (int i = 0; i < REGSTORE_MAX_CHUNKS; i++)
+    {
+      atomic_exchange_explicit(&snap->store->dirty[i], 0, memory_order_acquire); // see regstore_touch //
+    }
+
+  values = (int32_t *)(map + header->valuesoffset);
+  boundsids = (uint32_t *)(map + header->boundsidsoffset);
+  boundssize = numofbounds = 0;
+  for (int i = 0; i < count; i++)
+    {
+      registers_t *current = regstore_find(snap->store, i + 1);
+
+      values[i] = register_get(current);
+      boundsids[i] = current->desc->id;
+      if (current->desc->id == numofbounds)
+        {
+          strcpy((char *)map + header->boundsoffset + boundssize, current->desc->bounds);
+          boundssize += strlen(current->desc->bounds) + 1;
+          numofbounds++;
+        }
+    }
+
+  header->count = count;
+  header->numofbounds = numofbounds;
+  header->boundssize = boundssize;
+  header->numofblocks = copy_blocks(snap, map, 0, count);
+
+  if (msync(map, size, MS_SYNC) != 0 || rename(tmppath, snap->path) != 0)
+    {
+      log_error("ERROR: Could not write the snapshot %s: %s\n", snap->path, strerror(errno));
+      munmap(map, size);
+      close(fd);
+      unlink(tmppath);
+      free(tmppath);
+      return -1;
+    }
+
+  // the new file replaces the old one //
+  if (snap->map != NULL)
+    {
+      munmap(snap->map, snap->mapsize);
+      close(snap->fd);
+    }
+
+  snap->map = map;
+  snap->mapsize = size;
+  snap->fd = fd;
+  free(tmppath);
+
+  // or a crash may still find the old file, and the log dropped //
+  if (sync_parent_dir(snap->path) != 0)
+    {
+      log_error("ERROR: Could not write the snapshot %s: %s\n", snap->path, strerror(errno));
+      return -1;
+    }
+
+  return 0;
+}
+
+// ********** snapshot_open ********** //
+// open the snapshot file of a table; if it exists, the empty table //
+// is filled from it; returns 1 if the table was loaded, 0 if there  //
+// is no snapshot yet and -1 if the file is not a valid snapshot     //
+int snapshot_open(snapshot_t *snap, const char *path, regstore_t *store)
+{
+  struct stat st;
+  snapheader_t *header;
+  char **bounds = NULL;
+  const char *next, *end;
+  int result = 1;
+
+  memset(snap, 0, sizeof(*snap));
+  snap->fd = -1;
+  snap->store = store;
+  store->tracked = 1; // the writes mark their chunks from now on //
+  snap->path = strdup(path);
+  if (snap->path == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in snapshot\n");
+      exit(1);
+    }
+
+  snap->fd = open(path, O_RDWR);
+  if (snap->fd < 0)
+    {
+      return errno == ENOENT ? 0 : -1;
+    }
+
+  if (fstat(snap->fd, &st) != 0 || (size_t)st.st_size < sizeof(snapheader_t)
+      || (snap->map = map_file(snap->fd, (size_t)st.st_size)) == NULL)
+    {
+      close(snap->fd);
+      snap->fd = -1;
+      return -1;
+    }
+
+  snap->mapsize = (size_t)st.st_size;
+  header = (snapheader_t *)snap->map;
+
+  // check the layout before trusting any of it; a version 1 header //
+  // ends before the blocks, and none of them may be read           //
+  if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+      || (header->version == SNAPSHOT_VERSION ? header->headersize != sizeof(snapheader_t)
+          : header->version != SNAPSHOT_VERSION_NOBLOCKS || header->headersize != offsetof(snapheader_t, numofblocks))
+      || header->capacity > snap->mapsize || header->boundscapacity > snap->mapsize
+      || header->count > header->capacity || header->count > (uint64_t)REGSTORE_MAX_CHUNKS * REGSTORE_CHUNK_SIZE
+      || header->boundssize > header->boundscapacity || header->numofbounds > header->boundssize
+      || header->valuesoffset + header->capacity * sizeof(int32_t) > header->boundsidsoffset
+      || header->boundsidsoffset + header->capacity * sizeof(uint32_t) > header->boundsoffset
+      || header->boundsoffset + header->boundscapacity > snap->mapsize
+      || header->valuesoffset % 8 != 0 || header->boundsidsoffset % 8 != 0)
+    {
+      result = -1;
+    }
+
+  if (result == 1 && header->version == SNAPSHOT_VERSION
+      && (header->blockscapacity > REGSTORE_MAX_BLOCKS || header->numofblocks > header->blockscapacity
+          || header->blocksoffset < header->boundsoffset + header->boundscapacity || header->blocksoffset % 8 != 0
+          || header->blocksoffset + header->blockscapacity * 2 * sizeof(uint32_t) > snap->mapsize))
+    {
+      result = -1;
+    }
+
+  // the bounds strings, back to back //
+  if (result == 1)
+    {
+      bounds = (char **)malloc((header->numofbounds + 1) * sizeof(char *));
+      if (bounds == NULL)
+        {
+          fprintf(stderr, "Memory allocation error in snapshot\n");
+          exit(1);
+        }
+
+      next = (const char *)snap->map + header->boundsoffset;
+      end = next + header->boundssize;
+      for (uint64_t i = 0; i < header->numofbounds && result == 1; i++)
+        {
+          const char *nul = memchr(next, '\0', end - next);
+
+          if (nul == NULL)
+            {
+              result = -1;
+              break;
+            }
+          bounds[i] = (char *)next;
+          next = nul + 1;
+        }
+
+      if (result == 1 && next != end)
+        {
+          result = -1;
+        }
+    }
+
+  if (result == 1 && regstore_load(store, (int)header->count, (const int32_t *)(snap->map + header->valuesoffset),
+                                   (const uint32_t *)(snap->map + header->boundsidsoffset),
+                                   bounds, (unsigned int)header->numofbounds) != 0)
+    {
+      result = -1;
+    }
+
+  // the blocks, once their registers are in //
+  if (result == 1 && header->version == SNAPSHOT_VERSION)
+    {
+      const uint32_t *blocks = (const uint32_t *)(snap->map + header->blocksoffset);
+
+      for (uint64_t i = 0; i < header->numofblocks && result == 1; i++)
+        {
+          if (blocks[2 * i] > INT32_MAX || blocks[2 * i + 1] > INT32_MAX
+              || regstore_define_block(store, (int)blocks[2 * i], (int)blocks[2 * i + 1]) != (int)i + 1)
+            {
+              result = -1;
+            }
+        }
+    }
+
+  free(bounds);
+
+  if (result < 0)
+    {
+      munmap(snap->map, snap->mapsize);
+      close(snap->fd);
+      snap->map = NULL;
+      snap->fd = -1;
+    }
+
+  return result;
+}
+
+// ********** sync_table ********** //
+// copy the changed chunks and the new registers into the file and //
+// publish them; returns 0 on success and -1 on failure            //
+static int sync_table(snapshot_t *snap)
+{
+  snapheader_t *header;
+  int32_t *values;
+  uint32_t *boundsids;
+  uint64_t numofbounds, boundssize, numofblocks;
+  int count = regstore_count(snap->store), changed = 0;
+
+  if (snap->map == NULL)
+    {
+      return write_full(snap);
+    }
+
+  // a version 1 file has no room for the blocks //
+  header = (snapheader_t *)snap->map;
+  if ((uint64_t)count > header->capacity || header->version != SNAPSHOT_VERSION)
+    {
+      return write_full(snap);
+    }
+
+  // the bounds that are new since the last snapshot must fit too //
+  numofbounds = header->numofbounds;
+  boundssize = header->boundssize;
+  for (int i = (int)header->count; i < count; i++)
+    {
+      const boundsdesc_t *desc = regstore_find(snap->store, i + 1)->desc;
+
+      if (desc->id == numofbounds)
+        {
+          boundssize += strlen(desc->bounds) + 1;
+          numofbounds++;
+        }
+    }
+
+  if (boundssize > header->boundscapacity)
+    {
+      return write_full(snap);
+    }
+
+  values = (int32_t *)(snap->map + header->valuesoffset);
+  boundsids = (uint32_t *)(snap->map + header->boundsidsoffset);
+
+  // the values written since the last snapshot //
+  for (int chunk = 0; chunk <= ((int)header->count - 1) >> REGSTORE_CHUNK_BITS && header->count > 0; chunk++)
+    {
+      int first = chunk << REGSTORE_CHUNK_BITS;
+      int last = first + REGSTORE_CHUNK_SIZE < (int)header->count ? first + REGSTORE_CHUNK_SIZE : (int)header->count;
+
+      if (!atomic_exchange_explicit(&snap->store->dirty[chunk], 0, memory_order_acquire)) // see regstore_touch //
+        {
+          continue;
+        }
+
+      for (int i = first; i < last; i++)
+        {
+          values[i] = register_get(regstore_find(snap->store, i + 1));
+        }
+      changed = 1;
+    }
+
+  // and the registers inserted since then //
+  numofbounds = header->numofbounds;
+  boundssize = header->boundssize;
+  for (int i = (int)header->count; i < count; i++)
+    {
+      registers_t *current = regstore_find(snap->store, i + 1);
+
+      values[i] = register_get(current);
+      boundsids[i] = current->desc->id;
+      if (current->desc->id == numofbounds)
+        {
+          strcpy((char *)snap->map + header->boundsoffset + boundssize, current->desc->bounds);
+          boundssize += strlen(current->desc->bounds) + 1;
+          numofbounds++;
+        }
+      changed = 1;
+    }
+
+  // and the blocks added since then //
+  numofblocks = copy_blocks(snap, snap->map, header->numofblocks, count);
+  changed = changed || numofblocks != header->numofblocks;
+
+  if (!changed)
+    {
+      return 0;
+    }
+
+  // the data reaches the disk before the header points to it //
+  if (msync(snap->map, snap->mapsize, MS_SYNC) != 0)
+    {
+      log_error("ERROR: Could not write the snapshot %s: %s\n", snap->path, strerror(errno));
+      return -1;
+    }
+
+  header->count = count;
+  header->numofbounds = numofbounds;
+  header->boundssize = boundssize;
+  header->numofblocks = numofblocks;
+  header->generation++;
+
+  if (msync(snap->map, sizeof(snapheader_t), MS_SYNC) != 0)
+    {
+      log_error("ERROR: Could not write the snapshot %s: %s\n", snap->path, strerror(errno));
+      return -1;
+    }
+
+  return 0;
+}
+
+// ********** snapshot_main ********** //
+// the background thread, takes a snapshot every interval //
+static void *snapshot_main(void *arg)
+{
+  snapshot_t *snap = (snapshot_t *)arg;
+  struct timespec deadline;
+
+  pthread_mutex_lock(&snap->lock);
+  while (!snap->stopping)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += snap->interval / 1000;
+      deadline.tv_nsec += (long)(snap->interval % 1000) * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L)
+        {
+          deadline.tv_sec++;
+          deadline.tv_nsec -= 1000000000L;
+        }
+
+      if (pthread_cond_timedwait(&snap->wakeup, &snap->lock, &deadline) == ETIMEDOUT && !snap->stopping)
+        {
+          pthread_mutex_unlock(&snap->lock);
+          snapshot_sync(snap);
+          pthread_mutex_lock(&snap->lock);
+        }
+    }
+  pthread_mutex_unlock(&snap->lock);
+
+  return NULL;
+}
+
+// ********** snapshot_sync ********** //
+// take a snapshot, and drop the records of the log it holds; //
+// returns 0 on success and -1 on failure                     //
+int snapshot_sync(snapshot_t *snap)
+{
+  uint64_t mark = snap->log != NULL ? wal_mark(snap->log) : 0; // before the table is copied //
+  int result = sync_table(snap);
+
+  if (result == 0 && snap->log != NULL)
+    {
+      wal_compact(snap->log, mark);
+    }
+
+  return result;
+}
+
+// ********** snapshot_start ********** //
+// write the first snapshot if there is none, and start taking //
+// one every interval milliseconds; returns 0 on success and -1 //
+// on failure                                                   //
+int snapshot_start(snapshot_t *snap, int interval)
+{
+  pthread_condattr_t attr;
+
+  if (snapshot_sync(snap) != 0)
+    {
+      return -1;
+    }
+
+  snap->interval = interval;
+  snap->stopping = 0;
+  pthread_mutex_init(&snap->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&snap->wakeup, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (pthread_create(&snap->thread, NULL, snapshot_main, snap) != 0)
+    {
+      return -1;
+    }
+
+  snap->running = 1;
+  return 0;
+}
+
+// ********** snapshot_stop ********** //
+// stop the background thread, take a last snapshot and close the file //
+void snapshot_stop(snapshot_t *snap)
+{
+  if (snap->running)
+    {
+      pthread_mutex_lock(&snap->lock);
+      snap->stopping = 1;
+      pthread_cond_signal(&snap->wakeup);
+      pthread_mutex_unlock(&snap->lock);
+
+      pthread_join(snap->thread, NULL);
+      pthread_mutex_destroy(&snap->lock);
+      pthread_cond_destroy(&snap->wakeup);
+      snap->running = 0;
+    }
+
+  if (snapshot_sync(snap) == 0)
+    {
+      log_info("Snapshot written to %s\n", snap->path);
+    }
+
+  if (snap->map != NULL)
+    {
+      munmap(snap->map, snap->mapsize);
+      close(snap->fd);
+      snap->map = NULL;
+      snap->fd = -1;
+    }
+
+  free(snap->path);
+  snap->path = NULL;
+}
@@ -0,0 +1,91 @@
+// Header file for the register table snapshot of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+/* The snapshot keeps a copy of a register table in a memory-mapped file, so
+a restarted server gets its registers back with a single mmap, instead of
+starting from the two default registers.
+
+The file starts with a snapheader and holds four arrays: the values of the
+registers, the bounds id of every register, the distinct bounds strings,
+back to back and '\0' terminated, in the order of their ids, and the first
+register and the size of every register block. The arrays have room to
+grow; when they are full the whole file is written again, twice as large.
+All the numbers are in the byte order of the machine. A version 1 file, from
+before the blocks, is loaded as a table without blocks and written again in
+the current layout on the next snapshot.
+
+The request path never waits for the disk: the writes only mark the chunk
+of the register as changed (see regstore_touch), and a background thread
+copies the changed chunks and the new registers into the file, msyncs them
+and only then publishes them in the header, every interval milliseconds.
+With a mutation log, every snapshot on the disk compacts the log: the records
+it holds are dropped from it, see wal.h.
+*/
+
+#ifndef __SNAPSHOT_H_
+#define __SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "regstore.h"
+#include "wal.h"
+
+// Preprocessor //
+#define SNAPSHOT_MAGIC "SERCOMM" // the first 8 bytes of a snapshot file, with the '\0' //
+#define SNAPSHOT_VERSION 2 // raised whenever the layout changes //
+#define SNAPSHOT_VERSION_NOBLOCKS 1 // the layout without the blocks, still loaded //
+#define SNAPSHOT_INTERVAL 1000 // default milliseconds between two snapshots //
+#define SNAPSHOT_MIN_REGISTERS 4096 // the least room for registers in a new file //
+#define SNAPSHOT_MIN_BOUNDS 65536 // the least room for bounds strings in a new file //
+
+// Structs //
+// Snapshot Header Struct //
+// The on-disk header; the offsets are from the start of the file //
+struct snapheader{
+	char magic[8]; // SNAPSHOT_MAGIC //
+	uint32_t version; // SNAPSHOT_VERSION //
+	uint32_t headersize; // sizeof(struct snapheader) //
+	uint64_t generation; // incremented by every snapshot //
+	uint64_t count; // the number of registers in the snapshot //
+	uint64_t capacity; // room for registers in the values and bounds id arrays //
+	uint64_t numofbounds; // the number of distinct bounds strings //
+	uint64_t boundssize; // the bytes of the bounds strings //
+	uint64_t boundscapacity; // room for bounds strings, in bytes //
+	uint64_t valuesoffset; // int32_t values[capacity] //
+	uint64_t boundsidsoffset; // uint32_t bounds ids[capacity] //
+	uint64_t boundsoffset; // char bounds[boundscapacity] //
+	uint64_t numofblocks; // the number of register blocks, from version 2 on //
+	uint64_t blockscapacity; // room for blocks in the blocks array //
+	uint64_t blocksoffset; // uint32_t blocks[2 * blockscapacity], first register and size //
+};
+
+typedef struct snapheader snapheader_t;
+
+// Snapshot Struct //
+struct snapshot{
+	char *path; // the snapshot file //
+	int fd; // the open snapshot file, -1 if there is none yet //
+	unsigned char *map; // the mapped file //
+	size_t mapsize; // the size of the mapping //
+	regstore_t *store; // the table kept in the file //
+	wal_t *log; // the mutation log compacted by the snapshots, or NULL //
+	int interval; // milliseconds between two snapshots //
+	int running; // set while the background thread runs //
+	int stopping; // set to stop the background thread //
+	pthread_t thread; // the background thread //
+	pthread_mutex_t lock; // guards stopping //
+	pthread_cond_t wakeup; // signalled to stop the background thread //
+};
+
+typedef struct snapshot snapshot_t;
+
+// Function Prototypes //
+int snapshot_open(snapshot_t *snap, const char *path, regstore_t *store);
+int snapshot_start(snapshot_t *snap, int interval);
+int snapshot_sync(snapshot_t *snap);
+void snapshot_stop(snapshot_t *snap);
+
+#endif
@@ -0,0 +1,276 @@
+// Request statistics of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 1/2/2023 //
+
+#include "stats.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+// Globals //
+int stats_timing = 0;
+_Thread_local statsblock_t *stats_block = NULL;
+static statsblock_t *blocks = NULL; // the blocks of all the threads //
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER; // guards blocks //
+
+static const char *counter_names[STAT_COUNTERS] = {
+  "req", "read", "bounds", "write", "batch", "block", "insert", "bulk", "binary", "other", "invalid",
+  "reject", "badreg", "coalesced", "reused", "in", "out", "rcalls", "wcalls", "rpartial", "wpartial"
+};
+static const char *timer_names[STAT_TIMERS] = { "request", "atcmd", "lookup" };
+
+// the periodic dump //
+static int dump_interval; // milliseconds between two dumps //
+static int dumping; // set while the dump thread runs //
+static int dump_stopping; // set to stop the dump thread //
+static pthread_t dumper;
+static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER; // guards dump_stopping //
+static pthread_cond_t dump_wakeup;
+
+// ********** stats_register ********** //
+// give the calling thread a block of its own, the first time //
+// it counts; returns the block                               //
+statsblock_t *stats_register(void)
+{
+  // a cache line of its own, so the threads never share one //
+  statsblock_t *block = (statsblock_t *)aligned_alloc(64, (sizeof(statsblock_t) + 63) / 64 * 64);
+
+  if (block == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in stats\n");
+      exit(1);
+    }
+  memset(block, 0, sizeof(*block));
+
+  pthread_mutex_lock(&blocks_lock);
+  block->next = blocks;
+  blocks = block;
+  pthread_mutex_unlock(&blocks_lock);
+
+  stats_block = block;
+  return block;
+}
+
+// ********** stats_clock ********** //
+// current time of the monotonic clock, in nanoseconds //
+long long stats_clock(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// ********** stats_record ********** //
+// add the time since started to the histogram of a timer //
+void stats_record(int timer, long long started)
+{
+  statsblock_t *block = stats_block != NULL ? stats_block : stats_register();
+  unsigned long long elapsed = (unsigned long long)(stats_clock() - started);
+  int bucket = elapsed == 0 ? 0 : 64 - __builtin_clzll(elapsed);
+  atomic_ulong *value = &block->times[timer][bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1];
+
+  atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// ********** add_up ********** //
+// add up the blocks of all the threads //
+static void add_up(unsigned long *counters, unsigned long times[][STATS_BUCKETS])
+{
+  memset(counters, 0, STAT_COUNTERS * sizeof(unsigned long));
+  memset(times, 0, STAT_TIMERS * STATS_BUCKETS * sizeof(unsigned long));
+
+  pthread_mutex_lock(&blocks_lock);
+  for (statsblock_t *block = blocks; block != NULL; block = block->next)
+    {
+      for (int i = 0; i < STAT_COUNTERS; i++)
+        {
+          counters[i] += atomic_load_explicit(&block->counters[i], memory_order_relaxed);
+        }
+      for (int i = 0; i < STAT_TIMERS; i++)
+        {
+          for (int b = 0; b < STATS_BUCKETS; b++)
+            {
+              times[i][b] += atomic_load_explicit(&block->times[i][b], memory_order_relaxed);
+            }
+        }
+    }
+  pthread_mutex_unlock(&blocks_lock);
+}
+
+// ********** percentile ********** //
+// the upper bound, in nanoseconds, of the bucket holding the //
+// given fraction of a histogram; 0 if it is empty            //
+static unsigned long long percentile(const unsigned long *histogram, double fraction)
+{
+  unsigned long total = 0, seen = 0;
+
+  for (int b = 0; b < STATS_BUCKETS; b++)
+    {
+      total += histogram[b];
+    }
+
+  for (int b = 0; b < STATS_BUCKETS && total > 0; b++)
+    {
+      seen += histogram[b];
+      if (seen >= fraction * total)
+        {
+          return 1ULL << b;
+        }
+    }
+
+  return 0;
+}
+
+// ********** format_counters ********** //
+// write the counters first to last as "name=value" pairs //
+static size_t format_counters(char *summary, size_t size, const unsigned long *counters, int first, int last)
+{
+  size_t length = 0;
+
+  for (int i = first; i <= last && length < size; i++)
+    {
+      length += snprintf(summary + length, size - length, "%s%s=%lu", i > first ? " " : "", counter_names[i], counters[i]);
+    }
+
+  return length < size ? length : size - 1;
+}
+
+// ********** format_times ********** //
+// write the p50 and p99 of every timer, in nanoseconds //
+static size_t format_times(char *summary, size_t size, unsigned long times[][STATS_BUCKETS])
+{
+  size_t length = 0;
+
+  for (int i = 0; i < STAT_TIMERS && length < size; i++)
+    {
+      length += snprintf(summary + length, size - length, "%s%s_p50=%lluns %s_p99=%lluns", i > 0 ? " " : "",
+                         timer_names[i], percentile(times[i], 0.50), timer_names[i], percentile(times[i], 0.99));
+    }
+
+  return length < size ? length : size - 1;
+}
+
+// ********** stats_format ********** //
+// write all the statistics on one line of "name=value" pairs, //
+// the times only if they are taken; returns the length        //
+size_t stats_format(char *summary, size_t size)
+{
+  unsigned long counters[STAT_COUNTERS];
+  unsigned long times[STAT_TIMERS][STATS_BUCKETS];
+  size_t length;
+
+  add_up(counters, times);
+  length = format_counters(summary, size, counters, 0, STAT_COUNTERS - 1);
+  if (stats_timing && length + 1 < size)
+    {
+      summary[length++] = ' ';
+      length += format_times(summary + length, size - length, times);
+    }
+
+  return length;
+}
+
+// ********** dump_main ********** //
+// thread function, log the statistics every dump_interval //
+// milliseconds, in lines short enough for the logger      //
+static void *dump_main(void *arg)
+{
+  unsigned long counters[STAT_COUNTERS];
+  unsigned long times[STAT_TIMERS][STATS_BUCKETS];
+  char line[LOG_MSG_MAX];
+  struct timespec deadline;
+  int stopping = 0;
+
+  (void)arg;
+
+  while (!stopping)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += dump_interval / 1000;
+      deadline.tv_nsec += (long)(dump_interval % 1000) * 1000000;
+      if (deadline.tv_nsec >= 1000000000)
+        {
+          deadline.tv_sec++;
+          deadline.tv_nsec -= 1000000000;
+        }
+
+      pthread_mutex_lock(&dump_lock);
+      while (!dump_stopping && pthread_cond_timedwait(&dump_wakeup, &dump_lock, &deadline) == 0)
+        {
+          continue;
+        }
+      stopping = dump_stopping;
+      pthread_mutex_unlock(&dump_lock);
+
+      add_up(counters, times);
+      format_counters(line, sizeof(line), counters, STAT_REQUESTS, STAT_REUSED);
+      log_info("Stats: %s\n", line);
+      format_counters(line, sizeof(line), counters, STAT_BYTES_IN, STAT_PARTIAL_WRITES);
+      log_info("Stats: %s\n", line);
+      if (stats_timing)
+        {
+          format_times(line, sizeof(line), times);
+          log_info("Stats: %s\n", line);
+        }
+    }
+
+  return NULL;
+}
+
+// ********** stats_start ********** //
+// start logging the statistics every interval milliseconds //
+// returns 0 on success and -1 on failure                   //
+int stats_start(int interval)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&dump_wakeup, &attr);
+  pthread_condattr_destroy(&attr);
+
+  dump_interval = interval;
+  dump_stopping = 0;
+  if (pthread_create(&dumper, NULL, dump_main, NULL) != 0)
+    {
+      return -1;
+    }
+
+  dumping = 1;
+  return 0;
+}
+
+// ********** stats_stop ********** //
+// stop the periodic dump, after a last one, and free the blocks; //
+// no thread may count anymore                                   //
+void stats_stop(void)
+{
+  statsblock_t *next = NULL;
+
+  if (dumping)
+    {
+      pthread_mutex_lock(&dump_lock);
+      dump_stopping = 1;
+      pthread_cond_signal(&dump_wakeup);
+      pthread_mutex_unlock(&dump_lock);
+      pthread_join(dumper, NULL);
+      pthread_cond_destroy(&dump_wakeup);
+      dumping = 0;
+    }
+
+  pthread_mutex_lock(&blocks_lock);
+  for (statsblock_t *block = blocks; block != NULL; block = next)
+    {
+      next = block->next;
+      free(block);
+    }
+  blocks = NULL;
+  pthread_mutex_unlock(&blocks_lock);
+
+  stats_block = NULL;
+}
@@ -0,0 +1,112 @@
+// Header file for the request statistics of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 1/2/2023 //
+
+/* Every thread that executes requests counts into a statistics block of its
+own, so counting is a plain add to a cache line no other thread writes. The
+blocks are linked together the first time a thread counts, and AT+STATS or
+the periodic dump add them all up.
+
+The counters are always on. The times, i.e. of a whole request, of an
+AT-command and of a register lookup, need two clock reads each and are only
+taken when stats_timing is set; they are kept as histograms with one bucket
+per power of two nanoseconds.
+*/
+
+#ifndef __STATS_H_
+#define __STATS_H_
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Preprocessor //
+#define STATS_BUCKETS 40 // bucket b holds the times below 2^b ns, the last one the rest //
+#define STATS_REPLY_MAX 768 // the longest summary, see stats_format //
+
+// the counters //
+enum stat_counter{
+	STAT_REQUESTS, // requests executed //
+	STAT_READS, // AT+REGn //
+	STAT_BOUNDS, // AT+REGn=? //
+	STAT_WRITES, // AT+REGn=<int> //
+	STAT_BATCHES, // batches and ranges //
+	STAT_BLOCKS, // block+ and AT+BLKn //
+	STAT_INSERTS, // insert //
+	STAT_BULKINSERTS, // bulkinsert //
+	STAT_BINARY, // binary frames //
+	STAT_OTHER, // AT+BIN, AT+MEM, AT+SUB, AT+BAUD, AT+STATS, quit //
+	STAT_INVALID, // not an accepted command //
+	STAT_REJECTS, // writes out of the register bounds //
+	STAT_BADREGS, // registers not in the table //
+	STAT_COALESCED, // writes overwritten by the next one before being applied //
+	STAT_REUSED, // reads answered with the reply of the same read before //
+	STAT_BYTES_IN, // bytes read from the ports //
+	STAT_BYTES_OUT, // bytes written to the ports //
+	STAT_READ_CALLS, // reads of the ports //
+	STAT_WRITE_CALLS, // flushes of the replies //
+	STAT_PARTIAL_READS, // reads that ended in the middle of a request //
+	STAT_PARTIAL_WRITES, // flushes the port could not take all of //
+	STAT_COUNTERS
+};
+
+// the timed operations //
+enum stat_timer{
+	TIME_REQUEST, // a whole request //
+	TIME_ATCOMMAND, // process_atcommand, parsing and executing //
+	TIME_LOOKUP, // a register lookup in the table //
+	STAT_TIMERS
+};
+
+// Structs //
+// Statistics Block Struct //
+// The counts of one thread; only that thread writes them, so the //
+// atomics are only there for the readers adding the blocks up    //
+struct statsblock{
+	atomic_ulong counters[STAT_COUNTERS]; // see enum stat_counter //
+	atomic_ulong times[STAT_TIMERS][STATS_BUCKETS]; // histograms, see enum stat_timer //
+	struct statsblock *next; // the block of another thread //
+};
+
+typedef struct statsblock statsblock_t;
+
+// Globals //
+extern int stats_timing; // set to take the times as well //
+extern _Thread_local statsblock_t *stats_block; // the block of the calling thread //
+
+// Function Prototypes //
+statsblock_t *stats_register(void);
+long long stats_clock(void);
+void stats_record(int timer, long long started);
+size_t stats_format(char *summary, size_t size);
+int stats_start(int interval);
+void stats_stop(void);
+
+// ********** stats_add ********** //
+// add to a counter of the calling thread //
+static inline void stats_add(int counter, unsigned long count)
+{
+  statsblock_t *block = stats_block != NULL ? stats_block : stats_register();
+  atomic_ulong *value = &block->counters[counter];
+
+  atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + count, memory_order_relaxed);
+}
+
+// ********** stats_start_timer ********** //
+// the start of a timed operation, to hand to stats_stop_timer; //
+// 0 when no times are taken                                   //
+static inline long long stats_start_timer(void)
+{
+  return stats_timing ? stats_clock() : 0;
+}
+
+// ********** stats_stop_timer ********** //
+// the end of a timed operation, started with stats_start_timer //
+static inline void stats_stop_timer(int timer, long long started)
+{
+  if (started != 0)
+    {
+      stats_record(timer, started);
+    }
+}
+
+#endif
@@ -0,0 +1,832 @@
+// Mutation log of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 2/2/2023 //
+
+#include "wal.h"
+#include "binproto.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define WAL_COPY_SIZE 65536 // the bytes copied at a time when the log is compacted //
+#define RECORD_SIZE(length) (sizeof(walrecord_t) + (length)) // the bytes of a record in the log //
+
+// Globals //
+_Thread_local uint64_t wal_position = 0;
+static _Thread_local walbuffer_t *own_buffer = NULL; // the buffer of the calling thread //
+
+// ********** record_crc ********** //
+// the CRC of a record, from its type to the end of its body //
+static uint16_t record_crc(const unsigned char *record, uint32_t length)
+{
+  return bin_crc16(record + offsetof(walrecord_t, type), sizeof(walrecord_t) - offsetof(walrecord_t, type) + length);
+}
+
+// ********** thread_buffer ********** //
+// the buffer of the calling thread, created on its first record //
+static walbuffer_t *thread_buffer(wal_t *wal)
+{
+  if (own_buffer != NULL && own_buffer->wal == wal)
+    {
+      return own_buffer;
+    }
+
+  own_buffer = (walbuffer_t *)malloc(sizeof(walbuffer_t));
+  if (own_buffer == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in log\n");
+      exit(1);
+    }
+  own_buffer->wal = wal;
+  pthread_mutex_init(&own_buffer->lock, NULL);
+  outbuf_init(&own_buffer->pending);
+  outbuf_init(&own_buffer->writing);
+
+  pthread_mutex_lock(&wal->lock);
+  own_buffer->next = wal->buffers;
+  wal->buffers = own_buffer;
+  pthread_mutex_unlock(&wal->lock);
+
+  return own_buffer;
+}
+
+// ********** reserve ********** //
+// take the positions of length bytes of records in the log; the //
+// buffer of the thread is locked until they are copied, so the  //
+// background thread never takes a part of the records reserved  //
+static uint64_t reserve(wal_t *wal, size_t length)
+{
+  return atomic_fetch_add(&wal->appended, length);
+}
+
+// ********** append ********** //
+// copy a record of a head and a tail, e.g. the bounds, reserved //
+// at position into the locked buffer; returns the position after //
+static uint64_t append(walbuffer_t *buffer, uint64_t position, int type,
+                       const void *head, size_t headlength, const void *tail, size_t taillength)
+{
+  walrecord_t record = { .length = (uint32_t)(headlength + taillength), .type = (uint8_t)type };
+  size_t offset = buffer->pending.len + sizeof(position);
+  uint16_t crc;
+
+  if (outbuf_append(&buffer->pending, &position, sizeof(position)) != 0
+      || outbuf_append(&buffer->pending, &record, sizeof(record)) != 0
+      || outbuf_append(&buffer->pending, head, headlength) != 0
+      || (taillength > 0 && outbuf_append(&buffer->pending, tail, taillength) != 0))
+    {
+      fprintf(stderr, "Memory allocation error in log\n");
+      exit(1);
+    }
+
+  crc = record_crc((const unsigned char *)buffer->pending.data + offset, record.length);
+  memcpy(buffer->pending.data + offset + offsetof(walrecord_t, crc), &crc, sizeof(crc));
+
+  wal_position = position + RECORD_SIZE(record.length);
+  return wal_position;
+}
+
+// ********** wake ********** //
+// tell the background thread there are records to write //
+// out, if it is waiting for them                         //
+static void wake(wal_t *wal)
+{
+  if (atomic_load(&wal->sleeping))
+    {
+      pthread_mutex_lock(&wal->lock);
+      pthread_cond_signal(&wal->work);
+      pthread_mutex_unlock(&wal->lock);
+    }
+}
+
+// ********** wait_inserted ********** //
+// a change to a register or block just inserted waits for the //
+// insertion to be appended, so it is replayed after it          //
+static void wait_inserted(wal_t *wal, atomic_int *logged, int id)
+{
+  if (id > atomic_load_explicit(logged, memory_order_acquire))
+    {
+      pthread_mutex_lock(&wal->lock); // held by the insertion until it is appended //
+      pthread_mutex_unlock(&wal->lock);
+    }
+}
+
+// ********** apply ********** //
+// replay a record on the table; a change the table has already,  //
+// from the snapshot, is skipped; returns 0 on success and -1 if  //
+// the record does not fit the table, i.e. the log is not its own //
+static int apply(regstore_t *store, int type, const unsigned char *body, uint32_t length)
+{
+  int values[REGSTORE_BLOCK_MAX];
+  uint32_t head[4];
+  registers_t *reg = NULL;
+  regblock_t *block = NULL;
+  slice_t bounds;
+
+  switch (type)
+    {
+    case WAL_WRITE:
+      if (length != 2 * sizeof(uint32_t))
+        {
+          return -1;
+        }
+      memcpy(head, body, 2 * sizeof(uint32_t));
+      if (head[0] > INT32_MAX || (reg = regstore_find(store, (int)head[0])) == NULL)
+        {
+          return -1;
+        }
+      register_set(reg, (int32_t)head[1]);
+      regstore_touch(store, (int)head[0]);
+      return 0;
+
+    case WAL_INSERT:
+      if (length < 2 * sizeof(uint32_t))
+        {
+          return -1;
+        }
+      memcpy(head, body, 2 * sizeof(uint32_t));
+      if (head[0] <= (uint32_t)regstore_count(store))
+        {
+          return 0;
+        }
+      bounds.ptr = (const char *)body + 2 * sizeof(uint32_t);
+      bounds.len = length - 2 * sizeof(uint32_t);
+      return head[0] == (uint32_t)regstore_count(store) + 1
+             && regstore_add(store, (int32_t)head[1], bounds) == (int)head[0] ? 0 : -1;
+
+    case WAL_BLOCK:
+      if (length < 4 * sizeof(uint32_t))
+        {
+          return -1;
+        }
+      memcpy(head, body, 4 * sizeof(uint32_t));
+      if (head[0] <= (uint32_t)regstore_block_count(store))
+        {
+          return 0;
+        }
+      if (head[0] != (uint32_t)regstore_block_count(store) + 1 || head[1] > INT32_MAX || head[2] > REGSTORE_BLOCK_MAX)
+        {
+          return -1;
+        }
+
+      // the snapshot may have the registers of the block, but not the block yet //
+      if (head[1] + head[2] - 1 <= (uint32_t)regstore_count(store))
+        {
+          return regstore_define_block(store, (int)head[1], (int)head[2]) == (int)head[0] ? 0 : -1;
+        }
+      bounds.ptr = (const char *)body + 4 * sizeof(uint32_t);
+      bounds.len = length - 4 * sizeof(uint32_t);
+      return head[1] == (uint32_t)regstore_count(store) + 1
+             && regstore_add_block(store, (int)head[2], (int32_t)head[3], bounds) == (int)head[0] ? 0 : -1;
+
+    case WAL_BLOCK_WRITE:
+      if (length < 2 * sizeof(uint32_t))
+        {
+          return -1;
+        }
+      memcpy(head, body, 2 * sizeof(uint32_t));
+      if (head[0] > INT32_MAX || (block = regstore_find_block(store, (int)head[0])) == NULL
+          || head[1] != (uint32_t)block->count || length != (2 + head[1]) * sizeof(uint32_t))
+        {
+          return -1;
+        }
+      memcpy(values, body + 2 * sizeof(uint32_t), head[1] * sizeof(int32_t));
+      return regstore_block_write(store, block, values);
+
+    default:
+      return -1;
+    }
+}
+
+// ********** replay ********** //
+// apply the records of a log file to the table, up to the first //
+// one cut short or damaged; returns the number of records, or   //
+// -1 if one does not fit the table; valid is set to the bytes   //
+// of the records that checked out                               //
+static int replay(regstore_t *store, const unsigned char *records, size_t size, size_t *valid)
+{
+  size_t offset = 0;
+  walrecord_t record;
+  int count = 0;
+
+  while (size - offset >= sizeof(record))
+    {
+      memcpy(&record, records + offset, sizeof(record));
+      if (record.length > size - offset - sizeof(record)
+          || record.crc != record_crc(records + offset, record.length))
+        {
+          break; // the last record, being written when the server stopped //
+        }
+
+      if (apply(store, record.type, records + offset + sizeof(record), record.length) != 0)
+        {
+          return -1;
+        }
+
+      offset += sizeof(record) + record.length;
+      count++;
+    }
+
+  *valid = offset;
+  return count;
+}
+
+// ********** write_header ********** //
+// write the header of an empty log file whose first record //
+// will be at position start; returns 0 on success, -1 if not //
+static int write_header(int fd, uint64_t start)
+{
+  walheader_t header;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, WAL_MAGIC, sizeof(header.magic));
+  header.version = WAL_VERSION;
+  header.headersize = sizeof(walheader_t);
+  header.start = start;
+
+  return ftruncate(fd, 0) == 0 && pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) ? 0 : -1;
+}
+
+// ********** wal_open ********** //
+// open the log file of a table, creating it if needed; with replay //
+// the records in it are applied to the table, otherwise they are   //
+// dropped, and from now on the changes of the table are logged;    //
+// returns the number of records replayed, or -1 if the file is not //
+// a valid log of the table                                         //
+int wal_open(wal_t *wal, const char *path, regstore_t *store, int replay_records)
+{
+  const walheader_t *header = NULL;
+  unsigned char *map = NULL;
+  struct stat st;
+  size_t valid = 0;
+  pthread_condattr_t attr;
+  int count = 0;
+
+  memset(wal, 0, sizeof(*wal));
+  wal->notifyfd = -1;
+  pthread_mutex_init(&wal->lock, NULL);
+  pthread_mutex_init(&wal->io_lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&wal->work, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_cond_init(&wal->done, NULL);
+  wal->path = strdup(path);
+  if (wal->path == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in log\n");
+      exit(1);
+    }
+
+  wal->fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (wal->fd < 0 || fstat(wal->fd, &st) != 0)
+    {
+      log_error("ERROR: Could not open the log %s: %s\n", path, strerror(errno));
+      return -1;
+    }
+
+  if ((size_t)st.st_size > sizeof(walheader_t) && !replay_records)
+    {
+      log_info("Dropping the changes of %s, there is no snapshot to replay them on\n", path);
+    }
+
+  if ((size_t)st.st_size > 0 && replay_records)
+    {
+      map = (unsigned char *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, wal->fd, 0);
+      header = (const walheader_t *)map;
+      if (map == MAP_FAILED || (size_t)st.st_size < sizeof(walheader_t)
+          || memcmp(header->magic, WAL_MAGIC, sizeof(header->magic)) != 0
+          || header->version != WAL_VERSION || header->headersize != sizeof(walheader_t))
+        {
+          count = -1;
+        }
+      else
+        {
+          wal->start = header->start;
+          count = replay(store, map + sizeof(walheader_t), (size_t)st.st_size - sizeof(walheader_t), &valid);
+        }
+
+      if (map != MAP_FAILED)
+        {
+          munmap(map, (size_t)st.st_size);
+        }
+
+      if (count < 0)
+        {
+          return -1;
+        }
+
+      // the damaged end, if any, is written over by the next records //
+      if (sizeof(walheader_t) + valid < (size_t)st.st_size)
+        {
+          log_info("Dropping the last %zu bytes of %s, a change cut short\n",
+                   (size_t)st.st_size - sizeof(walheader_t) - valid, path);
+        }
+      if (ftruncate(wal->fd, (off_t)(sizeof(walheader_t) + valid)) != 0)
+        {
+          log_error("ERROR: Could not open the log %s: %s\n", path, strerror(errno));
+          return -1;
+        }
+    }
+  else if (write_header(wal->fd, 0) != 0 || fdatasync(wal->fd) != 0)
+    {
+      log_error("ERROR: Could not write the log %s: %s\n", path, strerror(errno));
+      return -1;
+    }
+
+  lseek(wal->fd, 0, SEEK_END);
+  wal->taken = wal->start + valid;
+  atomic_store(&wal->appended, wal->taken);
+  atomic_store(&wal->durable, wal->taken);
+  atomic_store(&wal->logged, regstore_count(store));
+  atomic_store(&wal->loggedblocks, regstore_block_count(store));
+  wal->store = store;
+
+  return count;
+}
+
+// ********** write_out ********** //
+// write the records taken from the buffers to the file and fsync //
+// it, then tell the threads waiting for them; returns 0 on       //
+// success, -1 if not                                             //
+static int write_out(wal_t *wal)
+{
+  walbuffer_t *buffers;
+  walrecord_t record;
+  outbuf_t records;
+  uint64_t from, target, position, one = 1;
+  int failed;
+
+  pthread_mutex_lock(&wal->io_lock);
+
+  // the records of all the buffers are taken at once, so they are //
+  // all the records before target: each is reserved and copied    //
+  // with its buffer locked                                        //
+  pthread_mutex_lock(&wal->lock);
+  buffers = wal->buffers;
+  for (walbuffer_t *buffer = buffers; buffer != NULL; buffer = buffer->next)
+    {
+      pthread_mutex_lock(&buffer->lock);
+    }
+  target = atomic_load(&wal->appended);
+  for (walbuffer_t *buffer = buffers; buffer != NULL; buffer = buffer->next)
+    {
+      records = buffer->pending;
+      buffer->pending = buffer->writing;
+      buffer->writing = records;
+      pthread_mutex_unlock(&buffer->lock);
+    }
+  from = wal->taken;
+  wal->taken = target;
+  failed = wal->failed;
+  pthread_mutex_unlock(&wal->lock);
+
+  // and put in log order, each at its position //
+  if (target - from > wal->imagesize)
+    {
+      free(wal->image);
+      wal->imagesize = (size_t)(target - from);
+      wal->image = (char *)malloc(wal->imagesize);
+      if (wal->image == NULL)
+        {
+          fprintf(stderr, "Memory allocation error in log\n");
+          exit(1);
+        }
+    }
+  for (walbuffer_t *buffer = buffers; buffer != NULL; buffer = buffer->next)
+    {
+      for (size_t offset = 0; offset < buffer->writing.len; offset += sizeof(position) + RECORD_SIZE(record.length))
+        {
+          memcpy(&position, buffer->writing.data + offset, sizeof(position));
+          memcpy(&record, buffer->writing.data + offset + sizeof(position), sizeof(record));
+          memcpy(wal->image + (position - from), buffer->writing.data + offset + sizeof(position), RECORD_SIZE(record.length));
+        }
+      buffer->writing.len = 0;
+    }
+
+  if (!failed && target > from
+      && (my_write(wal->fd, wal->image, (size_t)(target - from)) != (ssize_t)(target - from) || fdatasync(wal->fd) != 0))
+    {
+      log_error("ERROR: Could not write the log %s: %s\n", wal->path, strerror(errno));
+      failed = 1;
+    }
+
+  pthread_mutex_lock(&wal->lock);
+  if (!failed)
+    {
+      atomic_store_explicit(&wal->durable, target, memory_order_release);
+    }
+  wal->failed = failed;
+  pthread_cond_broadcast(&wal->done);
+  pthread_mutex_unlock(&wal->lock);
+
+  pthread_mutex_unlock(&wal->io_lock);
+
+  if (wal->notifyfd >= 0 && write(wal->notifyfd, &one, sizeof(one)) != sizeof(one))
+    {
+      log_error("ERROR: Could not tell of the log %s written\n", wal->path);
+    }
+
+  return failed ? -1 : 0;
+}
+
+// ********** wal_main ********** //
+// the background thread, gathers the records appended within a //
+// window and writes them out with a single fsync               //
+static void *wal_main(void *arg)
+{
+  wal_t *wal = (wal_t *)arg;
+  struct timespec deadline;
+
+  pthread_mutex_lock(&wal->lock);
+  while (1)
+    {
+      // sleeping is set before appended is looked at, and the appends //
+      // look at it after moving appended, so one of them sees the other //
+      atomic_store(&wal->sleeping, 1);
+      while (atomic_load(&wal->appended) == wal->taken && !wal->stopping)
+        {
+          pthread_cond_wait(&wal->work, &wal->lock);
+        }
+      atomic_store(&wal->sleeping, 0);
+
+      if (atomic_load(&wal->appended) == wal->taken)
+        {
+          break; // stopping, and all written out //
+        }
+
+      // the changes arriving within the window share the fsync //
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_nsec += (long)wal->window * 1000000L;
+      deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+      deadline.tv_nsec %= 1000000000L;
+      while (wal->window > 0 && !wal->stopping
+             && pthread_cond_timedwait(&wal->work, &wal->lock, &deadline) != ETIMEDOUT)
+        {
+          continue;
+        }
+
+      pthread_mutex_unlock(&wal->lock);
+      write_out(wal);
+      pthread_mutex_lock(&wal->lock);
+    }
+  pthread_mutex_unlock(&wal->lock);
+
+  return NULL;
+}
+
+// ********** wal_start ********** //
+// start writing out the changes, gathering them for window   //
+// milliseconds; notifyfd, if not -1, is told of every fsync; //
+// returns 0 on success and -1 on failure                     //
+int wal_start(wal_t *wal, int window, int notifyfd)
+{
+  wal->window = window;
+  wal->notifyfd = notifyfd;
+  wal->stopping = 0;
+  if (pthread_create(&wal->thread, NULL, wal_main, wal) != 0)
+    {
+      return -1;
+    }
+
+  wal->running = 1;
+  return 0;
+}
+
+// ********** wal_write ********** //
+// change the value of a register of the table and log it; the //
+// value is already checked against the bounds; returns 0      //
+int wal_write(wal_t *wal, registers_t *reg, int index, int value)
+{
+  walbuffer_t *buffer = thread_buffer(wal);
+  uint32_t head[2] = { (uint32_t)index, 0 };
+  uint64_t position;
+
+  wait_inserted(wal, &wal->logged, index);
+  register_set(reg, value);
+  regstore_touch(wal->store, index); // for the snapshot //
+
+  pthread_mutex_lock(&buffer->lock);
+  position = reserve(wal, RECORD_SIZE(sizeof(head)));
+  head[1] = (uint32_t)register_get(reg); // the value now: a write stored after this one may have reserved first, see wal.h //
+  append(buffer, position, WAL_WRITE, head, sizeof(head), NULL, 0);
+  pthread_mutex_unlock(&buffer->lock);
+
+  wake(wal);
+  return 0;
+}
+
+// ********** wal_add ********** //
+// same as regstore_add, on the table of the log, and logged //
+int wal_add(wal_t *wal, int value, slice_t bounds)
+{
+  walbuffer_t *buffer = thread_buffer(wal);
+  uint32_t head[2] = { 0, (uint32_t)value };
+  int index;
+
+  pthread_mutex_lock(&wal->lock);
+  if ((index = regstore_add(wal->store, value, bounds)) > 0)
+    {
+      head[0] = (uint32_t)index;
+      pthread_mutex_lock(&buffer->lock);
+      append(buffer, reserve(wal, RECORD_SIZE(sizeof(head) + bounds.len)), WAL_INSERT, head, sizeof(head), bounds.ptr, bounds.len);
+      pthread_mutex_unlock(&buffer->lock);
+      atomic_store_explicit(&wal->logged, index, memory_order_release);
+    }
+  pthread_mutex_unlock(&wal->lock);
+
+  wake(wal);
+  return index;
+}
+
+// ********** wal_add_many ********** //
+// same as regstore_add_many, on the table of the log, and logged //
+// as one insertion per register                                  //
+int wal_add_many(wal_t *wal, int count, const int *values, const slice_t *bounds)
+{
+  walbuffer_t *buffer = thread_buffer(wal);
+  uint32_t head[2];
+  uint64_t position;
+  size_t length = 0;
+  int first;
+
+  pthread_mutex_lock(&wal->lock);
+  if ((first = regstore_add_many(wal->store, count, values, bounds)) > 0)
+    {
+      for (int i = 0; i < count; i++)
+        {
+          length += RECORD_SIZE(sizeof(head) + bounds[i].len);
+        }
+
+      pthread_mutex_lock(&buffer->lock);
+      position = reserve(wal, length);
+      for (int i = 0; i < count; i++)
+        {
+          head[0] = (uint32_t)(first + i);
+          head[1] = (uint32_t)values[i];
+          position = append(buffer, position, WAL_INSERT, head, sizeof(head), bounds[i].ptr, bounds[i].len);
+        }
+      pthread_mutex_unlock(&buffer->lock);
+      atomic_store_explicit(&wal->logged, first + count - 1, memory_order_release);
+    }
+  pthread_mutex_unlock(&wal->lock);
+
+  wake(wal);
+  return first;
+}
+
+// ********** wal_add_block ********** //
+// same as regstore_add_block, on the table of the log, and logged //
+int wal_add_block(wal_t *wal, int count, int value, slice_t bounds)
+{
+  walbuffer_t *buffer = thread_buffer(wal);
+  uint32_t head[4] = { 0, 0, (uint32_t)count, (uint32_t)value };
+  int id;
+
+  pthread_mutex_lock(&wal->lock);
+  if ((id = regstore_add_block(wal->store, count, value, bounds)) > 0)
+    {
+      head[0] = (uint32_t)id;
+      head[1] = (uint32_t)regstore_find_block(wal->store, id)->first;
+      pthread_mutex_lock(&buffer->lock);
+      append(buffer, reserve(wal, RECORD_SIZE(sizeof(head) + bounds.len)), WAL_BLOCK, head, sizeof(head), bounds.ptr, bounds.len);
+      pthread_mutex_unlock(&buffer->lock);
+      atomic_store_explicit(&wal->logged, (int)head[1] + count - 1, memory_order_release);
+      atomic_store_explicit(&wal->loggedblocks, id, memory_order_release);
+    }
+  pthread_mutex_unlock(&wal->lock);
+
+  wake(wal);
+  return id;
+}
+
+// ********** wal_block_write ********** //
+// same as regstore_block_write on block id of the table of the //
+// log, and logged if the values were written                   //
+int wal_block_write(wal_t *wal, int id, const int *values)
+{
+  regblock_t *block = regstore_find_block(wal->store, id);
+  walbuffer_t *buffer = thread_buffer(wal);
+  uint32_t head[2] = { (uint32_t)id, 0 };
+  int current[REGSTORE_BLOCK_MAX];
+  uint64_t position;
+  int result;
+
+  if (block == NULL)
+    {
+      return -1;
+    }
+
+  wait_inserted(wal, &wal->loggedblocks, id);
+  if ((result = regstore_block_write(wal->store, block, values)) == 0)
+    {
+      head[1] = (uint32_t)block->count;
+      pthread_mutex_lock(&buffer->lock);
+      position = reserve(wal, RECORD_SIZE(sizeof(head) + block->count * sizeof(int32_t)));
+      regstore_block_read(wal->store, block, current); // the values now, as in wal_write //
+      append(buffer, position, WAL_BLOCK_WRITE, head, sizeof(head), current, block->count * sizeof(int32_t));
+      pthread_mutex_unlock(&buffer->lock);
+      wake(wal);
+    }
+
+  return result;
+}
+
+// ********** wal_commit ********** //
+// wait for the changes the calling thread logged to be on the //
+// disk; returns 0 once they are, and -1 if the log has failed //
+int wal_commit(wal_t *wal)
+{
+  uint64_t target = wal_position;
+  int result;
+
+  if (target <= atomic_load_explicit(&wal->durable, memory_order_acquire))
+    {
+      return 0;
+    }
+
+  pthread_mutex_lock(&wal->lock);
+  while (atomic_load_explicit(&wal->durable, memory_order_relaxed) < target && !wal->failed)
+    {
+      pthread_cond_wait(&wal->done, &wal->lock);
+    }
+  result = wal->failed ? -1 : 0;
+  pthread_mutex_unlock(&wal->lock);
+
+  return result;
+}
+
+// ********** wal_durable ********** //
+// tell, without waiting, if the changes up to position are on //
+// the disk: returns 1 once they are, 0 if not yet and -1 if   //
+// the log has failed                                          //
+int wal_durable(wal_t *wal, uint64_t position)
+{
+  int result;
+
+  if (position <= atomic_load_explicit(&wal->durable, memory_order_acquire))
+    {
+      return 1;
+    }
+
+  pthread_mutex_lock(&wal->lock);
+  result = wal->failed ? -1 : 0;
+  pthread_mutex_unlock(&wal->lock);
+
+  return result;
+}
+
+// ********** wal_mark ********** //
+// the position after the last record appended; the changes up //
+// to it are in the table, so a snapshot taken from now on has  //
+// them all, see wal_compact                                    //
+uint64_t wal_mark(wal_t *wal)
+{
+  return atomic_load(&wal->appended);
+}
+
+// ********** copy_records ********** //
+// copy the records of the log file from the given offset on //
+// into another file; returns 0 on success and -1 on failure //
+static int copy_records(int from, off_t offset, int to)
+{
+  char *buffer = (char *)malloc(WAL_COPY_SIZE);
+  ssize_t length = 0;
+
+  if (buffer == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in log\n");
+      exit(1);
+    }
+
+  while ((length = pread(from, buffer, WAL_COPY_SIZE, offset)) > 0)
+    {
+      if (my_write(to, buffer, (size_t)length) != length)
+        {
+          length = -1;
+          break;
+        }
+      offset += length;
+    }
+
+  free(buffer);
+  return length < 0 ? -1 : 0;
+}
+
+// ********** wal_compact ********** //
+// drop the records before mark, which a snapshot now holds: the //
+// records after it are written into a new file, which replaces  //
+// the old one; returns 0 on success and -1 on failure           //
+int wal_compact(wal_t *wal, uint64_t mark)
+{
+  char *tmppath = NULL;
+  int fd = -1, result = 0;
+
+  pthread_mutex_lock(&wal->lock);
+  result = mark <= wal->start || wal->failed;
+  pthread_mutex_unlock(&wal->lock);
+  if (result)
+    {
+      return 0; // nothing to drop //
+    }
+
+  // the records up to now are written out first, so the file //
+  // holds all the records before and after the mark          //
+  if (write_out(wal) != 0)
+    {
+      return -1;
+    }
+
+  tmppath = (char *)malloc(strlen(wal->path) + 5);
+  if (tmppath == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in log\n");
+      exit(1);
+    }
+  sprintf(tmppath, "%s.tmp", wal->path);
+
+  pthread_mutex_lock(&wal->io_lock);
+  fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || write_header(fd, mark) != 0 || lseek(fd, 0, SEEK_END) < 0
+      || copy_records(wal->fd, (off_t)(sizeof(walheader_t) + (mark - wal->start)), fd) != 0
+      || fdatasync(fd) != 0 || rename(tmppath, wal->path) != 0)
+    {
+      log_error("ERROR: Could not compact the log %s: %s\n", wal->path, strerror(errno));
+      if (fd >= 0)
+        {
+          close(fd);
+          unlink(tmppath);
+        }
+      result = -1;
+    }
+  else
+    {
+      close(wal->fd);
+      wal->fd = fd;
+      pthread_mutex_lock(&wal->lock);
+      wal->start = mark;
+      pthread_mutex_unlock(&wal->lock);
+
+      // or a crash may still find the old file //
+      if (sync_parent_dir(wal->path) != 0)
+        {
+          log_error("ERROR: Could not compact the log %s: %s\n", wal->path, strerror(errno));
+          result = -1;
+        }
+    }
+  pthread_mutex_unlock(&wal->io_lock);
+
+  free(tmppath);
+  return result;
+}
+
+// ********** wal_stop ********** //
+// write out the last records, stop the background thread //
+// and close the log; nothing is logged anymore           //
+void wal_stop(wal_t *wal)
+{
+  if (wal->running)
+    {
+      pthread_mutex_lock(&wal->lock);
+      wal->stopping = 1;
+      pthread_cond_signal(&wal->work);
+      pthread_mutex_unlock(&wal->lock);
+
+      pthread_join(wal->thread, NULL);
+      wal->running = 0;
+    }
+
+  write_out(wal);
+  if (wal->fd >= 0)
+    {
+      close(wal->fd);
+      wal->fd = -1;
+    }
+
+  pthread_mutex_destroy(&wal->lock);
+  pthread_mutex_destroy(&wal->io_lock);
+  pthread_cond_destroy(&wal->work);
+  pthread_cond_destroy(&wal->done);
+  while (wal->buffers != NULL)
+    {
+      walbuffer_t *buffer = wal->buffers;
+
+      wal->buffers = buffer->next;
+      pthread_mutex_destroy(&buffer->lock);
+      outbuf_free(&buffer->pending);
+      outbuf_free(&buffer->writing);
+      free(buffer);
+    }
+  own_buffer = NULL;
+  free(wal->image);
+  wal->image = NULL;
+  free(wal->path);
+  wal->path = NULL;
+  wal->store = NULL;
+}
@@ -0,0 +1,144 @@
+// Header file for the mutation log of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 2/2/2023 //
+
+/* The snapshot alone loses the changes of its last interval in a crash. The
+mutation log keeps every successful change of the register table, i.e. the
+writes, the insertions, the blocks and the block writes, in an append-only
+file, so that none is lost once its reply is out.
+
+Appending a change takes no lock shared between the threads: the record
+gets its position in the log with one atomic add, and is copied into a
+buffer of the thread that made the change. A write stores the value first
+and logs the value the register holds once the position is taken, so the
+last record of a register always holds the value the table kept, whatever
+the order of concurrent writes. Only the insertions are serialised, and a
+write to a register just inserted waits for its insertion to be appended.
+A background thread takes the records of all the buffers at once, puts
+them in log order, writes them out and fsyncs the file, at most once every
+window milliseconds, so all the changes of that time share a single fsync
+(group commit). Before the replies to a read go out, wal_commit waits for
+the changes the thread made to be on the disk; a thread that must not wait,
+like the event loop, keeps the replies back instead until wal_durable says
+they are, and hears of every fsync through the eventfd given to wal_start.
+
+The file starts with a walheader, followed by records of a walrecord and its
+body, checked with the CRC-16 of the binary protocol. A record that is cut
+short or does not check out is the end of the log: it was being written when
+the server stopped, and was never acknowledged.
+
+The log is compacted into the snapshot: a snapshot marks the end of the log
+before copying the table, and once it is on the disk the records before the
+mark are dropped, see wal_mark and wal_compact. On start the table is loaded
+from the snapshot and the records left in the log are replayed on it. A
+record may be in the snapshot already, so replaying one twice is harmless.
+*/
+
+#ifndef __WAL_H_
+#define __WAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "regstore.h"
+#include "commonfunc.h"
+
+// Preprocessor //
+#define WAL_MAGIC "SERCWAL" // the first 8 bytes of a log file, with the '\0' //
+#define WAL_VERSION 1 // raised whenever the layout changes //
+#define WAL_WINDOW 1 // default milliseconds the changes are gathered for one fsync //
+
+// record types //
+#define WAL_WRITE 1 // index (uint32), value (int32) //
+#define WAL_INSERT 2 // index (uint32), value (int32), bounds (the rest of the body) //
+#define WAL_BLOCK 3 // id, first, count (uint32), value (int32), bounds (the rest of the body) //
+#define WAL_BLOCK_WRITE 4 // id, count (uint32), values (int32[count]) //
+
+// Structs //
+// Log Header Struct //
+// The on-disk header of the log file //
+struct walheader{
+	char magic[8]; // WAL_MAGIC //
+	uint32_t version; // WAL_VERSION //
+	uint32_t headersize; // sizeof(struct walheader) //
+	uint64_t start; // the position in the log of the first record, see wal_t //
+};
+
+typedef struct walheader walheader_t;
+
+// Log Record Struct //
+// The header of every record, followed by length bytes of body; //
+// the CRC covers the type and the body                           //
+struct walrecord{
+	uint32_t length; // the bytes of the body //
+	uint16_t crc; // bin_crc16 of type, reserved and the body //
+	uint8_t type; // one of the WAL_* record types //
+	uint8_t reserved; // 0 //
+};
+
+typedef struct walrecord walrecord_t;
+
+// Log Buffer Struct //
+// The records one thread appended, each preceded by its position //
+// in the log. Only the background thread ever waits for the lock, //
+// while it takes the records, see write_out                       //
+struct walbuffer{
+	struct wal *wal; // the log it belongs to //
+	pthread_mutex_t lock; // held while a record is reserved and copied, or the records are taken //
+	outbuf_t pending; // the records not taken yet //
+	outbuf_t writing; // the records taken, guarded by io_lock of the log //
+	struct walbuffer *next; // the buffer of another thread //
+};
+
+typedef struct walbuffer walbuffer_t;
+
+// Mutation Log Struct //
+// The positions count the bytes of records appended since the log //
+// was created; the file holds the records from start on           //
+struct wal{
+	char *path; // the log file //
+	int fd; // the open log file //
+	regstore_t *store; // the table logged, NULL while nothing is logged //
+	int window; // milliseconds the changes are gathered for one fsync //
+	int notifyfd; // eventfd written to whenever durable moves on, -1 if none //
+	pthread_mutex_t lock; // guards buffers, taken, start, failed and stopping, and serialises the insertions //
+	pthread_mutex_t io_lock; // taken while the file is written or replaced //
+	pthread_cond_t work; // signalled when there are records to write out //
+	pthread_cond_t done; // broadcast when durable moves on //
+	walbuffer_t *buffers; // the buffers of the threads, new ones in front //
+	char *image; // the records taken, in log order, as they are written to the file //
+	size_t imagesize; // the allocated size of image //
+	uint64_t start; // the position of the first record of the file //
+	atomic_ullong appended; // the position after the last record reserved //
+	uint64_t taken; // the position up to which the records are taken from the buffers //
+	atomic_ullong durable; // the position up to which the records are on the disk //
+	atomic_int logged; // the registers whose insertion is appended, see wal_write //
+	atomic_int loggedblocks; // the blocks whose insertion is appended //
+	atomic_int sleeping; // set while the background thread waits for records //
+	int failed; // set once the file could not be written //
+	int running; // set while the background thread runs //
+	int stopping; // set to stop the background thread //
+	pthread_t thread; // the background thread //
+};
+
+typedef struct wal wal_t;
+
+// Globals //
+extern _Thread_local uint64_t wal_position; // the end of the last record the thread appended //
+
+// Function Prototypes //
+int wal_open(wal_t *wal, const char *path, regstore_t *store, int replay);
+int wal_start(wal_t *wal, int window, int notifyfd);
+int wal_write(wal_t *wal, registers_t *reg, int index, int value);
+int wal_add(wal_t *wal, int value, slice_t bounds);
+int wal_add_many(wal_t *wal, int count, const int *values, const slice_t *bounds);
+int wal_add_block(wal_t *wal, int count, int value, slice_t bounds);
+int wal_block_write(wal_t *wal, int id, const int *values);
+int wal_commit(wal_t *wal);
+int wal_durable(wal_t *wal, uint64_t position);
+uint64_t wal_mark(wal_t *wal);
+int wal_compact(wal_t *wal, uint64_t mark);
+void wal_stop(wal_t *wal);
+
+#endif
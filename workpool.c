@@ -0,0 +1,170 @@
+// Worker pool used by the server //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+#include "workpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Struct handed to a worker thread //
+struct workerarg{
+	workpool_t *pool;
+	workqueue_t *queue;
+};
+
+// ********** worker_main ********** //
+// take the items of the queue and execute them, until //
+// the pool is stopped and the queue is empty          //
+static void *worker_main(void *arg)
+{
+  workpool_t *pool = ((struct workerarg *)arg)->pool;
+  workqueue_t *queue = ((struct workerarg *)arg)->queue;
+  workitem_t *items, *next;
+
+  free(arg);
+
+  while (1)
+    {
+      pthread_mutex_lock(&queue->lock);
+      while (queue->head == NULL && !queue->stopping)
+        {
+          pthread_cond_wait(&queue->ready, &queue->lock);
+        }
+
+      items = queue->head; // take the whole queue //
+      queue->head = queue->tail = NULL;
+      pthread_mutex_unlock(&queue->lock);
+
+      if (items == NULL)
+        {
+          return NULL; // stopping and nothing is left //
+        }
+
+      for (; items != NULL; items = next)
+        {
+          next = items->next;
+          pool->work(items);
+
+          if (pool->done != NULL && (next == NULL || next->owner != items->owner))
+            {
+              pool->done(items->owner);
+            }
+
+          free(items);
+        }
+    }
+}
+
+// ********** workpool_start ********** //
+// start a pool of count workers //
+// returns 0 on success and -1 on failure //
+int workpool_start(workpool_t *pool, int count, workfunc_t work, donefunc_t done)
+{
+  pool->count = count;
+  pool->work = work;
+  pool->done = done;
+  pool->threads = (pthread_t *)calloc(count, sizeof(pthread_t));
+  pool->queues = (workqueue_t *)calloc(count, sizeof(workqueue_t));
+
+  if (pool->threads == NULL || pool->queues == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in the worker pool\n");
+      exit(1);
+    }
+
+  for (int i = 0; i < count; i++)
+    {
+      struct workerarg *arg = (struct workerarg *)malloc(sizeof(struct workerarg));
+
+      if (arg == NULL)
+        {
+          fprintf(stderr, "Memory allocation error in the worker pool\n");
+          exit(1);
+        }
+
+      pthread_mutex_init(&pool->queues[i].lock, NULL);
+      pthread_cond_init(&pool->queues[i].ready, NULL);
+      arg->pool = pool;
+      arg->queue = &pool->queues[i];
+
+      if (pthread_create(&pool->threads[i], NULL, worker_main, arg) != 0)
+        {
+          free(arg);
+          pool->count = i; // stop the ones already running //
+          workpool_stop(pool);
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
+// ********** workitem_new ********** //
+// create a work item with a copy of the data //
+workitem_t *workitem_new(void *owner, int kind, const void *data, size_t length)
+{
+  workitem_t *item = (workitem_t *)malloc(sizeof(workitem_t) + length + 1);
+
+  if (item == NULL)
+    {
+      fprintf(stderr, "Memory allocation error in the worker pool\n");
+      exit(1);
+    }
+
+  item->next = NULL;
+  item->owner = owner;
+  item->kind = kind;
+  item->length = length;
+  memcpy(item->data, data, length);
+  item->data[length] = '\0';
+
+  return item;
+}
+
+// ********** workpool_submit ********** //
+// queue an item to the worker of the shard; the items //
+// of a shard are executed in the order they were queued //
+void workpool_submit(workpool_t *pool, unsigned int shard, workitem_t *item)
+{
+  workqueue_t *queue = &pool->queues[shard % pool->count];
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->tail == NULL)
+    {
+      queue->head = item;
+    }
+  else
+    {
+      queue->tail->next = item;
+    }
+  queue->tail = item;
+  pthread_cond_signal(&queue->ready);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// ********** workpool_stop ********** //
+// let the workers finish what is queued, then stop them //
+void workpool_stop(workpool_t *pool)
+{
+  for (int i = 0; i < pool->count; i++)
+    {
+      pthread_mutex_lock(&pool->queues[i].lock);
+      pool->queues[i].stopping = 1;
+      pthread_cond_signal(&pool->queues[i].ready);
+      pthread_mutex_unlock(&pool->queues[i].lock);
+    }
+
+  for (int i = 0; i < pool->count; i++)
+    {
+      pthread_join(pool->threads[i], NULL);
+      pthread_mutex_destroy(&pool->queues[i].lock);
+      pthread_cond_destroy(&pool->queues[i].ready);
+    }
+
+  free(pool->threads);
+  free(pool->queues);
+  pool->threads = NULL;
+  pool->queues = NULL;
+  pool->count = 0;
+}
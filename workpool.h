@@ -0,0 +1,66 @@
+// Header file for the worker pool of the server //
+// Author: Vangelis Bakas //
+// Last Edited: 31/1/2023 //
+
+/* The event loop thread reads and frames the requests and hands them to a
+pool of worker threads, which execute them. Every worker has its own queue,
+and the work of one owner (a serial port) always goes to the same queue, so
+the requests of a port are executed, and answered, in the order they arrived,
+while different ports are served in parallel.
+
+A worker takes everything in its queue at once and calls the work function
+for every item; after the last item of a run of items of the same owner it
+calls the done function, e.g. to write out the replies of that owner together.
+*/
+
+#ifndef __WORKPOOL_H_
+#define __WORKPOOL_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Structs //
+// Work Item Struct //
+// One piece of work, e.g. a request, with a private copy of its data //
+struct workitem{
+	struct workitem *next; // the next item in the queue //
+	void *owner; // who the work belongs to, e.g. the port //
+	int kind; // what kind of work it is, chosen by the user of the pool //
+	size_t length; // the length of the data //
+	char data[]; // the data, always followed by a '\0' //
+};
+
+typedef struct workitem workitem_t;
+
+typedef void (*workfunc_t)(workitem_t *item);
+typedef void (*donefunc_t)(void *owner);
+
+// Work Queue Struct //
+struct workqueue{
+	pthread_mutex_t lock;
+	pthread_cond_t ready; // signalled when an item is queued //
+	workitem_t *head; // the oldest item //
+	workitem_t *tail; // the newest item //
+	int stopping; // set when the pool is stopped //
+};
+
+typedef struct workqueue workqueue_t;
+
+// Worker Pool Struct //
+struct workpool{
+	int count; // the number of workers //
+	pthread_t *threads; // the worker threads //
+	workqueue_t *queues; // one queue per worker //
+	workfunc_t work; // called for every item //
+	donefunc_t done; // called after the last item of a run of an owner //
+};
+
+typedef struct workpool workpool_t;
+
+// Function Prototypes //
+int workpool_start(workpool_t *pool, int count, workfunc_t work, donefunc_t done);
+workitem_t *workitem_new(void *owner, int kind, const void *data, size_t length);
+void workpool_submit(workpool_t *pool, unsigned int shard, workitem_t *item);
+void workpool_stop(workpool_t *pool);
+
+#endif